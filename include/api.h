@@ -23,11 +23,50 @@ void TypingInsertTab();
 // Clears line and inserts correct indent
 void TypingClearLine();
 
-typedef struct CursorPos
-{
-    int row;
-    int col;
-} CursorPos;
+// Adds an extra cursor at row/col, unless there already is one.
+void MultiAdd(int row, int col);
+// Leaves an extra cursor at the cursor position and moves the cursor down.
+void MultiAddBelow();
+// Puts cursors at col on the rows of block r that reach into it, the main
+// cursor on the first. Returns false if no row reaches into the block.
+bool MultiAddColumn(Range r, int col);
+// Adds an extra cursor at every match of the buffer search. Returns the
+// number of cursors added.
+int MultiAddMatches();
+// Removes all extra cursors.
+void MultiClear();
+// Writes text at all cursors as one change.
+void MultiWrite(char *text, int length);
+// Deletes the character before every cursor as one change. Does not join lines.
+void MultiBackspace();
+// Deletes the character after every cursor as one change. Does not join lines.
+void MultiDelete();
+// Moves all cursors by x, y.
+void MultiMove(int x, int y);
+
+// Starts selecting text of the given kind from the cursor and enters visual mode.
+void SelectStart(SelectMode mode);
+// Ends the selection and returns to edit mode.
+void SelectEnd();
+// Returns the selected range of the current buffer. The cursor char is included.
+Range SelectRange();
+// Copies range of the current buffer into register name, a-z or any other
+// character for the unnamed register. Whole lines are shared, not copied.
+void Yank(char name, Range r);
+// Yanks lines from row into register name.
+void YankLines(char name, int row, int count);
+// Yanks range into register name and deletes it as one undo step.
+void DeleteRange(char name, Range r);
+// Like DeleteRange, but whole lines are replaced by one line keeping the indent.
+void ChangeRange(char name, Range r);
+// Moves count lines from row to before the line at dest as one undo record.
+// Returns false if dest is inside the lines.
+bool MoveLines(int row, int count, int dest);
+// Replaces count lines from row with the newline separated lines of text as
+// one undo step. Text may be NULL to only delete the lines.
+void ReplaceLines(int row, int count, char *text, int length);
+// Puts register name after the cursor, or before it if before is true.
+void Put(char name, bool before);
 
 // Returns position of first character of next word
 int FindNextWordBegin();
@@ -43,7 +82,57 @@ int FindNextBlankLine();
 int FindPrevBlankLine();
 // Returns position of next or prev c on current line
 int FindNextChar(char c, bool backwards);
-// Returns next instance of search term in file from current cursor position
-CursorPos FindNext(char *search, int length);
-// Returns prev instance of search term in file from current cursor position
-CursorPos FindPrev(char *search, int length);
\ No newline at end of file
+// Returns next instance of search in file after the cursor. Wraps around to the
+// top of the file. Returns the cursor position if there is no match.
+CursorPos FindNext(Search *search);
+// Returns prev instance of search in file before the cursor. Wraps around to the
+// bottom of the file. Returns the cursor position if there is no match.
+CursorPos FindPrev(Search *search);
+// Returns next match of the buffer search after the cursor, looked up in the
+// match index. Wraps around. Returns the cursor position if there is no match.
+CursorPos FindNextMatch();
+// Same as FindNextMatch but returns the previous match before the cursor.
+CursorPos FindPrevMatch();
+// Starts incremental search in the current buffer from the cursor position.
+void FindIncStart();
+// Searches for query and moves the cursor to the first match after the start
+// position. Returns false if the search was cancelled by a pending key press.
+bool FindIncUpdate(char *query, int length);
+// Ends incremental search. Restores the cursor and previous search if cancel is true.
+void FindIncEnd(bool cancel);
+
+// Replaces matches of s in rows startRow to endRow, inclusive, with rep. Only
+// the first match in each line is replaced unless global is true. The whole
+// replace is one undo action. Returns number of replaced matches.
+int Replace(Search *s, char *rep, int repLength, int startRow, int endRow, bool global);
+// Runs a substitute command: s/pattern/replacement/[g] on the current line or
+// %s/pattern/replacement/[g] on the whole buffer. Pattern is a regex.
+void Substitute(char *command);
+
+// Sorts rows startRow to endRow, inclusive, as one undo action. Equal lines
+// keep their order. Numeric sorts by the first number in each line. Unique
+// keeps only the first of equal lines. Returns the number of lines removed,
+// or -1 if the sort was canceled.
+int SortLines(int startRow, int endRow, bool unique, bool numeric, bool reverse);
+
+// Runs command with rows startRow to endRow, inclusive, as input and replaces
+// them with its output as one undo step. The buffer is left unchanged if the
+// command fails. Returns false if the command could not be run or failed.
+bool Filter(int startRow, int endRow, char *command);
+// Runs a filter command: !cmd on the current line or selection, or %!cmd on the
+// whole buffer.
+void FilterCommand(char *command);
+
+// Starts searching all files in dir and below for pattern and shows the results
+// buffer. Results are added as they are found.
+void GrepStart(char *pattern, int length, char *dir);
+// Stops the running search, if any. Results found so far are kept.
+void GrepCancel();
+// Adds results found since the last call to the results buffer. Must be called
+// from the input thread. Returns true if the results buffer changed.
+bool GrepApplyResults();
+// Switches to the results buffer of the last search. Returns false if there is none.
+bool GrepShowResults();
+// Opens the file of the result under the cursor in the results buffer and
+// moves the cursor to the match. Returns false if the line is not a result.
+bool GrepOpenResult();
\ No newline at end of file
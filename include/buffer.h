@@ -2,10 +2,23 @@
 
 Buffer *BufferNew();
 void BufferFree(Buffer *b);
+// Frees the text of b to save memory, keeping the cursor and search. Undo
+// history must be empty or in the journal. Reload with BufferReload.
+void BufferUnload(Buffer *b);
+// Reads the text of an unloaded buffer from buf, the current content of its file.
+void BufferReload(Buffer *b, char *buf, int size);
 
 // Writes characters to buffer at cursor position.
 void BufferWrite(Buffer *buf, char *source, int length);
 void BufferWriteEx(Buffer *buf, int row, int col, char *source, int length);
+// Writes text at every position in pos, sorted by row and col. Each line is
+// changed once. Positions are moved past the text written at them.
+void BufferWriteMany(Buffer *b, CursorPos *pos, int count, char *text, int length);
+// Deletes counts[i] characters before every position in pos, sorted by row and
+// col, ranges must not overlap. Positions are moved to where the text was.
+void BufferDeleteMany(Buffer *b, CursorPos *pos, int *counts, int count);
+// Replaces the text of line at row. The line is allocated once at the new size.
+void BufferReplaceLine(Buffer *b, int row, char *text, int length);
 // Writes to buffer at row/col. Replaces any characters that are already there.
 void BufferOverWrite(Buffer *b, char *source, int length);
 void BufferOverWriteEx(Buffer *b, int row, int col, char *source, int length);
@@ -17,6 +30,21 @@ void BufferInsertLine(Buffer *buf, int row);
 void BufferInsertLineEx(Buffer *b, int row, char *text, int textLen);
 // Deletes line at row and move all lines below upwards.
 void BufferDeleteLine(Buffer *buf, int row);
+// Inserts count lines at row, taking over their text. The line array is
+// shifted once.
+void BufferInsertLines(Buffer *b, int row, Line *lines, int count);
+// Inserts the lines of text, separated by newlines, at row. The line array is
+// shifted once. Returns the number of lines inserted.
+int BufferInsertText(Buffer *b, int row, char *text, int length);
+// Deletes count lines from row. The line array is shifted once. The buffer
+// keeps one empty line if all are deleted.
+void BufferDeleteLines(Buffer *b, int row, int count);
+// Moves count lines from row to before the line at dest, which must not be one
+// of them. Only the lines in between are shifted.
+void BufferMoveLines(Buffer *b, int row, int count, int dest);
+// Reorders the count lines from row so that line i is the one at row +
+// order[i], keeping the first newCount of them. Lines not in order are freed.
+void BufferPermuteLines(Buffer *b, int row, int count, int *order, int newCount);
 // Copies and removes all characters behind the cursor position,
 // then pastes them at the end of the line below.
 void BufferMoveTextDown(Buffer *buf);
@@ -28,15 +56,68 @@ int BufferMoveTextUpEx(Buffer *buf, int row, int col);
 void BufferScroll(Buffer *buf);
 // Returns number of spaces before the cursor
 int BufferGetPrefixedSpaces(Buffer *buf);
-// Draws buffer to fill width withing area of y to y+h.
-void BufferRender(Buffer *b, int y, int h);
-// Draws buffer contents at x, y, with a maximum width and height.
-void BufferRenderEx(Buffer *buf, int x, int y, int width, int height);
+// Appends row y of a view of b with cursor c to cb, exactly width columns wide.
+// The part of the text in sel is drawn selected.
+void BufferRenderRow(Buffer *b, Cursor *c, CharBuf *cb, int y, int width, Range *sel);
 // Loads file contents into a new Buffer and returns it. Returns NULL on failure.
 Buffer *BufferLoadFile(char *filepath, char *buf, int size);
 // Saves buffer contents to file. Returns true on success.
 bool BufferSaveFile(Buffer *b);
 
+// Returns a snapshot of the lines of b. It can be read from any thread and must
+// be freed with SnapshotFree.
+Snapshot *BufferSnapshot(Buffer *b);
+// Releases a snapshot. Safe to call from any thread.
+void SnapshotFree(Snapshot *s);
+// Gives b its own line array if the current one was taken by a snapshot.
+void BufferUnshare(Buffer *b);
+// Line text is reference counted so snapshots can share it. LineAlloc returns
+// zeroed text, LineRealloc must only be used on text that is not shared.
+char *LineAlloc(int cap);
+char *LineRealloc(char *chars, int cap);
+void LineFree(char *chars);
+// Adds a reference to line text and returns it.
+char *LineShare(char *chars);
+// Gives line its own copy of its text if it is shared with a snapshot.
+void LineOwn(Line *line);
+
+// Returns the highlighted text of length bytes of row from col, cached until b
+// changes. Must NOT be freed.
+char *HighlightCached(Buffer *b, int row, int col, int length, int *newLength);
+// Frees the highlight cache of b. Must be called when colors or syntax change.
+void HighlightCacheFree(Buffer *b);
+
+// Invalidates the match index. Must be called when the buffer search changes.
+void MatchIndexClear(Buffer *b);
+void MatchIndexFree(Buffer *b);
+// Marks row as changed so its matches are searched again on next update.
+void MatchIndexTouch(Buffer *b, int row);
+// Shifts matches after a line is inserted or deleted at row.
+void MatchIndexInsertRow(Buffer *b, int row);
+void MatchIndexDeleteRow(Buffer *b, int row);
+// Shifts matches after count lines are inserted or deleted at row.
+void MatchIndexInsertRows(Buffer *b, int row, int count);
+void MatchIndexDeleteRows(Buffer *b, int row, int count);
+// Builds the index from a list of sorted rows known to contain all matches.
+void MatchIndexBuildRows(Buffer *b, int *rows, int numRows);
+// Brings the index up to date with the buffer search.
+void MatchIndexUpdate(Buffer *b);
+// Returns index of the first match after row/col, or the last one before it if
+// backwards is true. Wraps around. Returns -1 if there are no matches.
+int MatchIndexFind(Buffer *b, int row, int col, bool backwards);
+// Returns index of the match starting at row/col, -1 if there is none.
+int MatchIndexAt(Buffer *b, int row, int col);
+
+// Starts building a trigram index for the read-only file in b on a background
+// thread. Does nothing if the index is disabled or the buffer is small.
+void TrigramStart(Buffer *b);
+// Stops the index thread and frees the index, if any.
+void TrigramFree(Buffer *b);
+// Returns a filter with one byte per block of TRIGRAM_BLOCK_SHIFT rows, where
+// blocks that cannot contain a match of s are 0. Returns NULL if there is no
+// index ready or s has no literal of at least three bytes.
+uint8_t *TrigramFilter(Buffer *b, Search *s);
+
 // Sets cursor position in buffer space, scrolls if necessary. keepX is true when the cursor
 // should keep the current max width when moving vertically, only really used with CursorMove.
 void CursorSetPos(Buffer *buf, int x, int y, bool keepX);
@@ -2,10 +2,10 @@
 
 typedef struct CmdOptions
 {
-    bool hasFile;
-    char filename[260];
+    int numFiles;
+    char **files; // Files and patterns to open, the first one is shown
 } CmdOptions;
 
 // Writes to op. Returns false on failure or if program should exit.
 // Handles print commands like --help and --version.
-bool ProcessArgs(int argc, char **argv, CmdOptions *op);
\ No newline at end of file
+bool ProcessArgs(int argc, char **argv, CmdOptions *op);
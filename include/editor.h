@@ -13,29 +13,80 @@ void EditorInit(CmdOptions options);
 void EditorFree();
 // Hangs when waiting for input. Returns error if read failed. Writes to info.
 Status EditorReadInput(InputInfo *info);
+// Returns true if a key press is waiting in the input queue.
+bool EditorKeyPending();
+// Discards the waiting key presses. Other events, like wakes, are kept.
+void EditorDiscardKeys();
+// Waits for job to finish, showing label and progress on the command line.
+// Count is the number of tasks in the job. A key press cancels the job and is
+// discarded. Returns false if the job was canceled. Does not free the job.
+bool EditorWaitJob(PoolJob *job, int count, char *label);
+// Wakes the input thread from a background thread. The input thread handles
+// any pending background work and renders.
+void EditorWake();
 // Handles inputs for insert mode (default)
 Status HandleInsertMode(InputInfo *info);
 // Handles inputs for Vim mode (command mode)
 Status HandleVimMode(InputInfo *info);
+// Handles inputs while selecting text
+Status HandleVisualMode(InputInfo *info);
 // Sets editor input mode
 void EditorSetMode(InputMode mode);
 // Waits for input and takes action for insert mode.
 Status EditorHandleInput();
-// Loads file into buffer. Filepath must either be an absolute path
-// or name of a file in the same directory as working directory.
+// Loads file into a new buffer, or shows it if it is already open. Filepath must
+// either be an absolute path or name of a file in the same directory as
+// working directory.
 Status EditorOpenFile(char *filepath);
 // Writes content of buffer to filepath. Always truncates file.
 Status EditorSaveFile();
-// Replaces current buffer with b.
+
+// Shows b, adding it to the buffer list if it is not in it. A new buffer
+// replaces the current one if that is empty and unused.
 void EditorSetCurrentBuffer(Buffer *b);
+// Shows the buffer at index in the buffer list.
+void EditorShowBuffer(int index);
+// Adds b to the end of the buffer list without showing it.
+void EditorAddBuffer(Buffer *b);
+// Removes b from the buffer list without freeing it. If b is shown, the buffer
+// before it is shown instead, or a new empty one if it was the last.
+void EditorRemoveBuffer(Buffer *b);
+// Closes the current buffer, asking to save it first if it has changes.
+void EditorCloseBuffer();
+// Returns the index of b in the buffer list, -1 if it is not in it.
+int EditorBufferIndex(Buffer *b);
+// Returns the open buffer of the file at filepath, NULL if there is none. Other
+// paths to an open file, eg. links, give the same buffer.
+Buffer *EditorFindBuffer(char *filepath);
+// Writes the identity of the file at path to id. Returns false if it cannot be
+// read, eg. if the file does not exist.
+bool EditorFileId(char *path, FileId *id);
+// Returns true if a and b are valid and the same file.
+bool EditorSameFile(FileId *a, FileId *b);
+// Shows the buffer at offset from the current one in the list, wrapping around.
+void EditorCycleBuffer(int offset);
+// Shows the buffer given by its number in the list or part of its path.
+// Returns false if there is no match or more than one.
+bool EditorSwitchBuffer(char *name);
+// Writes the buffer list to dest as numbered names, the current one marked
+// with % and changed ones with *.
+void EditorListBuffers(char *dest, int size);
+// Opens the files matching the patterns, which may have * and ? wildcards,
+// loading them in parallel. Shows the first file once it is loaded, the rest
+// are added in the background. Returns false if no file could be opened.
+bool LoaderOpen(char **patterns, int count);
+// Adds files loaded since the last call to the buffer list. Must be called from
+// the input thread. Returns true if anything changed.
+bool LoaderApplyResults();
 // Read file realitive to cwd. Writes to size. Returns file content.
 // Remember to free!
 char *EditorReadFile(const char *filepath, int *size);
-// Loads help text into a new buffer and displays it.
+// Shows the help buffer, loading the help text if it is not open.
 void EditorShowHelp();
 
-// Asks user if they want to exit without saving. Writes file if answered yes.
-void PromptFileNotSaved();
+// Asks user if they want to close the current buffer without saving. Writes
+// file if answered yes. Returns false if its changes were not saved or declined.
+bool PromptFileNotSaved();
 // Prompts user for command input. If command is not NULL, it is set as the
 // current command and cannot be removed by the user, used for shorthands.
 void PromptCommand(char *command);
@@ -45,13 +96,66 @@ void PromptCommand(char *command);
 Status LoadConfig(Config *config);
 // Loads theme data into colors. Returns false on failure.
 Status LoadTheme(char *name, Colors *colors);
-// Loads syntax from file and sets new table in buffer if found.
+// Looks up syntax for the file extension and sets the table in buffer if found.
 Status LoadSyntax(Buffer *b, char *filepath);
+// Parses all tables in the syntax file. Returns NULL on failure.
+SyntaxRegistry *LoadSyntaxRegistry();
+void SyntaxRegistryFree(SyntaxRegistry *reg);
+// Returns the table for the given file extension, NULL if none is found.
+SyntaxTable *SyntaxLookup(SyntaxRegistry *reg, char *extension);
+
+// Starts watching the config directory for changes in a background thread.
+void ConfigWatchStart();
+// Asks the config watcher to load the theme in the background.
+void ConfigRequestTheme(char *name);
+// Swaps in config, theme and syntax reloaded by the watcher. Returns true
+// if anything was swapped. Must only be called from the input thread.
+bool ConfigApplyReload();
+
+// Starts recording key presses into macro register name.
+void MacroRecordStart(char name);
+// Stops recording. The key that stopped it is not kept.
+void MacroRecordStop();
+// Returns the name of the register being recorded, 0 if not recording.
+char MacroRecording();
+// Adds a key read from the console to the macro being recorded, if any.
+void MacroRecordInput(InputInfo *info);
+// Writes the next key of the playing macro to info. Returns false if no macro
+// is playing.
+bool MacroNextInput(InputInfo *info);
+// Plays macro name count times without drawing in between. @ plays the last
+// played macro.
+void MacroPlay(char name, int count);
 
 // Undos last action if any.
 void Undo();
+// Redos last undone action if any.
+void Redo();
+// Moves to the state made before/after the current one, across undo branches.
+void UndoOlder();
+void UndoNewer();
 // Saves action to undo stack. May group it with previous actions if suitable.
 void UndoSaveAction(Action type, char *text, int textLen);
 void UndoSaveActionEx(Action type, int row, int col, char *text, int textLen);
 // Joins last n actions under same undo call.
-void UndoJoin(int n);
\ No newline at end of file
+void UndoJoin(int n);
+// Actions between these are undone as one, groups can be nested.
+void UndoGroupBegin();
+void UndoGroupEnd();
+// Adds a state with a copy of the given records as a child of parent. Used
+// when loading the journal. Returns false if the records are malformed.
+bool UndoLoadNode(UndoLog *log, int parent, char *records, int length);
+// Frees the undo history of a buffer. The journal is kept.
+void UndoFree(UndoLog *log);
+
+// Sets up the undo journal for a file just read into b. An existing journal is
+// kept if it was saved with the same content and loaded on first use.
+void JournalOpen(Buffer *b, char *text, int length);
+// Loads the journal into the undo log of b, which must only have the root.
+void JournalLoad(Buffer *b);
+// Writes finished undo states of b to its journal.
+void JournalFlush(Buffer *b);
+// Writes all undo states of b and marks the current one as saved.
+void JournalSave(Buffer *b, char *text, int length);
+// Writes remaining undo states of b and frees the journal.
+void JournalClose(Buffer *b);
\ No newline at end of file
@@ -7,9 +7,10 @@ typedef unsigned char byte;
 
 #define SYNTAX_NAME_LEN 16 // Length of extension name in syntax file
 #define THEME_NAME_LEN 32  // Length of name in theme file
-#define UNDO_CAP 256       // Max number of actions saved
 
 #define DEFAULT_TAB_SIZE 4
+#define DEFAULT_UNDO_MEMORY 16384 // KB of undo history per buffer
+#define DEFAULT_BUFFER_MEMORY 256 // MB of text kept for hidden buffers
 
 typedef enum Status
 {
@@ -23,6 +24,7 @@ typedef enum Status
 #include <malloc.h>
 #include <stdbool.h>
 #include <string.h>
+#include <limits.h>
 
 #include "types.h"
 #include "api.h"
@@ -3,9 +3,32 @@
 // Renders everything to the terminal. Sets cursor position. Shows welcome screen.
 void Render();
 
+// Splits the active view in two showing the same buffer, side by side if
+// vertical is true. Returns false if there is no room for another view.
+bool ViewSplit(bool vertical);
+// Closes the active view. Returns false if it is the only view.
+bool ViewClose();
+// Makes the next view in screen order active, wrapping around.
+void ViewFocusNext();
+// Returns the number of views showing b, or all views if b is NULL.
+int ViewCount(Buffer *b);
+// Shows the current buffer in the views showing b. Must be called when b is
+// removed from the buffer list.
+void ViewBufferRemoved(Buffer *b);
+// Lays out the views in the text area and brings their cursors up to date.
+// Must be called before drawing rows.
+void ViewLayout(int width, int height);
+// Appends row y of the text area, with every view and separator on it, to cb.
+void ViewRenderRow(CharBuf *cb, int y);
+// Returns the screen position of the cursor in the active view.
+COORD ViewCursorPos();
+
 // Sets status bar info. Passing NULL for filename will leave the current one.
 // Passing NULL for error will remove the current error. Call Render to update.
 void SetStatus(char *filename, char *error);
+// Sets message shown on the command line when there is no error. Passing NULL
+// removes it. Call Render to update.
+void SetStatusInfo(char *info);
 
 // Status codes returned by UI functions.
 typedef enum UiStatus
@@ -29,6 +52,8 @@ void UiFreeResult(UiResult res);
 UiStatus UiPromptYesNo(char *message, bool select);
 // Prompts user for text input under status line. Remember to check status and free result.
 UiResult UiGetTextInput(char *prompt, int maxSize);
+// Same as UiGetTextInput, but calls onChange each time the text is edited.
+UiResult UiGetTextInputEx(char *prompt, int maxSize, void (*onChange)(char *text, int length));
 
 void ScreenWrite(const char *string, int length);
 void ScreenWriteAt(int x, int y, const char *text);
@@ -7,41 +7,87 @@ typedef struct Config
     bool syntaxEnabled; // Enable syntax highlighting for some files
     bool matchParen;    // Match ending parens when typing. eg: '(' adds a ')'
     bool useCRLF;       // Use CRLF line endings. (NOT IMPLEMENTED)
+    bool trigramIndex;  // Index large read-only files for faster search
     byte tabSize;       // Amount of spaces a tab equals
+    int undoMemory;     // Max size of undo history per buffer in KB
+    bool undoJournal;   // Keep undo history of files between sessions
+    int bufferMemory;   // Max size of text kept for hidden buffers in MB
 } Config;
 
 // Action types for undo to keep track of which actions to group.
 typedef enum Action
 {
-    A_JOIN,        // Join multiple actions into larger undo
-    A_UNDO,        // Editor undo
-    A_CURSOR,      // Set cursor pos (for delete)
-    A_WRITE,       // Write text
-    A_DELETE,      // Delete text forward
-    A_DELETE_BACK, // Same as backspace, but without joining etc
-    A_BACKSPACE,   // Delete backwards, reverses on paste
-    A_DELETE_LINE, // Delete line only
-    A_INSERT_LINE, // Insert line only
+    A_UNDO,         // Editor undo
+    A_CURSOR,       // Set cursor pos (for delete)
+    A_WRITE,        // Write text
+    A_DELETE,       // Delete text forward
+    A_DELETE_BACK,  // Same as backspace, but without joining etc
+    A_BACKSPACE,    // Delete backwards, reverses on paste
+    A_DELETE_LINE,  // Delete line only
+    A_INSERT_LINE,  // Insert line only
+    A_REPLACE,      // Replace text of many lines, old and new lines packed in text
+    A_WRITE_MANY,   // Write at many cursors, positions and text packed in text
+    A_DELETE_MANY,  // Delete at many cursors, positions and text packed in text
+    A_INSERT_LINES, // Insert many lines, lengths and text packed in text
+    A_DELETE_LINES, // Delete many lines, lengths and text packed in text
+    A_MOVE_LINES,   // Move lines from row, count and destination row packed in text
+    A_SORT_LINES,   // Reorder lines from row, new order and removed lines packed in text
 } Action;
 
-#define EDITOR_ACTION_BUFSIZE 128 // Character cap for string in action
-
-// Object representing an executable action by the editor (write, delete, etc).
-typedef struct EditorAction
+// Header of an action in the undo log, followed by textLen bytes of text
+// padded to 4 bytes.
+typedef struct UndoRecord
 {
     Action type;
-    int numUndos; // Used for join
     int row;
     int col;
-    int endCol;
     int textLen;
-    char text[EDITOR_ACTION_BUFSIZE];
-    bool isLongText;
-    char *longText;
-} EditorAction;
+    int prevSize; // Offset back to previous record in the node, 0 for the first
+} UndoRecord;
+
+// State in the undo tree. Its records turn the parent state into this one.
+typedef struct UndoNode
+{
+    int parent; // -1 for the root
+    int redo;   // Child to redo into, -1 if none
+    int depth;
+    int offset; // Records in log data
+    int length;
+    int last; // Offset of last record, -1 if none
+} UndoNode;
+
+typedef struct UndoJournal UndoJournal;
+
+// Undo tree of a buffer. Records are packed back to back in data, nodes are
+// stored in the order they were made.
+typedef struct UndoLog
+{
+    char *data;
+    int length;
+    int cap;
+    UndoNode *nodes;
+    int numNodes;
+    int nodeCap;
+    int current; // Node of the current buffer state
+    int saved;   // Node of the state saved to file, -1 if evicted
+
+    UndoJournal *journal; // NULL if the buffer has none
+    int written;          // Nodes in the journal, 0 if it must be rewritten
+
+    int groupDepth; // Open UndoGroupBegin calls
+    int groupNode;  // Node records of the open group go to, -1 if none yet
+} UndoLog;
 
 #define COLOR_SIZE 13 // Size of a color string including NULL
 
+// Used to store text before rendering.
+typedef struct CharBuf
+{
+    char *buffer;
+    char *pos;
+    int lineLength;
+} CharBuf;
+
 // The editor keeps a single instance of this struct globally available
 // to easily get color values from a loaded theme.
 typedef struct Colors
@@ -67,6 +113,7 @@ typedef enum InputEventType
     INPUT_UNKNOWN,
     INPUT_KEYDOWN,
     INPUT_WINDOW_RESIZE,
+    INPUT_WAKE, // Posted by background threads with EditorWake
 } InputEventType;
 
 // Keycodes recognized by the editor and part of the InputInfo struct.
@@ -111,6 +158,12 @@ typedef struct Cursor
     int scrollDy;   // Minimum distance before scrolling up/down
 } Cursor;
 
+typedef struct CursorPos
+{
+    int row;
+    int col;
+} CursorPos;
+
 #define LINE_DEFAULT_LENGTH 32
 
 // Line in buffer. Holds raw text.
@@ -120,9 +173,53 @@ typedef struct Line
     int cap;
     int length;
     int indent; // Updated on cursor movement
-    char *chars;
+    char *chars; // Reference counted, see snapshot.c
 } Line;
 
+// Kinds of text selection.
+typedef enum SelectMode
+{
+    SELECT_NONE,
+    SELECT_CHAR,  // Characters from start to end
+    SELECT_LINE,  // Whole lines
+    SELECT_BLOCK, // Rectangle between the start and end columns
+} SelectMode;
+
+// Range of text in a buffer. Rows are inclusive, end col is exclusive. Cols
+// are not used for line ranges.
+typedef struct Range
+{
+    SelectMode mode;
+    int startRow, startCol;
+    int endRow, endCol;
+} Range;
+
+// Yanked text, one line per line of the range. Whole lines share their text
+// with the buffer they were yanked from, see snapshot.c.
+typedef struct Register
+{
+    SelectMode mode;
+    int numLines;
+    Line *lines;
+} Register;
+
+// Recorded key presses, see macro.c.
+typedef struct Macro
+{
+    InputInfo *keys;
+    int numKeys;
+    int cap;
+} Macro;
+
+// Frozen view of buffer lines. Can be read from any thread.
+typedef struct Snapshot
+{
+    volatile LONG refs;
+    int version; // Buffer version the snapshot was taken at
+    int numLines;
+    Line *lines;
+} Snapshot;
+
 // All filetypes recognized by the editor and
 // with syntax highlighting available.
 typedef enum FileType
@@ -135,49 +232,145 @@ typedef enum FileType
 // Table used to store syntax information for current file type
 typedef struct SyntaxTable
 {
-    char extension[16]; // File extension
-    int numWords[2];    // Number of words in words
+    char extensions[32]; // Slash seperated file extensions, eg. "c/h"
+    int numWords[2];     // Number of words in words
 
     // Null seperated list of words. First is keywords, second types.
     char words[2][1024];
 } SyntaxTable;
 
+// All syntax tables parsed from the syntax file. The editor keeps one global
+// registry which buffers look up their table in by file extension.
+typedef struct SyntaxRegistry
+{
+    int numTables;
+    SyntaxTable *tables;
+} SyntaxRegistry;
+
 #define BUFFER_DEFAULT_LINE_CAP 32
 #define MAX_SEARCH 64
 
+// Compiled regular expression. See util/regex.c.
+typedef struct Regex Regex;
+
+// Trigram index of a read-only buffer. See buffer/trigram.c.
+typedef struct TrigramIndex TrigramIndex;
+
+#define TRIGRAM_BLOCK_SHIFT 12 // Trigram index blocks are 4096 lines
+
+// Job running on the worker pool. See util/pool.c.
+typedef struct PoolJob PoolJob;
+
+// Task function for the worker pool. Index is the task index, worker is the
+// index of the worker running it, less than PoolSize().
+typedef void (*PoolFunc)(void *arg, int index, int worker);
+
+// Compiled search pattern. See util/search.c.
+typedef struct Search
+{
+    char pattern[MAX_SEARCH];
+    int length;
+    Regex *regex;     // NULL for literal searches
+    int rare;         // Index of the least common byte in pattern
+    int skip[256];    // Horspool shift when searching forwards
+    int skipRev[256]; // Horspool shift when searching backwards
+} Search;
+
+#define MATCH_MAX_DIRTY 256 // Dirty rows before the match index is rebuilt
+
+// Sorted positions of all matches of the buffer search. See buffer/match.c.
+typedef struct MatchIndex
+{
+    CursorPos *matches;
+    int numMatches;
+    int cap;
+    int dirty[MATCH_MAX_DIRTY]; // Rows changed since last update
+    int numDirty;
+    bool valid;     // False if the index must be rebuilt
+    bool stale;     // Invalidated by edits, staleCount is the count before them
+    int staleCount;
+} MatchIndex;
+
+#define HL_CACHE_SIZE 256 // Highlighted segments kept per buffer
+
+// A highlighted segment of a line, valid while the buffer version is the same.
+typedef struct HighlightEntry
+{
+    int row, col, length; // Segment of the line that was highlighted
+    int version;          // Buffer.version when it was highlighted
+    int hlLength;
+    int cap;
+    char *text; // NULL if the entry is unused
+} HighlightEntry;
+
+// Identifies a file whatever path is used to open it, eg. through a link.
+typedef struct FileId
+{
+    bool valid;
+    DWORD volume;
+    DWORD indexHigh, indexLow;
+} FileId;
+
 // A buffer holds text, usually a file, and is editable.
 typedef struct Buffer
 {
     Cursor cursor;
+    SelectMode selectMode; // SELECT_NONE if nothing is selected
+    CursorPos selectStart; // The selection is from here to the cursor
     SyntaxTable *syntaxTable;
 
     bool isFile;      // Does the buffer contain a file?
     bool dirty;       // Has the buffer changed since last save?
     bool syntaxReady; // Is syntax highlighting available for this file?
     bool readOnly;    // Is file read-only? Default for non-file buffers like help.
+    bool isResults;   // Is buffer the grep results list? Owned by rum/grep.c.
+    bool unloaded;    // Was the text freed to save memory? See editor/buffers.c.
 
     char filepath[260]; // Full path to file
+    FileId fileId;      // Found when first looked up, see editor/buffers.c
     FileType fileType;
+    int textSize;  // Size of the file when it was read, estimates memory use
+    int lastShown; // Editor.numSwitches when the buffer was last shown
 
-    char search[MAX_SEARCH]; // Current search word
-    int searchLen;
+    Search search; // Current search, length is 0 if none
+    bool hlSearch; // Highlight matches of search in view
+    MatchIndex matches;
+    TrigramIndex *trigrams;     // NULL if the buffer is not indexed
+    HighlightEntry *highlights; // Shared by all views, see buffer/color.c
 
     int textH;
     int padX, padY; // Padding on left and top of text area
     int numLines;
     int lineCap;
     Line *lines;
-    EditorAction *undos; // List pointer
+    int version;        // Incremented on every change to lines
+    Snapshot *snapshot; // Shares lines until the next change, NULL if none
+    UndoLog undo;
+
+    // Cursors other than the main one, sorted by position. See rum/multi.c.
+    CursorPos *cursors;
+    int numCursors;
+    int cursorCap;
 } Buffer;
 
+// A view shows a buffer in a rectangle of the screen. The active view keeps its
+// cursor in the buffer, the others keep their own. See screen/view.c.
+typedef struct View
+{
+    Buffer *buffer; // Not set for the active view, which shows curBuffer
+    Cursor cursor;
+    int x, y, width, height;
+} View;
+
 typedef enum InputMode
 {
     MODE_INSERT,
     MODE_VIM,    // Vim command mode
+    MODE_VISUAL, // Selecting text, see Buffer.selectMode
     MODE_CUSTOM, // Defined by config (todo)
 } InputMode;
 
-#define EDITOR_BUFFER_CAP 16
+#define EDITOR_BUFFER_CAP 16 // Initial size of the buffer list
 
 // The Editor contains the buffers and the current state of the editor.
 typedef struct Editor
@@ -189,10 +382,15 @@ typedef struct Editor
     HANDLE hstdin;  // Console input
 
     InputMode mode;
+    Buffer *blockInsert; // Buffer of a column edit in insert mode, NULL if none
+    bool replaying;      // Playing a macro, nothing is drawn until it is done
 
+    // Open buffers in the order they were opened. See editor/buffers.c.
     int numBuffers;
     int activeBuffer;
-    Buffer *buffers[EDITOR_BUFFER_CAP];
+    int bufferCap;
+    Buffer **buffers;
+    int numSwitches; // Times the current buffer changed, orders buffers by use
 
     char *renderBuffer;
 } Editor;
\ No newline at end of file
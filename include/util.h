@@ -13,16 +13,62 @@ void StrFilename(char *dest, char *src);
 void StrFileExtension(char *dest, char *src);
 // Returns pointer to first character in first instance of substr in buf. NULL if none is found.
 char *StrMemStr(char *buf, char *substr, size_t size);
+// Writes n to dest with comma seperated thousands, eg. 12,004. Returns length.
+int StrFormatInt(char *dest, int n);
+// Writes path of a file in the rum temp directory to dest. The file is named by
+// a hash of the full path of filepath, with ext added. Returns false on fail.
+bool StrTempPath(char *dest, char *filepath, char *ext);
+// Compiles literal pattern into s. Pattern is truncated to MAX_SEARCH-1 bytes.
+void SearchCompile(Search *s, char *pattern, int length);
+// Compiles regex pattern into s. Returns error if the pattern is invalid.
+Status SearchCompileRegex(Search *s, char *pattern, int length);
+// Frees the compiled regex, if any. The search is empty after.
+void SearchFree(Search *s);
+// Returns index of first match at or after from in text, -1 if none is found.
+// Writes length of match to matchLength if not NULL.
+int SearchForward(Search *s, char *text, int length, int from, int *matchLength);
+// Returns index of last match starting at or before from, -1 if none is found.
+// Writes length of match to matchLength if not NULL.
+int SearchBackward(Search *s, char *text, int length, int from, int *matchLength);
+
+// Copies src into dst. Regex searches get their own match state so the copy can
+// be used on another thread. Free with SearchFree, src must outlive it.
+void SearchClone(Search *dst, Search *src);
+
+// Compiles pattern. Returns NULL on syntax error or if the pattern is too big.
+Regex *RegexCompile(char *pattern, int length);
+void RegexFree(Regex *re);
+// Returns a copy of re with its own DFA cache and scratch space so it can be
+// used on another thread. The program is shared, re must outlive the copy.
+Regex *RegexClone(Regex *re);
+// Returns the literal every match contains. Its length is 0 if there is none.
+Search *RegexLiteral(Regex *re);
+// Returns index of leftmost match starting at or after from, -1 if none is
+// found. Writes length of match to matchLength if not NULL.
+int RegexSearch(Regex *re, char *text, int length, int from, int *matchLength);
+// Returns index of last match starting at or before from, -1 if none is found.
+// Writes length of match to matchLength if not NULL.
+int RegexSearchLast(Regex *re, char *text, int length, int from, int *matchLength);
 // Returns true if c is a printable ascii character
 bool isChar(char c);
 
-// Used to store text before rendering.
-typedef struct CharBuf
-{
-    char *buffer;
-    char *pos;
-    int lineLength;
-} CharBuf;
+// Starts one worker per logical processor. Must be called before any other pool
+// function.
+void PoolInit();
+// Returns number of workers. Worker ids passed to tasks are less than this.
+int PoolSize();
+// Runs fn(arg, index, worker) for each index in [0, count) on the workers.
+// Returns immediately. The job must be freed with PoolFinish.
+PoolJob *PoolStart(PoolFunc fn, void *arg, int count);
+// Waits up to ms milliseconds for job to finish. Returns true if it finished.
+bool PoolWait(PoolJob *job, int ms);
+// Returns the number of tasks finished, including skipped ones.
+int PoolProgress(PoolJob *job);
+// Makes workers skip tasks that have not started yet.
+void PoolCancel(PoolJob *job);
+bool PoolCanceled(PoolJob *job);
+// Waits for job to finish and frees it.
+void PoolFinish(PoolJob *job);
 
 // Returns empty CharBuf mapped to input buffer.
 CharBuf CbNew(char *buffer);
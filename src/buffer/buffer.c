@@ -11,15 +11,35 @@ static char padding[256] = {[0 ... 255] = ' '}; // For indents
 // Reallocs lines char array to new size.
 static void bufferExtendLine(Buffer *b, int row, int new_size)
 {
-    if (row >= curBuffer->numLines)
+    if (row >= b->numLines)
         Error("row out of bounds");
     Line *line = &b->lines[row];
     line->cap = new_size;
-    line->chars = MemRealloc(line->chars, line->cap);
-    AssertNotNull(line->chars);
+    line->chars = LineRealloc(line->chars, line->cap);
     memset(line->chars + line->length, 0, line->cap - line->length);
 }
 
+// Grows the line array of b to fit count more lines.
+static void reserveLines(Buffer *b, int count)
+{
+    if (b->numLines + count <= b->lineCap)
+        return;
+
+    b->lineCap = max(b->lineCap * 2, b->numLines + count);
+    b->lines = MemRealloc(b->lines, b->lineCap * sizeof(Line));
+    AssertNotNull(b->lines);
+}
+
+// Must be called before changing b. Copies the line array and the text at row
+// if they are shared with a snapshot. Row is -1 if no line text is changed.
+static void bufferChange(Buffer *b, int row)
+{
+    BufferUnshare(b);
+    if (row != -1)
+        LineOwn(&b->lines[row]);
+    b->version++;
+}
+
 Buffer *BufferNew()
 {
     Buffer *b = MemZeroAlloc(sizeof(Buffer));
@@ -35,32 +55,75 @@ Buffer *BufferNew()
         .scrollDy = 5,
     };
 
-    b->undos = list(EditorAction, UNDO_CAP);
-    AssertNotNull(b->undos);
-
     BufferInsertLine(b, 0);
     b->dirty = false;
     b->syntaxReady = false;
     b->readOnly = false;
-    b->searchLen = 0;
     return b;
 }
 
-void BufferFree(Buffer *b)
+// Frees the lines of b and the line array.
+static void freeLines(Buffer *b)
 {
-    for (int i = 0; i < b->numLines; i++)
-        MemFree(b->lines[i].chars);
-
-    if (b->syntaxReady)
-        MemFree(b->syntaxTable);
+    if (b->snapshot != NULL)
+    {
+        // Lines are freed with the last reference to the snapshot
+        SnapshotFree(b->snapshot);
+        b->snapshot = NULL;
+        b->lines = NULL;
+    }
+    else
+    {
+        for (int i = 0; i < b->numLines; i++)
+            LineFree(b->lines[i].chars);
+    }
 
     MemFree(b->lines);
+    b->lines = NULL;
+    b->numLines = 0;
+    b->lineCap = 0;
+}
+
+void BufferFree(Buffer *b)
+{
+    freeLines(b);
+    TrigramFree(b);
+    SearchFree(&b->search);
+    MatchIndexFree(b);
+    HighlightCacheFree(b);
+    JournalClose(b);
+    UndoFree(&b->undo);
+    MemFree(b->cursors);
     MemFree(b);
 }
 
+// Frees the text of b to save memory. The cursor, search and settings are
+// kept. Undo history must be empty or in the journal, it is read again with
+// the text. Must be reloaded with BufferReload before use.
+void BufferUnload(Buffer *b)
+{
+    freeLines(b);
+    TrigramFree(b);
+    MatchIndexFree(b);
+    HighlightCacheFree(b);
+    JournalClose(b);
+    UndoFree(&b->undo);
+    b->unloaded = true;
+}
+
+// Reads the text of an unloaded buffer from buf, the current content of its file.
+void BufferReload(Buffer *b, char *buf, int size)
+{
+    BufferInsertText(b, 0, buf, size);
+    b->textSize = size;
+    b->dirty = false;
+    b->unloaded = false;
+}
+
 // Writes characters to buffer at row/col.
 void BufferWriteEx(Buffer *b, int row, int col, char *source, int length)
 {
+    bufferChange(b, row);
     Line *line = &b->lines[row];
 
     if (line->length + length >= line->cap)
@@ -81,6 +144,107 @@ void BufferWriteEx(Buffer *b, int row, int col, char *source, int length)
     memcpy(line->chars + col, source, length);
     line->length += length;
     b->dirty = true;
+    MatchIndexTouch(b, row);
+}
+
+// Writes text at every position in pos, which must be sorted by row and col.
+// Each line is changed once, grown to fit all its writes and its text moved
+// right to left so every segment moves once. Positions are moved past the
+// text written at them.
+void BufferWriteMany(Buffer *b, CursorPos *pos, int count, char *text, int length)
+{
+    for (int i = 0; i < count;)
+    {
+        int row = pos[i].row;
+        int n = 1;
+        while (i + n < count && pos[i + n].row == row)
+            n++;
+
+        bufferChange(b, row);
+        Line *line = &b->lines[row];
+        int newLength = line->length + n * length;
+
+        if (newLength >= line->cap)
+        {
+            int l = LINE_DEFAULT_LENGTH;
+            bufferExtendLine(b, row, (newLength / l + 1) * l);
+        }
+
+        int end = line->length;
+        for (int j = n - 1; j >= 0; j--)
+        {
+            int col = pos[i + j].col;
+            memmove(line->chars + col + (j + 1) * length, line->chars + col, end - col);
+            memcpy(line->chars + col + j * length, text, length);
+            end = col;
+        }
+
+        for (int j = 0; j < n; j++)
+            pos[i + j].col += (j + 1) * length;
+
+        line->length = newLength;
+        MatchIndexTouch(b, row);
+        i += n;
+    }
+
+    b->dirty = true;
+}
+
+// Deletes counts[i] characters before every position in pos, which must be
+// sorted by row and col with ranges that do not overlap. Each line is changed
+// once and its text moved left to right. Positions are moved to where their
+// deleted text was.
+void BufferDeleteMany(Buffer *b, CursorPos *pos, int *counts, int count)
+{
+    for (int i = 0; i < count;)
+    {
+        int row = pos[i].row;
+        int n = 1;
+        while (i + n < count && pos[i + n].row == row)
+            n++;
+
+        bufferChange(b, row);
+        Line *line = &b->lines[row];
+        int dest = pos[i].col - counts[i];
+        int removed = 0;
+
+        for (int j = 0; j < n; j++)
+        {
+            // Text between this range and the next one
+            int from = pos[i + j].col;
+            int to = j + 1 < n ? pos[i + j + 1].col - counts[i + j + 1] : line->length;
+            memmove(line->chars + dest, line->chars + from, to - from);
+            dest += to - from;
+            removed += counts[i + j];
+            pos[i + j].col -= removed;
+        }
+
+        memset(line->chars + line->length - removed, 0, removed);
+        line->length -= removed;
+        MatchIndexTouch(b, row);
+        i += n;
+    }
+
+    b->dirty = true;
+}
+
+// Replaces the text of line at row. The line is allocated once at the new size.
+void BufferReplaceLine(Buffer *b, int row, char *text, int length)
+{
+    bufferChange(b, -1);
+    Line *line = &b->lines[row];
+    int l = LINE_DEFAULT_LENGTH;
+    int cap = (length / l) * l + l;
+
+    char *chars = LineAlloc(cap);
+    memcpy(chars, text, length);
+
+    LineFree(line->chars);
+    line->chars = chars;
+    line->length = length;
+    line->cap = cap;
+    b->dirty = true;
+    MatchIndexTouch(b, row);
 }
 
 // Writes characters to buffer at cursor position.
@@ -92,6 +256,7 @@ void BufferWrite(Buffer *b, char *source, int length)
 // Writes to buffer at row/col. Replaces any characters that are already there.
 void BufferOverWriteEx(Buffer *b, int row, int col, char *source, int length)
 {
+    bufferChange(b, row);
     Line *line = &b->lines[row];
 
     if (line->length + length >= line->cap)
@@ -105,6 +270,7 @@ void BufferOverWriteEx(Buffer *b, int row, int col, char *source, int length)
     memcpy(line->chars + col, source, length);
     line->length = col + length;
     b->dirty = true;
+    MatchIndexTouch(b, row);
 }
 
 // Writes to buffer at current row/col. Replaces any characters that are already there.
@@ -119,6 +285,7 @@ void BufferDeleteEx(Buffer *b, int row, int col, int count)
     if (col == 0)
         return;
 
+    bufferChange(b, row);
     Line *line = &b->lines[row];
     count = min(count, col); // Dont delete past 0
 
@@ -132,6 +299,7 @@ void BufferDeleteEx(Buffer *b, int row, int col, int count)
     memset(line->chars + line->length, 0, line->cap - line->length);
     line->length -= count;
     b->dirty = true;
+    MatchIndexTouch(b, row);
 }
 
 // Deletes backwards from cursor position. Stops at empty line, does not remove newline.
@@ -165,14 +333,8 @@ void BufferInsertLine(Buffer *b, int row)
 void BufferInsertLineEx(Buffer *b, int row, char *text, int textLen)
 {
     row = row != -1 ? row : b->numLines;
-
-    if (b->numLines >= b->lineCap)
-    {
-        // Realloc editor line buffer array when full
-        b->lineCap += BUFFER_DEFAULT_LINE_CAP;
-        b->lines = MemRealloc(b->lines, b->lineCap * sizeof(Line));
-        AssertNotNull(b->lines);
-    }
+    bufferChange(b, -1);
+    reserveLines(b, 1);
 
     if (row < b->numLines)
     {
@@ -194,19 +356,17 @@ void BufferInsertLineEx(Buffer *b, int row, char *text, int textLen)
             cap = (textLen / l) * l + l;
         }
 
-        chars = MemZeroAlloc(cap * sizeof(char));
+        chars = LineAlloc(cap);
         strncpy(chars, padding, b->cursor.indent);
         strncat(chars, text, textLen);
     }
     else
     {
         // No text was passed
-        chars = MemZeroAlloc(LINE_DEFAULT_LENGTH * sizeof(char));
+        chars = LineAlloc(LINE_DEFAULT_LENGTH);
         strncpy(chars, padding, b->cursor.indent);
     }
 
-    AssertNotNull(chars);
-
     Line line = {
         .chars = chars,
         .cap = cap,
@@ -217,6 +377,7 @@ void BufferInsertLineEx(Buffer *b, int row, char *text, int textLen)
     memcpy(&b->lines[row], &line, sizeof(Line));
     b->numLines++;
     b->dirty = true;
+    MatchIndexInsertRow(b, row);
 }
 
 // Deletes line at row and move all lines below upwards.
@@ -227,16 +388,19 @@ void BufferDeleteLine(Buffer *b, int row)
     if (row > b->numLines - 1)
         return;
 
+    bool lastLine = row == 0 && b->numLines == 1;
+    bufferChange(b, lastLine ? row : -1);
     Line *line = &b->lines[row];
 
-    if (row == 0 && b->numLines == 1)
+    if (lastLine)
     {
         memset(line->chars, 0, line->cap);
         line->length = 0;
+        MatchIndexTouch(b, row);
         return;
     }
 
-    MemFree(line->chars);
+    LineFree(line->chars);
     Line *pos = b->lines + row + 1;
 
     if (row != b->lineCap - 1)
@@ -248,12 +412,179 @@ void BufferDeleteLine(Buffer *b, int row)
 
     b->numLines--;
     b->dirty = true;
+    MatchIndexDeleteRow(b, row);
+}
+
+// Inserts count lines at row, taking over their text. The line array is grown
+// and shifted once, so inserting many lines costs the same as inserting one.
+void BufferInsertLines(Buffer *b, int row, Line *lines, int count)
+{
+    if (count <= 0)
+        return;
+
+    bufferChange(b, -1);
+    reserveLines(b, count);
+
+    memmove(b->lines + row + count, b->lines + row, (b->numLines - row) * sizeof(Line));
+    memcpy(b->lines + row, lines, count * sizeof(Line));
+
+    for (int i = 0; i < count; i++)
+        b->lines[row + i].row = row + i;
+
+    b->numLines += count;
+    b->dirty = true;
+    MatchIndexInsertRows(b, row, count);
+}
+
+// Inserts the lines of text, separated by newlines, at row. The line array is
+// grown and shifted once and each line is allocated once at its final size. A
+// \r before a newline is dropped. Returns the number of lines inserted.
+int BufferInsertText(Buffer *b, int row, char *text, int length)
+{
+    char *end = text + length;
+    int count = 1;
+    for (char *p = text; p < end && (p = memchr(p, '\n', end - p)) != NULL; p++)
+        count++;
+
+    bufferChange(b, -1);
+    reserveLines(b, count);
+    memmove(b->lines + row + count, b->lines + row, (b->numLines - row) * sizeof(Line));
+
+    char *p = text;
+    for (int i = 0; i < count; i++)
+    {
+        char *newline = p < end ? memchr(p, '\n', end - p) : NULL;
+        int lineLength = (newline != NULL ? newline : end) - p;
+        if (newline != NULL && lineLength > 0 && p[lineLength - 1] == '\r')
+            lineLength--;
+
+        int l = LINE_DEFAULT_LENGTH;
+        int cap = (lineLength / l) * l + l;
+        Line *line = &b->lines[row + i];
+        *line = (Line){.chars = LineAlloc(cap), .cap = cap, .length = lineLength, .row = row + i};
+        memcpy(line->chars, p, lineLength);
+
+        if (newline != NULL)
+            p = newline + 1;
+    }
+
+    b->numLines += count;
+    b->dirty = true;
+    MatchIndexInsertRows(b, row, count);
+    return count;
+}
+
+// Deletes count lines from row. The line array is shifted once. The buffer
+// keeps one empty line if all are deleted.
+void BufferDeleteLines(Buffer *b, int row, int count)
+{
+    count = min(count, b->numLines - row);
+    if (count <= 0)
+        return;
+
+    if (count == b->numLines)
+    {
+        // Keep the first line, emptied
+        BufferDeleteLines(b, 1, count - 1);
+        BufferDeleteLine(b, 0);
+        return;
+    }
+
+    bufferChange(b, -1);
+
+    for (int i = row; i < row + count; i++)
+        LineFree(b->lines[i].chars);
+
+    memmove(b->lines + row, b->lines + row + count, (b->numLines - row - count) * sizeof(Line));
+    b->numLines -= count;
+    memset(b->lines + b->numLines, 0, count * sizeof(Line));
+    b->dirty = true;
+    MatchIndexDeleteRows(b, row, count);
+}
+
+// Moves count lines from row to before the line at dest, which must not be
+// one of them. Only the lines in between are shifted.
+void BufferMoveLines(Buffer *b, int row, int count, int dest)
+{
+    if (count <= 0 || (dest >= row && dest <= row + count))
+        return;
+
+    bufferChange(b, -1);
+
+    Line *moved = MemAlloc(count * sizeof(Line));
+    AssertNotNull(moved);
+    memcpy(moved, b->lines + row, count * sizeof(Line));
+
+    int to = dest;
+    if (dest < row)
+        memmove(b->lines + dest + count, b->lines + dest, (row - dest) * sizeof(Line));
+    else
+    {
+        memmove(b->lines + row, b->lines + row + count, (dest - row - count) * sizeof(Line));
+        to = dest - count;
+    }
+
+    memcpy(b->lines + to, moved, count * sizeof(Line));
+    MemFree(moved);
+
+    for (int i = min(row, to); i < max(row, to) + count; i++)
+        b->lines[i].row = i;
+
+    b->dirty = true;
+    MatchIndexDeleteRows(b, row, count);
+    MatchIndexInsertRows(b, to, count);
+}
+
+// Reorders the count lines from row so that line i is the one at row +
+// order[i], keeping the first newCount of them. Lines not in order are freed.
+// Only line handles are moved, the text stays where it is.
+void BufferPermuteLines(Buffer *b, int row, int count, int *order, int newCount)
+{
+    if (count <= 0 || newCount <= 0)
+        return;
+
+    bufferChange(b, -1);
+
+    Line *lines = MemAlloc(count * sizeof(Line));
+    AssertNotNull(lines);
+    memcpy(lines, b->lines + row, count * sizeof(Line));
+
+    for (int i = 0; i < newCount; i++)
+    {
+        Line *line = &lines[order[i]];
+        b->lines[row + i] = *line;
+        b->lines[row + i].row = row + i;
+        line->chars = NULL;
+    }
+
+    for (int i = 0; i < count; i++)
+        if (lines[i].chars != NULL)
+            LineFree(lines[i].chars);
+
+    MemFree(lines);
+
+    if (newCount < count)
+    {
+        int removed = count - newCount;
+        memmove(b->lines + row + newCount, b->lines + row + count, (b->numLines - row - count) * sizeof(Line));
+        b->numLines -= removed;
+        memset(b->lines + b->numLines, 0, removed * sizeof(Line));
+
+        for (int i = row + newCount; i < b->numLines; i++)
+            b->lines[i].row = i;
+    }
+
+    b->dirty = true;
+    MatchIndexDeleteRows(b, row, count);
+    MatchIndexInsertRows(b, row, newCount);
 }
 
 // Copies and removes all characters behind the cursor position,
 // then pastes them at the end of the line below.
 void BufferMoveTextDownEx(Buffer *b, int row, int col)
 {
+    bufferChange(b, row);
+    bufferChange(b, row + 1);
     Line *from = &b->lines[row];
     Line *to = &b->lines[row + 1];
     int length = from->length - col;
@@ -271,6 +602,8 @@ void BufferMoveTextDownEx(Buffer *b, int row, int col)
     to->length += length;
     from->length -= length;
     b->dirty = true;
+    MatchIndexTouch(b, row);
+    MatchIndexTouch(b, row + 1);
 }
 
 // Copies and removes all characters behind the cursor position,
@@ -283,6 +616,7 @@ void BufferMoveTextDown(Buffer *b)
 // Moves line content from row to end of line above. Returns length of line above.
 int BufferMoveTextUpEx(Buffer *b, int row, int col)
 {
+    bufferChange(b, row - 1);
     Line *from = &b->lines[row];
     Line *to = &b->lines[row - 1];
     int toLength = to->length;
@@ -301,6 +635,7 @@ int BufferMoveTextUpEx(Buffer *b, int row, int col)
     memcpy(to->chars + to->length, from->chars, from->length);
     to->length += from->length;
     b->dirty = true;
+    MatchIndexTouch(b, row - 1);
     return toLength;
 }
 
@@ -321,145 +656,197 @@ void BufferScroll(Buffer *b)
         b->cursor.offy = min(b->cursor.row - b->textH + b->cursor.scrollDy, b->numLines - b->textH);
 }
 
-// From buffer/color.c
-//
-// Returns pointer to highlight buffer. Must NOT be freed. Line is the
-// pointer to the line contents and the length is excluding the NULL
-// terminator. Writes byte length of highlighted text to newLength.
-char *HighlightLine(Buffer *b, char *line, int lineLength, int *newLength);
-
-void BufferRender(Buffer *b, int y, int h)
+// Appends length bytes of line from col to cb, with syntax highlighting if
+// enabled.
+static void renderSegment(Buffer *b, CharBuf *cb, Line *line, int row, int col, int length)
 {
-    int textW = editor.width - b->padX;
-    int textH = h - b->padY;
-    b->textH = textH;
-
-    CharBuf cb = CbNew(editor.renderBuffer);
+    if (length <= 0)
+        return;
 
-    for (int i = 0; i < textH; i++)
+    if (config.syntaxEnabled && b->syntaxReady)
     {
-        int row = i + b->cursor.offy;
+        // Get syntax highlighting for the segment and its new byte length
+        int newLength;
+        char *hl = HighlightCached(b, row, col, length, &newLength);
+        CbAppend(cb, hl, newLength);
+        CbFg(cb, colors.fg0);
+    }
+    else
+        CbAppend(cb, line->chars + col, length);
+}
 
-        if (row >= b->numLines || y + i >= editor.height)
-            break;
+// Returns index of the first extra cursor at or after row.
+static int firstCursor(Buffer *b, int row)
+{
+    int lo = 0;
+    int hi = b->numCursors;
+    while (lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+        if (b->cursors[mid].row < row)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
 
-        Line line = b->lines[row];
+    return lo;
+}
 
-        // Line background color
-        if (b->cursor.row == row)
-            CbColor(&cb, colors.bg1, colors.yellow);
-        else
-            CbColor(&cb, colors.bg0, colors.bg2);
+// Appends the text of line from pos to end to cb. Matches of the buffer search
+// are highlighted if enabled and extra cursors are drawn inverted. bg is the
+// background of the text.
+static void renderSpan(Buffer *b, CharBuf *cb, Line *line, int row, int pos, int end, char *bg)
+{
 
-        // Line numbers
-        char numbuf[12];
-        sprintf(numbuf, " %4d ", (short)(row + 1));
-        CbAppend(&cb, numbuf, b->padX);
+    int matchLength = 0;
+    int col = -1;
+    if (b->hlSearch && b->search.length > 0)
+        col = SearchForward(&b->search, line->chars, line->length, 0, &matchLength);
 
-        // Line contents
-        CbFg(&cb, colors.fg0);
-        b->cursor.offx = max(b->cursor.col - textW + b->cursor.scrollDx, 0);
-        int lineLength = line.length - b->cursor.offx;
+    int c = firstCursor(b, row);
 
-        int renderLength = max(min(min(lineLength, textW), editor.width), 0);
-        char *lineBegin = line.chars + b->cursor.offx;
+    while (pos < end)
+    {
+        // Skip cursors and matches left of pos
+        while (c < b->numCursors && b->cursors[c].row == row && b->cursors[c].col < pos)
+            c++;
+        while (col != -1 && col < end && col + matchLength <= pos)
+            col = SearchForward(&b->search, line->chars, line->length, col + max(matchLength, 1), &matchLength);
+
+        int cursorCol = c < b->numCursors && b->cursors[c].row == row ? b->cursors[c].col : INT_MAX;
+        int matchStart = col == -1 ? INT_MAX : max(col, pos);
+        int next = min(min(cursorCol, matchStart), end);
+
+        renderSegment(b, cb, line, row, pos, next - pos);
+        pos = next;
+        if (pos == end)
+            break;
 
-        if (config.syntaxEnabled && b->syntaxReady)
+        if (pos == cursorCol)
         {
-            // Generate syntax highlighting for line and get new byte length
-            int newLength;
-            char *line = HighlightLine(b, lineBegin, renderLength, &newLength);
-            CbAppend(&cb, line, newLength);
+            CbColor(cb, colors.fg0, colors.bg0);
+            CbAppend(cb, line->chars + pos, 1);
+            pos++;
         }
         else
-            CbAppend(&cb, lineBegin, renderLength);
-
-        // Padding after
-        if (renderLength < textW)
-            CbAppend(&cb, padding, textW - renderLength);
-    }
-
-    // Draw squiggles for non-filled lines
-    CbColor(&cb, colors.bg0, colors.bg2);
-    if (b->numLines < b->textH)
-    {
-        for (int i = 0; i < b->textH - b->numLines; i++)
         {
-            CbAppend(&cb, "~", 1);
-            CbAppend(&cb, padding, editor.width - 1);
+            int matchEnd = min(min(col + matchLength, end), cursorCol);
+            CbColor(cb, colors.yellow, colors.bg0);
+            CbAppend(cb, line->chars + pos, matchEnd - pos);
+            pos = matchEnd;
         }
-    }
 
-    CbRender(&cb, 0, y);
+        CbColor(cb, bg, colors.fg0);
+    }
 }
 
-// Draws buffer contents at x, y, with a maximum width and height.
-void BufferRenderEx(Buffer *b, int x, int y, int width, int height)
+// Appends the visible part of line, starting at offx, to cb. The selected
+// part, from selStart to selEnd, gets the selection background. bg is the
+// line background.
+static void renderText(Buffer *b, CharBuf *cb, Line *line, int row, int offx, int length, char *bg, int selStart, int selEnd)
 {
-    HANDLE H = editor.hbuffer;
+    int end = offx + length;
+    int start = min(max(selStart, offx), end);
+    int stop = min(max(selEnd, start), end);
 
-    int textW = width - b->padX;
-    int textH = height - b->padY;
-    b->textH = textH;
+    renderSpan(b, cb, line, row, offx, start, bg);
+    if (stop > start)
+    {
+        CbColor(cb, colors.bg2, colors.fg0);
+        renderSpan(b, cb, line, row, start, stop, colors.bg2);
+        CbColor(cb, bg, colors.fg0);
+    }
+    renderSpan(b, cb, line, row, stop, end, bg);
+}
 
-    CursorHide();
+// Writes the selected columns of row to start and end. End is 0 if the row is
+// not selected.
+static void selectedCols(Buffer *b, Range *sel, int row, int *start, int *end)
+{
+    *start = 0;
+    *end = 0;
+    if (sel->mode == SELECT_NONE || row < sel->startRow || row > sel->endRow)
+        return;
 
-    for (int i = 0; i < textH; i++)
+    *end = INT_MAX;
+    if (sel->mode == SELECT_BLOCK)
     {
-        int row = i + b->cursor.offy;
-
-        if (row >= b->numLines || y + i >= editor.height)
-            break;
+        *start = sel->startCol;
+        *end = sel->endCol;
+    }
+    else if (sel->mode == SELECT_CHAR)
+    {
+        if (row == sel->startRow)
+            *start = sel->startCol;
+        if (row == sel->endRow)
+            *end = sel->endCol;
+    }
+}
 
-        Line line = b->lines[row];
-        SetConsoleCursorPosition(H, (COORD){x, y + i});
+// Appends count spaces to cb.
+static void renderPadding(CharBuf *cb, int count)
+{
+    for (; count > 0; count -= sizeof(padding))
+        CbAppend(cb, padding, min(count, (int)sizeof(padding)));
+}
 
-        // Line background color
-        if (b->cursor.row == row)
-            ScreenColor(colors.bg1, colors.yellow);
-        else
-            ScreenColor(colors.bg0, colors.bg2);
+// Appends row y of a view of b with cursor c to cb, exactly width columns wide.
+// The part of the text in sel is drawn selected.
+void BufferRenderRow(Buffer *b, Cursor *c, CharBuf *cb, int y, int width, Range *sel)
+{
+    int row = y + c->offy;
+    if (width <= 0)
+        return;
 
-        // Line numbers
-        char numbuf[12];
-        sprintf(numbuf, " %4d ", (short)(row + 1));
-        ScreenWrite(numbuf, b->padX);
+    // Squiggles for rows after the end of the buffer
+    if (row >= b->numLines)
+    {
+        CbColor(cb, colors.bg0, colors.bg2);
+        CbAppend(cb, "~", 1);
+        renderPadding(cb, width - 1);
+        return;
+    }
 
-        // Line contents
-        ScreenFg(colors.fg0);
-        b->cursor.offx = max(b->cursor.col - textW + b->cursor.scrollDx, 0);
-        int lineLength = line.length - b->cursor.offx;
+    Line *line = &b->lines[row];
+    char *bg = c->row == row ? colors.bg1 : colors.bg0;
 
-        int renderLength = max(min(min(lineLength, textW), editor.width), 0);
-        char *lineBegin = line.chars + b->cursor.offx;
+    // Line background color
+    if (c->row == row)
+        CbColor(cb, colors.bg1, colors.yellow);
+    else
+        CbColor(cb, colors.bg0, colors.bg2);
 
-        if (config.syntaxEnabled && b->syntaxReady)
-        {
-            // Generate syntax highlighting for line and get new byte length
-            int newLength;
-            char *line = HighlightLine(b, lineBegin, renderLength, &newLength);
-            ScreenWrite(line, newLength);
-        }
-        else
-            ScreenWrite(lineBegin, renderLength);
+    // Line numbers
+    char numbuf[12];
+    sprintf(numbuf, " %4d ", (short)(row + 1));
+    CbAppend(cb, numbuf, min(b->padX, width));
 
-        // Padding after
-        if (renderLength < textW)
-            ScreenWrite(padding, textW - renderLength);
-    }
+    int textW = width - b->padX;
+    if (textW <= 0)
+        return;
 
-    // Draw squiggles for non-filled lines
-    ScreenColor(colors.bg0, colors.bg2);
-    if (b->numLines < b->textH)
+    // Line contents
+    CbFg(cb, colors.fg0);
+    int lineLength = line->length - c->offx;
+    int renderLength = max(min(lineLength, textW), 0);
+    int selStart, selEnd;
+    selectedCols(b, sel, row, &selStart, &selEnd);
+    renderText(b, cb, line, row, c->offx, renderLength, bg, selStart, selEnd);
+
+    // Extra cursor after the end of the line
+    int i = firstCursor(b, row);
+    while (i < b->numCursors && b->cursors[i].row == row && b->cursors[i].col < line->length)
+        i++;
+    if (i < b->numCursors && b->cursors[i].row == row && renderLength < textW && lineLength >= 0)
     {
-        for (int i = 0; i < b->textH - b->numLines; i++)
-        {
-            ScreenWrite("~", 1);
-            ScreenWrite(padding, editor.width - 1);
-        }
+        CbColor(cb, colors.fg0, colors.bg0);
+        CbAppend(cb, " ", 1);
+        CbColor(cb, bg, colors.fg0);
+        renderLength++;
     }
 
-    CursorShow();
+    // Padding after
+    renderPadding(cb, textW - renderLength);
 }
 
 // Loads file contents into a new Buffer and returns it.
@@ -470,26 +857,9 @@ Buffer *BufferLoadFile(char *filepath, char *buf, int size)
     b->isFile = true;
     strcpy(b->filepath, filepath);
 
-    char *newline;
-    char *ptr = buf;
-    int row = 0;
-
-    while ((newline = strstr(ptr, "\n")) != NULL)
-    {
-        // Get distance from current pos in buffer and found newline
-        // Then strncpy the line into the line char buffer
-        int length = newline - ptr;
-        if (length > 0 && *(newline - 1) == '\r')
-            BufferInsertLineEx(b, row, ptr, length - 1);
-        else
-            BufferInsertLineEx(b, row, ptr, length);
-        ptr += length + 1;
-        row++;
-    }
-
-    // Write last line of file
-    BufferInsertLineEx(b, row, ptr, size - (ptr - buf));
+    BufferInsertText(b, 0, buf, size);
     BufferDeleteLine(b, -1); // Remove line added at buffer create
+    b->textSize = size;
     b->dirty = false;
     return b;
 }
@@ -555,5 +925,6 @@ bool BufferSaveFile(Buffer *b)
 
     b->dirty = false;
     CloseHandle(file);
+    JournalSave(b, buf, size - newlineSize);
     return true;
 }
@@ -217,4 +217,53 @@ char *HighlightLine(Buffer *b, char *line, int lineLength, int *newLength)
     addKeyword(b, &buffer, prev, (line + lineLength) - prev);
     *newLength = buffer.pos - buffer.buffer;
     return buffer.buffer;
-}
\ No newline at end of file
+}
+
+// Returns the highlighted text of length bytes of row from col. Must NOT be
+// freed. Segments are cached in the buffer until it changes, so every view of
+// the buffer and every redraw without changes reuses them instead of
+// highlighting the line again.
+char *HighlightCached(Buffer *b, int row, int col, int length, int *newLength)
+{
+    if (b->highlights == NULL)
+    {
+        b->highlights = MemZeroAlloc(HL_CACHE_SIZE * sizeof(HighlightEntry));
+        AssertNotNull(b->highlights);
+    }
+
+    HighlightEntry *e = &b->highlights[(unsigned)(row + col * 31) % HL_CACHE_SIZE];
+    if (e->text != NULL && e->row == row && e->col == col && e->length == length && e->version == b->version)
+    {
+        *newLength = e->hlLength;
+        return e->text;
+    }
+
+    char *hl = HighlightLine(b, b->lines[row].chars + col, length, newLength);
+    if (*newLength > e->cap || e->text == NULL)
+    {
+        e->cap = max(*newLength, LINE_DEFAULT_LENGTH);
+        e->text = MemRealloc(e->text, e->cap);
+        AssertNotNull(e->text);
+    }
+
+    memcpy(e->text, hl, *newLength);
+    e->row = row;
+    e->col = col;
+    e->length = length;
+    e->version = b->version;
+    e->hlLength = *newLength;
+    return e->text;
+}
+
+// Frees the highlight cache of b. Must be called when colors or syntax change.
+void HighlightCacheFree(Buffer *b)
+{
+    if (b->highlights == NULL)
+        return;
+
+    for (int i = 0; i < HL_CACHE_SIZE; i++)
+        MemFree(b->highlights[i].text);
+
+    MemFree(b->highlights);
+    b->highlights = NULL;
+}
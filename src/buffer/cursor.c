@@ -53,7 +53,11 @@ void CursorSetPos(Buffer *b, int x, int y, bool keepX)
             break;
         c->indent++;
     }
-    line->indent = c->indent;
+    if (line->indent != c->indent)
+    {
+        BufferUnshare(b);
+        b->lines[c->row].indent = c->indent;
+    }
 
     // Keep cursor x when moving vertically
     if (dy != 0)
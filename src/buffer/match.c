@@ -0,0 +1,339 @@
+// Match index. Keeps the sorted positions of every match of the buffer search so
+// n/N and the match count in the status bar are binary searches instead of scans.
+// Edits only mark rows as dirty, and those rows are searched again the next time
+// the index is used. Inserted and deleted lines shift the rows after them.
+
+#include "rum.h"
+
+static void addMatch(MatchIndex *m, int row, int col)
+{
+    if (m->numMatches >= m->cap)
+    {
+        m->cap = m->cap == 0 ? 256 : m->cap * 2;
+        m->matches = MemRealloc(m->matches, m->cap * sizeof(CursorPos));
+        AssertNotNull(m->matches);
+    }
+
+    m->matches[m->numMatches++] = (CursorPos){.row = row, .col = col};
+}
+
+// Appends all matches of s in row to the end of m.
+static void scanRow(Buffer *b, Search *s, MatchIndex *m, int row)
+{
+    Line *line = &b->lines[row];
+    int length;
+    int col = SearchForward(s, line->chars, line->length, 0, &length);
+
+    while (col != -1)
+    {
+        addMatch(m, row, col);
+        col = SearchForward(s, line->chars, line->length, col + max(length, 1), &length);
+    }
+}
+
+// Buffers with more rows than this are indexed on the worker pool
+#define MATCH_PARALLEL_ROWS 65536
+// Rows per pool task
+#define MATCH_CHUNK_ROWS 8192
+
+typedef struct ScanJob
+{
+    Buffer *b;
+    Search *searches;   // Copy of the search for each worker
+    MatchIndex *chunks; // Matches in each chunk
+    uint8_t *filter;    // Trigram filter, NULL if none
+} ScanJob;
+
+static void scanChunk(void *arg, int index, int worker)
+{
+    ScanJob *job = arg;
+    int start = index * MATCH_CHUNK_ROWS;
+    int end = min(start + MATCH_CHUNK_ROWS, job->b->numLines);
+
+    for (int row = start; row < end; row++)
+        if (job->filter == NULL || job->filter[row >> TRIGRAM_BLOCK_SHIFT])
+            scanRow(job->b, &job->searches[worker], &job->chunks[index], row);
+}
+
+// Searches the whole buffer. Large buffers are split into chunks searched in
+// parallel and merged in order. Returns false if canceled, the index is left
+// invalid.
+static bool rebuild(Buffer *b)
+{
+    MatchIndex *m = &b->matches;
+    MatchIndexClear(b);
+
+    // Only blocks the trigram index allows need to be searched
+    uint8_t *filter = TrigramFilter(b, &b->search);
+    if (b->numLines <= MATCH_PARALLEL_ROWS)
+    {
+        for (int row = 0; row < b->numLines; row++)
+            if (filter == NULL || filter[row >> TRIGRAM_BLOCK_SHIFT])
+                scanRow(b, &b->search, m, row);
+        m->valid = true;
+        return true;
+    }
+
+    int numWorkers = PoolSize();
+    int numChunks = (b->numLines + MATCH_CHUNK_ROWS - 1) / MATCH_CHUNK_ROWS;
+    ScanJob job = {
+        .b = b,
+        .searches = MemAlloc(numWorkers * sizeof(Search)),
+        .chunks = MemZeroAlloc(numChunks * sizeof(MatchIndex)),
+        .filter = filter,
+    };
+    AssertNotNull(job.searches);
+    AssertNotNull(job.chunks);
+
+    for (int i = 0; i < numWorkers; i++)
+        SearchClone(&job.searches[i], &b->search);
+
+    PoolJob *pj = PoolStart(scanChunk, &job, numChunks);
+    bool done = EditorWaitJob(pj, numChunks, "counting matches");
+    PoolFinish(pj);
+
+    // Chunks are merged in order into one allocation of the total size
+    int total = 0;
+    for (int i = 0; i < numChunks; i++)
+        total += job.chunks[i].numMatches;
+
+    if (done && total > m->cap)
+    {
+        m->cap = total;
+        m->matches = MemRealloc(m->matches, m->cap * sizeof(CursorPos));
+        AssertNotNull(m->matches);
+    }
+
+    for (int i = 0; i < numChunks; i++)
+    {
+        MatchIndex *chunk = &job.chunks[i];
+        if (done && chunk->numMatches > 0)
+        {
+            memcpy(m->matches + m->numMatches, chunk->matches, chunk->numMatches * sizeof(CursorPos));
+            m->numMatches += chunk->numMatches;
+        }
+
+        MemFree(chunk->matches);
+    }
+
+    for (int i = 0; i < numWorkers; i++)
+        SearchFree(&job.searches[i]);
+    MemFree(job.searches);
+    MemFree(job.chunks);
+
+    m->valid = done;
+    return done;
+}
+
+// Returns index of first match at or after row/col.
+static int lowerBound(MatchIndex *m, int row, int col)
+{
+    int lo = 0, hi = m->numMatches;
+    while (lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+        CursorPos p = m->matches[mid];
+        if (p.row < row || (p.row == row && p.col < col))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+// Invalidates the index. Must be called when the buffer search changes.
+void MatchIndexClear(Buffer *b)
+{
+    b->matches.numMatches = 0;
+    b->matches.numDirty = 0;
+    b->matches.valid = false;
+    b->matches.stale = false;
+}
+
+// Invalidates the index after too many edits to track. The old count is kept
+// so the status bar can show it until the index is rebuilt.
+static void invalidate(Buffer *b)
+{
+    int count = b->matches.numMatches;
+    MatchIndexClear(b);
+    b->matches.stale = true;
+    b->matches.staleCount = count;
+}
+
+void MatchIndexFree(Buffer *b)
+{
+    MemFree(b->matches.matches);
+    b->matches = (MatchIndex){0};
+}
+
+// Marks row as changed so its matches are searched again on next update.
+void MatchIndexTouch(Buffer *b, int row)
+{
+    MatchIndex *m = &b->matches;
+    if (!m->valid)
+        return;
+
+    for (int i = 0; i < m->numDirty; i++)
+        if (m->dirty[i] == row)
+            return;
+
+    if (m->numDirty == MATCH_MAX_DIRTY)
+    {
+        // Cheaper to start over than splice this many rows
+        invalidate(b);
+        return;
+    }
+
+    m->dirty[m->numDirty++] = row;
+}
+
+// Shifts matches down after count lines are inserted at row.
+void MatchIndexInsertRows(Buffer *b, int row, int count)
+{
+    MatchIndex *m = &b->matches;
+    if (!m->valid)
+        return;
+
+    if (count > MATCH_MAX_DIRTY)
+    {
+        invalidate(b);
+        return;
+    }
+
+    for (int i = lowerBound(m, row, 0); i < m->numMatches; i++)
+        m->matches[i].row += count;
+    for (int i = 0; i < m->numDirty; i++)
+        if (m->dirty[i] >= row)
+            m->dirty[i] += count;
+
+    for (int i = 0; i < count; i++)
+        MatchIndexTouch(b, row + i);
+}
+
+void MatchIndexInsertRow(Buffer *b, int row)
+{
+    MatchIndexInsertRows(b, row, 1);
+}
+
+// Removes matches in count rows from row and shifts the ones below up after
+// the lines are deleted.
+void MatchIndexDeleteRows(Buffer *b, int row, int count)
+{
+    MatchIndex *m = &b->matches;
+    if (!m->valid)
+        return;
+
+    int start = lowerBound(m, row, 0);
+    int end = lowerBound(m, row + count, 0);
+    memmove(m->matches + start, m->matches + end, (m->numMatches - end) * sizeof(CursorPos));
+    m->numMatches -= end - start;
+
+    for (int i = start; i < m->numMatches; i++)
+        m->matches[i].row -= count;
+
+    int kept = 0;
+    for (int i = 0; i < m->numDirty; i++)
+    {
+        if (m->dirty[i] >= row && m->dirty[i] < row + count)
+            continue;
+        m->dirty[kept++] = m->dirty[i] >= row + count ? m->dirty[i] - count : m->dirty[i];
+    }
+    m->numDirty = kept;
+}
+
+void MatchIndexDeleteRow(Buffer *b, int row)
+{
+    MatchIndexDeleteRows(b, row, 1);
+}
+
+// Builds the index from a list of sorted rows known to contain all matches.
+void MatchIndexBuildRows(Buffer *b, int *rows, int numRows)
+{
+    MatchIndex *m = &b->matches;
+    MatchIndexClear(b);
+
+    for (int i = 0; i < numRows; i++)
+        scanRow(b, &b->search, m, rows[i]);
+
+    m->valid = true;
+}
+
+// Brings the index up to date with the buffer search. Searches the whole buffer
+// if the index is not valid, otherwise only the dirty rows.
+void MatchIndexUpdate(Buffer *b)
+{
+    MatchIndex *m = &b->matches;
+
+    if (b->search.length == 0)
+    {
+        MatchIndexClear(b);
+        return;
+    }
+
+    if (!m->valid)
+    {
+        rebuild(b);
+        return;
+    }
+
+    // Scratch index for the matches in a single row
+    static MatchIndex tmp;
+
+    for (int i = 0; i < m->numDirty; i++)
+    {
+        int row = m->dirty[i];
+        if (row >= b->numLines)
+            continue;
+
+        tmp.numMatches = 0;
+        scanRow(b, &b->search, &tmp, row);
+
+        // Splice the new matches in place of the old ones
+        int start = lowerBound(m, row, 0);
+        int end = lowerBound(m, row + 1, 0);
+        int newTotal = m->numMatches - (end - start) + tmp.numMatches;
+
+        while (m->cap < newTotal)
+        {
+            m->cap = m->cap == 0 ? 256 : m->cap * 2;
+            m->matches = MemRealloc(m->matches, m->cap * sizeof(CursorPos));
+            AssertNotNull(m->matches);
+        }
+
+        memmove(m->matches + start + tmp.numMatches, m->matches + end, (m->numMatches - end) * sizeof(CursorPos));
+        memcpy(m->matches + start, tmp.matches, tmp.numMatches * sizeof(CursorPos));
+        m->numMatches = newTotal;
+    }
+
+    m->numDirty = 0;
+}
+
+// Returns index of the first match after row/col, or the last one before it if
+// backwards is true. Wraps around. Returns -1 if there are no matches.
+int MatchIndexFind(Buffer *b, int row, int col, bool backwards)
+{
+    MatchIndexUpdate(b);
+    MatchIndex *m = &b->matches;
+    if (m->numMatches == 0)
+        return -1;
+
+    if (backwards)
+    {
+        int i = lowerBound(m, row, col) - 1;
+        return i < 0 ? m->numMatches - 1 : i;
+    }
+
+    int i = lowerBound(m, row, col + 1);
+    return i == m->numMatches ? 0 : i;
+}
+
+// Returns index of the match starting at row/col, -1 if there is none. Does
+// not update the index.
+int MatchIndexAt(Buffer *b, int row, int col)
+{
+    MatchIndex *m = &b->matches;
+    int i = lowerBound(m, row, col);
+    if (i < m->numMatches && m->matches[i].row == row && m->matches[i].col == col)
+        return i;
+    return -1;
+}
@@ -0,0 +1,115 @@
+// Buffer snapshots. A snapshot is a frozen view of the buffer lines that can be
+// read from any thread. Taking one is O(1), the snapshot takes over the current
+// line array and the buffer keeps using it until its next change. That change
+// copies the array of line headers and shares the text of every line with the
+// snapshot. Line text is reference counted and a shared line is only copied
+// when it is written to, so a snapshot costs the lines changed after it.
+
+#include "rum.h"
+
+// Header before the text of every line
+typedef struct LineText
+{
+    volatile LONG refs;
+    int pad; // Keeps text 8 byte aligned
+} LineText;
+
+#define header(chars) ((LineText *)(chars) - 1)
+
+// Returns zeroed line text of cap bytes.
+char *LineAlloc(int cap)
+{
+    LineText *t = MemZeroAlloc(sizeof(LineText) + cap);
+    AssertNotNull(t);
+    t->refs = 1;
+    return (char *)(t + 1);
+}
+
+// Resizes line text, which must not be shared.
+char *LineRealloc(char *chars, int cap)
+{
+    LineText *t = MemRealloc(header(chars), sizeof(LineText) + cap);
+    AssertNotNull(t);
+    return (char *)(t + 1);
+}
+
+// Releases line text. Safe to call from any thread.
+void LineFree(char *chars)
+{
+    if (chars != NULL && InterlockedDecrement(&header(chars)->refs) == 0)
+        MemFree(header(chars));
+}
+
+// Adds a reference to line text and returns it. The text is copied when
+// either holder writes to it.
+char *LineShare(char *chars)
+{
+    InterlockedIncrement(&header(chars)->refs);
+    return chars;
+}
+
+// Gives line its own copy of its text if it is shared with a snapshot.
+void LineOwn(Line *line)
+{
+    if (header(line->chars)->refs == 1)
+        return;
+
+    char *chars = LineAlloc(line->cap);
+    memcpy(chars, line->chars, line->length);
+    LineFree(line->chars);
+    line->chars = chars;
+}
+
+// Returns a snapshot of the lines of b. It can be read from any thread and must
+// be freed with SnapshotFree.
+Snapshot *BufferSnapshot(Buffer *b)
+{
+    if (b->snapshot == NULL)
+    {
+        Snapshot *s = MemAlloc(sizeof(Snapshot));
+        AssertNotNull(s);
+        *s = (Snapshot){
+            .refs = 1, // Held by the buffer until its next change
+            .lines = b->lines,
+            .numLines = b->numLines,
+            .version = b->version,
+        };
+        b->snapshot = s;
+    }
+
+    InterlockedIncrement(&b->snapshot->refs);
+    return b->snapshot;
+}
+
+// Releases a snapshot. Safe to call from any thread.
+void SnapshotFree(Snapshot *s)
+{
+    if (InterlockedDecrement(&s->refs) > 0)
+        return;
+
+    for (int i = 0; i < s->numLines; i++)
+        LineFree(s->lines[i].chars);
+
+    MemFree(s->lines);
+    MemFree(s);
+}
+
+// Gives b its own line array if the current one was taken by a snapshot. The
+// text of all lines is shared until changed.
+void BufferUnshare(Buffer *b)
+{
+    Snapshot *s = b->snapshot;
+    if (s == NULL)
+        return;
+
+    Line *lines = MemAlloc(b->lineCap * sizeof(Line));
+    AssertNotNull(lines);
+    memcpy(lines, b->lines, b->numLines * sizeof(Line));
+
+    for (int i = 0; i < b->numLines; i++)
+        InterlockedIncrement(&header(lines[i].chars)->refs);
+
+    b->lines = lines;
+    b->snapshot = NULL;
+    SnapshotFree(s);
+}
@@ -0,0 +1,275 @@
+// Trigram index for large read-only buffers. Lines are grouped in blocks of
+// 1 << TRIGRAM_BLOCK_SHIFT lines, and each block has a bitset with a bit set for
+// the hash of every trigram in it. A search hashes the trigrams of the literal
+// every match must contain and only searches blocks that have all their bits
+// set. Hash collisions only add candidates, matches are never missed. The
+// index costs 4 bytes per line, posting lists of all trigrams would be bigger
+// than the file for large logs.
+//
+// The index is built on a background thread from a snapshot of the buffer
+// taken when the file is opened. Only read-only buffers are indexed so rows in
+// the index stay valid. It is cached in the temp directory and reused as long
+// as the file size and write time match.
+
+#include "rum.h"
+
+extern Config config;
+
+#define TRIGRAM_BITS 12                   // Block bitset is 1 << TRIGRAM_BITS words
+#define TRIGRAM_WORDS (1 << TRIGRAM_BITS) // 32 bit words per block
+#define TRIGRAM_MIN_LINES 100000          // Smaller buffers are searched fast enough
+#define TRIGRAM_VERSION 1
+
+typedef struct TrigramHeader
+{
+    char magic[8];
+    int version;
+    int blockShift;
+    int bits;
+    int numLines;
+    int numBlocks;
+    LONGLONG fileSize;
+    FILETIME writeTime;
+} TrigramHeader;
+
+struct TrigramIndex
+{
+    HANDLE thread;
+    volatile LONG cancel;
+    volatile LONG ready;
+    Snapshot *snap;
+
+    TrigramHeader header;
+    char cachePath[MAX_PATH];
+    uint32_t *bits; // TRIGRAM_WORDS per block
+
+    // Filter for the last looked up literal
+    char literal[MAX_SEARCH];
+    int literalLength;
+    uint8_t *filter;
+};
+
+// Returns bit index of the trigram at p in a block bitset.
+static inline uint32_t hashTrigram(char *p)
+{
+    uint32_t t = (uint8_t)p[0] | (uint8_t)p[1] << 8 | (uint8_t)p[2] << 16;
+    return (t * 2654435761u) >> (32 - TRIGRAM_BITS - 5);
+}
+
+// Builds the bitsets from the buffer lines. Returns false if canceled.
+static bool build(TrigramIndex *t)
+{
+    Snapshot *s = t->snap;
+    t->bits = MemZeroAlloc(t->header.numBlocks * TRIGRAM_WORDS * sizeof(uint32_t));
+    AssertNotNull(t->bits);
+
+    for (int block = 0; block < t->header.numBlocks; block++)
+    {
+        if (t->cancel)
+            return false;
+
+        uint32_t *set = t->bits + block * TRIGRAM_WORDS;
+        int end = min((block + 1) << TRIGRAM_BLOCK_SHIFT, s->numLines);
+
+        for (int row = block << TRIGRAM_BLOCK_SHIFT; row < end; row++)
+        {
+            Line *line = &s->lines[row];
+            for (int i = 0; i + 2 < line->length; i++)
+            {
+                uint32_t bit = hashTrigram(line->chars + i);
+                set[bit >> 5] |= 1u << (bit & 31);
+            }
+        }
+    }
+
+    return true;
+}
+
+static bool readAll(HANDLE file, void *dest, DWORD size)
+{
+    DWORD read;
+    return ReadFile(file, dest, size, &read, NULL) && read == size;
+}
+
+static bool writeAll(HANDLE file, void *src, DWORD size)
+{
+    DWORD written;
+    return WriteFile(file, src, size, &written, NULL) && written == size;
+}
+
+// Loads the cached index if it was built for the current version of the file.
+static bool loadCache(TrigramIndex *t)
+{
+    HANDLE file = CreateFileA(t->cachePath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    TrigramHeader header;
+    bool ok = readAll(file, &header, sizeof(header)) && !memcmp(&header, &t->header, sizeof(header));
+
+    if (ok)
+    {
+        t->bits = MemAlloc(header.numBlocks * TRIGRAM_WORDS * sizeof(uint32_t));
+        AssertNotNull(t->bits);
+        ok = readAll(file, t->bits, header.numBlocks * TRIGRAM_WORDS * sizeof(uint32_t));
+    }
+
+    CloseHandle(file);
+    return ok;
+}
+
+static void writeCache(TrigramIndex *t)
+{
+    HANDLE file = CreateFileA(t->cachePath, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return;
+
+    bool ok = writeAll(file, &t->header, sizeof(TrigramHeader)) &&
+              writeAll(file, t->bits, t->header.numBlocks * TRIGRAM_WORDS * sizeof(uint32_t));
+
+    CloseHandle(file);
+    if (!ok)
+        DeleteFileA(t->cachePath);
+}
+
+static DWORD WINAPI indexThread(LPVOID param)
+{
+    TrigramIndex *t = param;
+
+    if (loadCache(t))
+    {
+        InterlockedExchange(&t->ready, 1);
+        return 0;
+    }
+
+    MemFree(t->bits);
+    t->bits = NULL;
+
+    if (!build(t))
+        return 0;
+
+    InterlockedExchange(&t->ready, 1);
+    writeCache(t);
+    Log("Trigram index built");
+    return 0;
+}
+
+// Gets the size and write time of the file and the path of its index cache.
+static bool fileIdentity(TrigramIndex *t, char *filepath)
+{
+    HANDLE file = CreateFileA(filepath, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    bool ok = GetFileSizeEx(file, &size) && GetFileTime(file, NULL, NULL, &t->header.writeTime);
+    t->header.fileSize = size.QuadPart;
+    CloseHandle(file);
+
+    return ok && StrTempPath(t->cachePath, filepath, ".tri");
+}
+
+// Starts building a trigram index for the read-only file in b on a background
+// thread. Does nothing if the index is disabled or the buffer is small.
+void TrigramStart(Buffer *b)
+{
+    if (!config.trigramIndex || !b->readOnly || !b->isFile || b->numLines < TRIGRAM_MIN_LINES || b->trigrams != NULL)
+        return;
+
+    TrigramIndex *t = MemZeroAlloc(sizeof(TrigramIndex));
+    AssertNotNull(t);
+
+    memcpy(t->header.magic, "RUMTRI", 7);
+    t->header.version = TRIGRAM_VERSION;
+    t->header.blockShift = TRIGRAM_BLOCK_SHIFT;
+    t->header.bits = TRIGRAM_BITS;
+    t->header.numLines = b->numLines;
+    t->header.numBlocks = (b->numLines >> TRIGRAM_BLOCK_SHIFT) + 1;
+
+    if (!fileIdentity(t, b->filepath))
+    {
+        MemFree(t);
+        return;
+    }
+
+    t->snap = BufferSnapshot(b);
+    t->thread = CreateThread(NULL, 0, indexThread, t, 0, NULL);
+    if (t->thread == NULL)
+    {
+        SnapshotFree(t->snap);
+        MemFree(t);
+        return;
+    }
+
+    b->trigrams = t;
+}
+
+// Stops the index thread and frees the index, if any.
+void TrigramFree(Buffer *b)
+{
+    TrigramIndex *t = b->trigrams;
+    if (t == NULL)
+        return;
+
+    InterlockedExchange(&t->cancel, 1);
+    WaitForSingleObject(t->thread, INFINITE);
+    CloseHandle(t->thread);
+
+    SnapshotFree(t->snap);
+    MemFree(t->bits);
+    MemFree(t->filter);
+    MemFree(t);
+    b->trigrams = NULL;
+}
+
+// Returns a filter with one byte per block of 1 << TRIGRAM_BLOCK_SHIFT rows, where
+// blocks that cannot contain a match of s are 0. Returns NULL if there is no
+// index ready or s has no literal of at least three bytes. The filter is owned
+// by the index and valid until the next call.
+uint8_t *TrigramFilter(Buffer *b, Search *s)
+{
+    TrigramIndex *t = b->trigrams;
+    if (t == NULL || !t->ready || s->length == 0)
+        return NULL;
+
+    Search *lit = s->regex != NULL ? RegexLiteral(s->regex) : s;
+    if (lit->length < 3)
+        return NULL;
+
+    if (t->filter != NULL && lit->length == t->literalLength && !memcmp(lit->pattern, t->literal, lit->length))
+        return t->filter;
+
+    int numBlocks = t->header.numBlocks;
+    if (t->filter == NULL)
+        t->filter = MemAlloc(numBlocks);
+    AssertNotNull(t->filter);
+
+    memcpy(t->literal, lit->pattern, lit->length);
+    t->literalLength = lit->length;
+
+    // Bits of all trigrams in the literal
+    uint32_t query[TRIGRAM_WORDS] = {0};
+    for (int i = 0; i + 2 < lit->length; i++)
+    {
+        uint32_t bit = hashTrigram(lit->pattern + i);
+        query[bit >> 5] |= 1u << (bit & 31);
+    }
+
+    // Only words with query bits need to be checked
+    int words[MAX_SEARCH];
+    int numWords = 0;
+    for (int i = 0; i < TRIGRAM_WORDS; i++)
+        if (query[i] != 0)
+            words[numWords++] = i;
+
+    for (int block = 0; block < numBlocks; block++)
+    {
+        uint32_t *set = t->bits + block * TRIGRAM_WORDS;
+        bool candidate = true;
+        for (int i = 0; i < numWords && candidate; i++)
+            candidate = (set[words[i]] & query[words[i]]) == query[words[i]];
+        t->filter[block] = candidate;
+    }
+
+    return t->filter;
+}
@@ -4,7 +4,7 @@
 
 static void printHelp()
 {
-    printf("Usage: rum [filename] [options]      \n");
+    printf("Usage: rum [files...] [options]      \n");
     printf("                                     \n");
     printf("Options:                             \n");
     printf("    -v --version   print version     \n");
@@ -13,15 +13,9 @@ static void printHelp()
 
 bool ProcessArgs(int argc, char **argv, CmdOptions *op)
 {
-    if (argc > 2)
+    for (int i = 1; i < argc; i++)
     {
-        printHelp();
-        return RETURN_ERROR;
-    }
-
-    if (argc == 2)
-    {
-        char *command = argv[1];
+        char *command = argv[i];
 
         if (!strcmp(command, "--version") || !strcmp(command, "-v"))
         {
@@ -39,12 +33,10 @@ bool ProcessArgs(int argc, char **argv, CmdOptions *op)
             printHelp();
             return RETURN_ERROR;
         }
-        else
-        {
-            strncpy(op->filename, command, 260);
-            op->hasFile = true;
-        }
     }
 
+    // Everything else is a file
+    op->numFiles = argc - 1;
+    op->files = argv + 1;
     return RETURN_SUCCESS;
 }
\ No newline at end of file
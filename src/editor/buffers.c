@@ -0,0 +1,325 @@
+// Buffer list. Every open buffer stays in the list with its cursor, search and
+// undo history, so switching only changes the active index. When the text of
+// hidden buffers grows past the memory budget, the least recently shown files
+// without unsaved changes are unloaded. Their undo history is in the journal,
+// and they are read from disk again when shown.
+
+#include "rum.h"
+
+extern Editor editor;
+extern Config config;
+
+// Returns true if a and b are the same file.
+static bool samePath(char *a, char *b)
+{
+    char fullA[MAX_PATH], fullB[MAX_PATH];
+    if (GetFullPathNameA(a, MAX_PATH, fullA, NULL) == 0 || GetFullPathNameA(b, MAX_PATH, fullB, NULL) == 0)
+        return false;
+    return !_stricmp(fullA, fullB);
+}
+
+// Returns true if b is an empty buffer nothing was done in, which a new buffer
+// can replace.
+static bool isScratch(Buffer *b)
+{
+    return !b->isFile && !b->isResults && !b->readOnly && !b->dirty && b->numLines == 1 && b->lines[0].length == 0;
+}
+
+// Returns an estimate of the memory used by the text of b.
+static int64_t memoryUse(Buffer *b)
+{
+    if (b->unloaded)
+        return 0;
+    return (int64_t)b->textSize + (int64_t)b->lineCap * sizeof(Line);
+}
+
+// Returns true if b can be unloaded and read again from its file without
+// losing anything.
+static bool canUnload(Buffer *b)
+{
+    return b->isFile && !b->dirty && !b->unloaded && ViewCount(b) == 0 &&
+           (b->undo.journal != NULL || b->undo.numNodes <= 1);
+}
+
+// Unloads the least recently shown hidden buffers until the text of the
+// hidden buffers fits in the memory budget. Buffers in a view are not hidden.
+static void evictBuffers()
+{
+    int64_t budget = (int64_t)config.bufferMemory * 1024 * 1024;
+    int64_t total = 0;
+    for (int i = 0; i < editor.numBuffers; i++)
+        if (ViewCount(editor.buffers[i]) == 0)
+            total += memoryUse(editor.buffers[i]);
+
+    while (total > budget)
+    {
+        Buffer *oldest = NULL;
+        for (int i = 0; i < editor.numBuffers; i++)
+        {
+            Buffer *b = editor.buffers[i];
+            if (canUnload(b) && (oldest == NULL || b->lastShown < oldest->lastShown))
+                oldest = b;
+        }
+
+        if (oldest == NULL)
+            break;
+
+        Logf("Unloading %s", oldest->filepath);
+        total -= memoryUse(oldest);
+        BufferUnload(oldest);
+    }
+}
+
+// Reads the text of an unloaded buffer from its file. The buffer is left empty
+// if the file is gone.
+static void reload(Buffer *b)
+{
+    int size = 0;
+    char *buf = EditorReadFile(b->filepath, &size);
+    if (buf == NULL)
+    {
+        BufferReload(b, "", 0);
+        SetStatus(NULL, size == -1 ? "file too large" : "file not found");
+        return;
+    }
+
+    BufferReload(b, buf, size);
+    JournalOpen(b, buf, size);
+    MemFree(buf);
+
+    if (b->readOnly)
+        TrigramStart(b);
+
+    CursorSetPos(b, b->cursor.col, b->cursor.row, false);
+}
+
+static void addToList(Buffer *b)
+{
+    if (editor.numBuffers == editor.bufferCap)
+    {
+        editor.bufferCap = max(editor.bufferCap * 2, EDITOR_BUFFER_CAP);
+        editor.buffers = MemRealloc(editor.buffers, editor.bufferCap * sizeof(Buffer *));
+        AssertNotNull(editor.buffers);
+    }
+
+    editor.buffers[editor.numBuffers++] = b;
+}
+
+// Returns the index of b in the buffer list, -1 if it is not in it.
+int EditorBufferIndex(Buffer *b)
+{
+    for (int i = 0; i < editor.numBuffers; i++)
+        if (editor.buffers[i] == b)
+            return i;
+    return -1;
+}
+
+// Writes the identity of the file at path to id. Returns false if it cannot be
+// read, eg. if the file does not exist.
+bool EditorFileId(char *path, FileId *id)
+{
+    id->valid = false;
+    HANDLE file = CreateFileA(path, 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    BY_HANDLE_FILE_INFORMATION info;
+    if (GetFileInformationByHandle(file, &info))
+    {
+        id->valid = true;
+        id->volume = info.dwVolumeSerialNumber;
+        id->indexHigh = info.nFileIndexHigh;
+        id->indexLow = info.nFileIndexLow;
+    }
+
+    CloseHandle(file);
+    return id->valid;
+}
+
+// Returns true if a and b are valid and the same file.
+bool EditorSameFile(FileId *a, FileId *b)
+{
+    return a->valid && b->valid && a->volume == b->volume && a->indexHigh == b->indexHigh &&
+           a->indexLow == b->indexLow;
+}
+
+// Returns the open buffer of the file at filepath, NULL if there is none. Other
+// paths to an open file, eg. links, give the same buffer, so a file is never
+// held twice.
+Buffer *EditorFindBuffer(char *filepath)
+{
+    FileId id;
+    EditorFileId(filepath, &id);
+
+    for (int i = 0; i < editor.numBuffers; i++)
+    {
+        Buffer *b = editor.buffers[i];
+        if (!b->isFile)
+            continue;
+
+        if (samePath(b->filepath, filepath))
+            return b;
+
+        if (id.valid && !b->fileId.valid)
+            EditorFileId(b->filepath, &b->fileId);
+        if (EditorSameFile(&id, &b->fileId))
+            return b;
+    }
+
+    return NULL;
+}
+
+// Shows the buffer at index in the buffer list.
+void EditorShowBuffer(int index)
+{
+    Buffer *b = editor.buffers[index];
+    if (b->unloaded)
+        reload(b);
+
+    editor.activeBuffer = index;
+    b->lastShown = ++editor.numSwitches;
+    evictBuffers();
+}
+
+// Shows b, adding it to the buffer list if it is not in it. A new buffer
+// replaces the current one if that is empty and unused.
+void EditorSetCurrentBuffer(Buffer *b)
+{
+    int index = EditorBufferIndex(b);
+    if (index != -1)
+    {
+        EditorShowBuffer(index);
+        return;
+    }
+
+    if (editor.numBuffers > 0 && isScratch(curBuffer) && ViewCount(curBuffer) == 1)
+    {
+        BufferFree(curBuffer);
+        curBuffer = b;
+        EditorShowBuffer(editor.activeBuffer);
+        return;
+    }
+
+    addToList(b);
+    EditorShowBuffer(editor.numBuffers - 1);
+}
+
+// Adds b to the end of the buffer list without showing it.
+void EditorAddBuffer(Buffer *b)
+{
+    addToList(b);
+    evictBuffers();
+}
+
+// Removes b from the buffer list without freeing it. If b is shown, the buffer
+// before it is shown instead, or a new empty one if it was the last. Other
+// views showing b show the current buffer.
+void EditorRemoveBuffer(Buffer *b)
+{
+    int index = EditorBufferIndex(b);
+    if (index == -1)
+        return;
+
+    memmove(editor.buffers + index, editor.buffers + index + 1, (editor.numBuffers - index - 1) * sizeof(Buffer *));
+    editor.numBuffers--;
+
+    if (editor.numBuffers == 0)
+    {
+        editor.activeBuffer = 0;
+        EditorSetCurrentBuffer(BufferNew());
+    }
+    else if (index == editor.activeBuffer)
+        EditorShowBuffer(max(index - 1, 0));
+    else if (index < editor.activeBuffer)
+        editor.activeBuffer--;
+
+    ViewBufferRemoved(b);
+    if (editor.blockInsert == b)
+        editor.blockInsert = NULL;
+}
+
+// Closes the current buffer, asking to save it first if it has changes. It is
+// kept if the changes were neither saved nor declined. The grep results buffer
+// is only removed from the list, grep keeps it.
+void EditorCloseBuffer()
+{
+    Buffer *b = curBuffer;
+    if (!PromptFileNotSaved())
+    {
+        SetStatus(NULL, "file not saved");
+        return;
+    }
+
+    EditorRemoveBuffer(b);
+
+    if (!b->isResults)
+        BufferFree(b);
+}
+
+// Shows the buffer at offset from the current one in the list, wrapping around.
+void EditorCycleBuffer(int offset)
+{
+    int n = editor.numBuffers;
+    EditorShowBuffer(((editor.activeBuffer + offset) % n + n) % n);
+}
+
+// Shows the buffer given by its number in the list or part of its path.
+// Returns false if there is no match or more than one.
+bool EditorSwitchBuffer(char *name)
+{
+    char *end;
+    long number = strtol(name, &end, 10);
+    if (*end == 0)
+    {
+        if (number < 1 || number > editor.numBuffers)
+            return false;
+
+        EditorShowBuffer(number - 1);
+        return true;
+    }
+
+    int match = -1;
+    for (int i = 0; i < editor.numBuffers; i++)
+    {
+        Buffer *b = editor.buffers[i];
+        if (b->isFile && samePath(b->filepath, name))
+        {
+            match = i;
+            break;
+        }
+
+        if (strstr(b->filepath, name) != NULL)
+        {
+            if (match != -1)
+                return false;
+            match = i;
+        }
+    }
+
+    if (match == -1)
+        return false;
+
+    EditorShowBuffer(match);
+    return true;
+}
+
+// Writes the buffer list to dest as numbered names, the current one marked
+// with % and changed ones with *.
+void EditorListBuffers(char *dest, int size)
+{
+    int length = 0;
+    dest[0] = 0;
+
+    for (int i = 0; i < editor.numBuffers && length < size; i++)
+    {
+        Buffer *b = editor.buffers[i];
+        char *name = b->filepath[0] != 0 ? b->filepath : "[empty]";
+        for (char *p = name; b->isFile && *p; p++)
+            if (*p == '\\' || *p == '/')
+                name = p + 1;
+
+        length += snprintf(dest + length, size - length, "%s%d%s %s%s", i > 0 ? "  " : "", i + 1,
+                           i == editor.activeBuffer ? "%" : "", name, b->dirty ? "*" : "");
+    }
+}
@@ -2,19 +2,28 @@
 
 #define wordSize 32 // Size of token lexemes
 
+extern Editor editor;
+extern Colors colors;
+extern Config config;
+extern SyntaxRegistry *syntaxRegistry;
+
+// Writes path of file in the directory of the executable to dest.
+static void configPath(char *dest, const char *file, int size)
+{
+    // Concat path to executable with filepath
+    int len = GetModuleFileNameA(NULL, dest, size);
+    for (int i = len; i > 0 && dest[i] != '\\'; i--)
+        dest[i] = 0;
+
+    strncat(dest, file, size - strlen(dest) - 1);
+}
+
 // Looks for files in the directory of the executable, eg. config, runtime etc.
 // Returns pointer to file data, NULL on error. Writes to size. Remember to free!
 static char *readConfigFile(const char *file, int *size)
 {
-    const int pathSize = 512;
-
-    // Concat path to executable with filepath
-    char path[pathSize];
-    int len = GetModuleFileNameA(NULL, path, pathSize);
-    for (int i = len; i > 0 && path[i] != '\\'; i--)
-        path[i] = 0;
-
-    strcat(path, file);
+    char path[512];
+    configPath(path, file, sizeof(path));
     return EditorReadFile(path, size);
 }
 
@@ -29,8 +38,14 @@ Status readerFromFile(char *filepath, reader *r)
 {
     int size;
     char *file = readConfigFile(filepath, &size);
-    if (file == NULL || size == 0)
+    if (file == NULL)
+        return RETURN_ERROR;
+
+    if (size == 0)
+    {
+        MemFree(file);
         return RETURN_ERROR;
+    }
 
     r->file = file;
     r->size = size;
@@ -198,6 +213,10 @@ Status LoadConfig(Config *config)
     config->syntaxEnabled = true;
     config->matchParen = true;
     config->useCRLF = true;
+    config->trigramIndex = true;
+    config->undoMemory = DEFAULT_UNDO_MEMORY;
+    config->undoJournal = true;
+    config->bufferMemory = DEFAULT_BUFFER_MEMORY;
 
     reader r;
     token t;
@@ -221,6 +240,14 @@ Status LoadConfig(Config *config)
                 config->matchParen = expect_bool(&r, &t, true);
             else if (isword("syntaxEnabled"))
                 config->syntaxEnabled = expect_bool(&r, &t, true);
+            else if (isword("trigramIndex"))
+                config->trigramIndex = expect_bool(&r, &t, true);
+            else if (isword("undoMemory"))
+                config->undoMemory = expect_number(&r, &t, DEFAULT_UNDO_MEMORY);
+            else if (isword("undoJournal"))
+                config->undoJournal = expect_bool(&r, &t, true);
+            else if (isword("bufferMemory"))
+                config->bufferMemory = expect_number(&r, &t, DEFAULT_BUFFER_MEMORY);
             else
                 Errorf("Unknown key %s", t.word);
             continue;
@@ -235,10 +262,10 @@ Status LoadConfig(Config *config)
         Error("unhandled case in json parsing");
     }
 
+    MemFree(r.file);
     if (t.type != T_RBRACE)
         return RETURN_ERROR;
 
-    MemFree(r.file);
     Log("Config loaded");
     return RETURN_SUCCESS;
 }
@@ -297,20 +324,24 @@ Status LoadTheme(char *name, Colors *colors)
         if (t.type != T_STRING)
         {
             Error("expected string");
+            MemFree(r.file);
             return RETURN_ERROR;
         }
 
-        char name[wordSize];
-        strncpy(name, t.word, wordSize);
+        char colorName[wordSize];
+        strncpy(colorName, t.word, wordSize);
         char colorHex[wordSize];
         expect_string(&r, &t, colorHex);
 
         char colorRGB[32] = {0};
         if (!hex_to_rgb(colorHex, colorRGB, "0;0;0"))
+        {
+            MemFree(r.file);
             return RETURN_ERROR;
+        }
 
 #define set_color(n, dest)                   \
-    if (!strncmp(n, name, wordSize))         \
+    if (!strncmp(n, colorName, wordSize))    \
     {                                        \
         memset(dest, 0, COLOR_SIZE);         \
         strncpy(dest, colorRGB, COLOR_SIZE); \
@@ -333,28 +364,26 @@ Status LoadTheme(char *name, Colors *colors)
         Error("unknown color name");
     }
 
+    MemFree(r.file);
     if (t.type != T_RBRACE)
         return RETURN_ERROR;
 
-    strncpy(colors->name, name, 31);
-    MemFree(r.file);
+    strncpy(colors->name, name, THEME_NAME_LEN - 1);
     Log("Theme loaded");
     return RETURN_SUCCESS;
 }
 
-Status LoadSyntax(Buffer *b, char *filepath)
+// Parses every table in the syntax file. Returns NULL on failure.
+SyntaxRegistry *LoadSyntaxRegistry()
 {
-    char extension[16];
-    StrFileExtension(extension, filepath);
-
-    SyntaxTable *table = MemZeroAlloc(sizeof(SyntaxTable));
-    b->syntaxReady = false;
-
     reader r;
     token t;
 
     if (!readerFromFile("config/syntax.json", &r))
-        goto fail;
+        return NULL;
+
+    SyntaxRegistry *reg = MemZeroAlloc(sizeof(SyntaxRegistry));
+    AssertNotNull(reg);
 
     next(&r, &t); // LBRACE
 
@@ -367,16 +396,11 @@ Status LoadSyntax(Buffer *b, char *filepath)
             goto fail;
         }
 
-        char *name = strtok(t.word, "/");
-        while (name != NULL && strcmp(name, extension))
-            name = strtok(NULL, "/");
-
-        bool found = false;
-        if (name != NULL)
-        {
-            strcpy(table->extension, extension);
-            found = true;
-        }
+        reg->tables = MemRealloc(reg->tables, (reg->numTables + 1) * sizeof(SyntaxTable));
+        AssertNotNull(reg->tables);
+        SyntaxTable *table = &reg->tables[reg->numTables++];
+        memset(table, 0, sizeof(SyntaxTable));
+        strncpy(table->extensions, t.word, sizeof(table->extensions) - 1);
 
         // Parse syntax
         next(&r, &t); // Colon
@@ -392,14 +416,11 @@ Status LoadSyntax(Buffer *b, char *filepath)
             while (true)
             {
                 next(&r, &t);
-                if (t.type == T_STRING)
+                if (t.type == T_STRING && pos + t.len + 1 <= sizeof(table->words[i]))
                 {
-                    if (found)
-                    {
-                        memcpy(table->words[i] + pos, t.word, t.len + 1);
-                        pos += t.len + 1;
-                        table->numWords[i]++;
-                    }
+                    memcpy(table->words[i] + pos, t.word, t.len + 1);
+                    pos += t.len + 1;
+                    table->numWords[i]++;
                 }
 
                 next(&r, &t);
@@ -414,23 +435,206 @@ Status LoadSyntax(Buffer *b, char *filepath)
 
         next(&r, &t); // RBRACE
 
-        if (found)
-        {
-            b->syntaxReady = true;
-            b->syntaxTable = table;
-            return RETURN_SUCCESS;
-        }
-
         // If comma, more syntax to come, else quit
         if (t.type != T_COMMA)
             break;
     }
 
-    if (t.type != T_RBRACE)
-        goto fail;
+    MemFree(r.file);
+    Log("Syntax loaded");
+    return reg;
 
 fail:
     MemFree(r.file);
-    MemFree(table);
-    return RETURN_ERROR;
-}
\ No newline at end of file
+    SyntaxRegistryFree(reg);
+    return NULL;
+}
+
+void SyntaxRegistryFree(SyntaxRegistry *reg)
+{
+    if (reg == NULL)
+        return;
+    MemFree(reg->tables);
+    MemFree(reg);
+}
+
+// Returns the table matching the file extension, NULL if none is found.
+SyntaxTable *SyntaxLookup(SyntaxRegistry *reg, char *extension)
+{
+    if (reg == NULL || strlen(extension) == 0)
+        return NULL;
+
+    int length = strlen(extension);
+
+    for (int i = 0; i < reg->numTables; i++)
+    {
+        // Compare each name in the slash seperated list
+        char *name = reg->tables[i].extensions;
+        while (name != NULL)
+        {
+            char *slash = strchr(name, '/');
+            int nameLength = slash != NULL ? slash - name : strlen(name);
+            if (nameLength == length && !strncmp(name, extension, length))
+                return &reg->tables[i];
+            name = slash != NULL ? slash + 1 : NULL;
+        }
+    }
+
+    return NULL;
+}
+
+// Looks up the syntax table for the file in the global registry and sets it in b.
+Status LoadSyntax(Buffer *b, char *filepath)
+{
+    char extension[260];
+    StrFileExtension(extension, filepath);
+
+    b->syntaxTable = SyntaxLookup(syntaxRegistry, extension);
+    b->syntaxReady = b->syntaxTable != NULL;
+    return b->syntaxReady ? RETURN_SUCCESS : RETURN_ERROR;
+}
+
+// Live reload. A watcher thread waits for changes in the config directory, or
+// for a theme request from the editor, and parses everything into a pending
+// slot. The input thread swaps the pending values in between two frames, so
+// nothing is ever parsed on the input thread and the renderer never sees a
+// half written config.
+
+#define RELOAD_DEBOUNCE_MS 100 // Editors often save a file in several writes
+
+static struct
+{
+    CRITICAL_SECTION lock;
+    HANDLE request;             // Signaled by ConfigRequestTheme
+    char theme[THEME_NAME_LEN]; // Theme to load on next reload
+
+    bool ready;     // Pending values are ready to be swapped in
+    bool hasConfig; // Parts of the pending slot that parsed successfully
+    bool hasColors;
+    Config config;
+    Colors colors;
+    SyntaxRegistry *syntax;
+} reload;
+
+static DWORD WINAPI watchConfig(LPVOID arg)
+{
+    char dir[512];
+    configPath(dir, "config", sizeof(dir));
+
+    HANDLE change = FindFirstChangeNotificationA(dir, TRUE, FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME);
+    if (change == INVALID_HANDLE_VALUE)
+        Error("failed to watch config directory");
+
+    HANDLE handles[2] = {reload.request, change};
+    int numHandles = change == INVALID_HANDLE_VALUE ? 1 : 2;
+
+    while (true)
+    {
+        DWORD signaled = WaitForMultipleObjects(numHandles, handles, FALSE, INFINITE);
+        if (signaled == WAIT_OBJECT_0 + 1)
+        {
+            Sleep(RELOAD_DEBOUNCE_MS);
+            FindNextChangeNotification(change);
+        }
+        else if (signaled != WAIT_OBJECT_0)
+            break;
+
+        char theme[THEME_NAME_LEN];
+        EnterCriticalSection(&reload.lock);
+        strcpy(theme, reload.theme);
+        LeaveCriticalSection(&reload.lock);
+
+        Config newConfig;
+        Colors newColors = {0};
+        bool hasConfig = LoadConfig(&newConfig);
+        bool hasColors = LoadTheme(theme, &newColors);
+        SyntaxRegistry *syntax = LoadSyntaxRegistry();
+
+        EnterCriticalSection(&reload.lock);
+        if (reload.ready)
+            SyntaxRegistryFree(reload.syntax); // Superseded before it was applied
+
+        reload.hasConfig = hasConfig;
+        reload.hasColors = hasColors;
+        reload.config = newConfig;
+        reload.colors = newColors;
+        reload.syntax = syntax;
+        reload.ready = true;
+        LeaveCriticalSection(&reload.lock);
+
+        EditorWake();
+    }
+
+    if (change != INVALID_HANDLE_VALUE)
+        FindCloseChangeNotification(change);
+    return 0;
+}
+
+// Starts the config watcher thread. Must be called after the initial config,
+// theme and syntax have been loaded.
+void ConfigWatchStart()
+{
+    InitializeCriticalSection(&reload.lock);
+    strncpy(reload.theme, colors.name, THEME_NAME_LEN - 1);
+
+    reload.request = CreateEventA(NULL, FALSE, FALSE, NULL);
+    if (reload.request == NULL || CreateThread(NULL, 0, watchConfig, NULL, 0, NULL) == NULL)
+        Error("failed to start config watcher");
+}
+
+// Asks the watcher thread to load a new theme. The result is swapped in by
+// ConfigApplyReload when it is done.
+void ConfigRequestTheme(char *name)
+{
+    EnterCriticalSection(&reload.lock);
+    strncpy(reload.theme, name, THEME_NAME_LEN - 1);
+    LeaveCriticalSection(&reload.lock);
+    SetEvent(reload.request);
+}
+
+// Swaps in pending config, colors and syntax if the watcher has any ready.
+// Must be called from the input thread. Returns true if anything changed.
+bool ConfigApplyReload()
+{
+    EnterCriticalSection(&reload.lock);
+
+    if (!reload.ready)
+    {
+        LeaveCriticalSection(&reload.lock);
+        return false;
+    }
+
+    if (reload.hasConfig)
+        config = reload.config;
+
+    if (reload.hasColors)
+        colors = reload.colors;
+    else
+    {
+        // Keep the last working theme for the next reload
+        strncpy(reload.theme, colors.name, THEME_NAME_LEN - 1);
+        SetStatus(NULL, "theme not found");
+    }
+
+    if (reload.syntax != NULL)
+    {
+        SyntaxRegistry *old = syntaxRegistry;
+        syntaxRegistry = reload.syntax;
+
+        for (int i = 0; i < editor.numBuffers; i++)
+            if (editor.buffers[i]->isFile)
+                LoadSyntax(editor.buffers[i], editor.buffers[i]->filepath);
+
+        SyntaxRegistryFree(old);
+    }
+
+    // Cached highlights use the old colors and syntax
+    for (int i = 0; i < editor.numBuffers; i++)
+        HighlightCacheFree(editor.buffers[i]);
+
+    reload.syntax = NULL;
+    reload.ready = false;
+    LeaveCriticalSection(&reload.lock);
+    Log("Config reloaded");
+    return true;
+}
@@ -8,6 +8,8 @@ Editor editor; // Global editor instance used in core module
 Colors colors; // Global constant color palette loaded from theme.json
 Config config; // Global constant config loaded from config.json
 
+SyntaxRegistry *syntaxRegistry; // Global syntax tables loaded from syntax.json
+
 static void updateSize();
 
 void error_exit(char *msg)
@@ -60,9 +62,7 @@ void EditorInit(CmdOptions options)
     // win32 does not give a shit if the handle is invalid and will
     // blame literally anything else (especially HeapFree for some reason)
 
-    editor.buffers[0] = BufferNew();
-    editor.activeBuffer = 0;
-    editor.numBuffers = 1;
+    EditorSetCurrentBuffer(BufferNew());
 
     editor.mode = MODE_INSERT;
 
@@ -72,24 +72,38 @@ void EditorInit(CmdOptions options)
     if (!LoadConfig(&config))
         error_exit("Failed to load config file");
 
-    if (options.hasFile)
-    {
-        if (!EditorOpenFile(options.filename))
-            error_exit("File not found");
-    }
+    syntaxRegistry = LoadSyntaxRegistry();
+    PoolInit();
+
+    initTerm(); // Must be called before render and loading files
+
+    // The first file is shown when loaded, the rest are added in the background
+    if (options.numFiles > 0 && !LoaderOpen(options.files, options.numFiles))
+        error_exit("File not found");
 
-    initTerm(); // Must be called before render
+    ConfigWatchStart();
     Render();
     Log("Init");
 }
 
 void EditorFree()
 {
-    PromptFileNotSaved();
+    // Ask for every buffer with changes, shown so the user knows which
+    for (int i = 0; i < editor.numBuffers; i++)
+    {
+        if (editor.buffers[i]->dirty)
+        {
+            EditorShowBuffer(i);
+            Render();
+            PromptFileNotSaved();
+        }
+    }
 
     for (int i = 0; i < editor.numBuffers; i++)
         BufferFree(editor.buffers[i]);
 
+    MemFree(editor.buffers);
+
     MemFree(editor.renderBuffer);
     CloseHandle(editor.hbuffer);
     Log("Editor free successful");
@@ -98,6 +112,9 @@ void EditorFree()
 // Hangs when waiting for input. Returns error if read failed. Writes to info.
 Status EditorReadInput(InputInfo *info)
 {
+    if (MacroNextInput(info))
+        return RETURN_SUCCESS;
+
     INPUT_RECORD record;
     DWORD read;
     if (!ReadConsoleInputA(editor.hstdin, &record, 1, &read) || read == 0)
@@ -115,10 +132,91 @@ Status EditorReadInput(InputInfo *info)
     }
     else if (record.EventType == WINDOW_BUFFER_SIZE_EVENT)
         info->eventType = INPUT_WINDOW_RESIZE;
+    else if (record.EventType == MENU_EVENT)
+        info->eventType = INPUT_WAKE;
 
+    MacroRecordInput(info);
     return RETURN_SUCCESS;
 }
 
+// Returns true if a key press is waiting in the input queue. Used by long
+// running work on the input thread to cancel itself when the user types.
+bool EditorKeyPending()
+{
+    INPUT_RECORD records[16];
+    DWORD count;
+    if (!PeekConsoleInputA(editor.hstdin, records, 16, &count))
+        return false;
+
+    for (int i = 0; i < count; i++)
+        if (records[i].EventType == KEY_EVENT && records[i].Event.KeyEvent.bKeyDown)
+            return true;
+
+    return false;
+}
+
+// Discards the key presses waiting in the input queue. Other events, like
+// wakes from background threads and resizes, are put back so they are handled.
+void EditorDiscardKeys()
+{
+    INPUT_RECORD records[64];
+    INPUT_RECORD kept[64];
+    int numKept = 0;
+    DWORD count;
+
+    while (GetNumberOfConsoleInputEvents(editor.hstdin, &count) && count > 0)
+    {
+        if (!ReadConsoleInputA(editor.hstdin, records, 64, &count))
+            break;
+
+        // Repeated wakes and resizes are handled the same as one
+        for (int i = 0; i < count && numKept < 64; i++)
+            if (records[i].EventType != KEY_EVENT)
+                kept[numKept++] = records[i];
+    }
+
+    if (numKept > 0)
+        WriteConsoleInputA(editor.hstdin, kept, numKept, &count);
+}
+
+// Waits for job to finish, showing label and progress on the command line.
+// Count is the number of tasks in the job. A key press cancels the job and is
+// discarded. Returns false if the job was canceled. Does not free the job.
+bool EditorWaitJob(PoolJob *job, int count, char *label)
+{
+    // Skip progress for jobs that finish right away
+    if (PoolWait(job, 30))
+        return true;
+
+    while (!PoolWait(job, 50))
+    {
+        if (EditorKeyPending())
+        {
+            PoolCancel(job);
+            EditorDiscardKeys();
+            break;
+        }
+
+        char info[128];
+        sprintf(info, "%s %d%% (press any key to cancel)", label, PoolProgress(job) * 100 / max(count, 1));
+        SetStatusInfo(info);
+        Render();
+    }
+
+    PoolWait(job, INFINITE);
+    SetStatusInfo(NULL);
+    return !PoolCanceled(job);
+}
+
+// Wakes the input thread from a background thread. Menu events are only used
+// internally by the console so they are safe to use as a wake signal.
+void EditorWake()
+{
+    INPUT_RECORD record = {.EventType = MENU_EVENT};
+    DWORD written;
+    WriteConsoleInputA(editor.hstdin, &record, 1, &written);
+}
+
 // Waits for input and takes action for insert mode.
 Status EditorHandleInput()
 {
@@ -133,6 +231,16 @@ Status EditorHandleInput()
         return RETURN_SUCCESS;
     }
 
+    if (info.eventType == INPUT_WAKE)
+    {
+        bool changed = ConfigApplyReload();
+        changed = GrepApplyResults() || changed;
+        changed = LoaderApplyResults() || changed;
+        if (changed)
+            Render();
+        return RETURN_SUCCESS;
+    }
+
     if (info.eventType == INPUT_KEYDOWN)
     {
         switch (editor.mode)
@@ -151,10 +259,19 @@ Status EditorHandleInput()
         }
         break;
 
+        case MODE_VISUAL:
+            HandleVisualMode(&info);
+            break;
+
         default:
             break;
         }
 
+        // A playing macro draws and writes the journal once when done
+        if (editor.replaying)
+            return RETURN_SUCCESS;
+
+        JournalFlush(curBuffer);
         Render();
         return RETURN_SUCCESS;
     }
@@ -163,26 +280,38 @@ Status EditorHandleInput()
 }
 
 // Loads file into current buffer. Filepath must either be an absolute path
-// or name of a file in the same directory as working directory.
+// or name of a file in the same directory as working directory. Sets a status
+// error if the file cannot be loaded.
 Status EditorOpenFile(char *filepath)
 {
     if (filepath == NULL || strlen(filepath) == 0)
     {
         // Empty buffer
-        BufferFree(curBuffer);
-        curBuffer = BufferNew();
+        EditorSetCurrentBuffer(BufferNew());
         return RETURN_SUCCESS;
     }
 
-    PromptFileNotSaved();
+    // Files that are already open are shown as they are
+    Buffer *open = EditorFindBuffer(filepath);
+    if (open != NULL)
+    {
+        EditorSetCurrentBuffer(open);
+        SetStatus(filepath, NULL);
+        return RETURN_SUCCESS;
+    }
 
-    int size;
+    int size = 0;
     char *buf = EditorReadFile(filepath, &size);
     if (buf == NULL)
+    {
+        SetStatus(NULL, size == -1 ? "file too large" : "file not found");
         return RETURN_ERROR;
+    }
 
-    // Change active buffer
+    // Change active buffer, the previous one stays in the buffer list
     Buffer *newBuf = BufferLoadFile(filepath, buf, size);
+    JournalOpen(newBuf, buf, size);
+    MemFree(buf);
     EditorSetCurrentBuffer(newBuf);
 
     SetStatus(filepath, NULL);
@@ -193,12 +322,6 @@ Status EditorOpenFile(char *filepath)
     return RETURN_SUCCESS;
 }
 
-void EditorSetCurrentBuffer(Buffer *b)
-{
-    BufferFree(curBuffer);
-    curBuffer = b;
-}
-
 // Writes content of buffer to filepath. Always truncates file.
 Status EditorSaveFile()
 {
@@ -229,27 +352,44 @@ static void updateSize()
     editor.height = (int)(newSize.Y);
 }
 
-// Asks user if they want to exit without saving. Writes file if answered yes.
-void PromptFileNotSaved()
+// Asks user if they want to close the current buffer without saving. Writes
+// file if answered yes. Returns false if it has changes that were neither saved
+// nor thrown away by the user.
+bool PromptFileNotSaved()
 {
-    if (curBuffer->isFile && curBuffer->dirty)
-        if (UiPromptYesNo("Save file before closing?", true) == UI_YES)
-            EditorSaveFile();
+    if (!curBuffer->dirty || curBuffer->readOnly)
+        return true;
+
+    if (UiPromptYesNo("Save file before closing?", true) == UI_NO)
+        return true;
+
+    return EditorSaveFile() == RETURN_SUCCESS;
 }
 
-// Returns pointer to file contents, NULL on fail. Size is written to.
+// Returns pointer to file contents, NULL on fail. Size is written to, it is set
+// to -1 if the file is too large to load.
 char *EditorReadFile(const char *filepath, int *size)
 {
     // Open file. EditorOpenFile does not create files and fails on file-not-found
-    HANDLE file = CreateFileA(filepath, GENERIC_READ, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    HANDLE file = CreateFileA(filepath, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
     if (file == INVALID_HANDLE_VALUE)
     {
         Error("failed to load file");
         return NULL;
     }
 
-    // Get file size and read file contents into string buffer
-    DWORD bufSize = GetFileSize(file, NULL) + 1;
+    // Get file size and read file contents into string buffer. Lines and
+    // buffers are indexed with int so larger files cannot be loaded.
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart >= INT_MAX)
+    {
+        Error("file too large");
+        CloseHandle(file);
+        *size = -1;
+        return NULL;
+    }
+
+    DWORD bufSize = fileSize.QuadPart + 1;
     DWORD read;
     char *buffer = MemAlloc(bufSize);
     if (!ReadFile(file, buffer, bufSize, &read, NULL))
@@ -272,20 +412,17 @@ void PromptCommand(char *command)
     // Todo: rewrite prompt command system
 
     SetStatus(NULL, NULL);
-
-    AssertNotNull(command); // Debug
+    SetStatusInfo(NULL);
 
     // Append initial command to text
+    char prompt[64] = ":";
     if (command != NULL)
     {
-        // This is supposed to set the prompt to the given command name
+        strcat(prompt, command);
+        strcat(prompt, " ");
     }
 
-    char prompt[64] = ":";
-    strcat(prompt, command);
-    strcat(prompt, " ");
-
-    UiResult res = UiGetTextInput(prompt, 64);
+    UiResult res = UiGetTextInput(prompt, 256);
     char bufWithPrompt[res.length + 64];
 
     if (res.status != UI_OK)
@@ -295,6 +432,23 @@ void PromptCommand(char *command)
     strcpy(bufWithPrompt, prompt);
     strncat(bufWithPrompt, res.buffer, res.length);
     Logf("prompt: %s", bufWithPrompt);
+
+    // Pattern and replacement may contain spaces, so substitute and filter get the whole line
+    char *cmd = bufWithPrompt + 1;
+    if (!strncmp(cmd, "s/", 2) || !strncmp(cmd, "%s/", 3))
+    {
+        Substitute(cmd);
+        Render();
+        goto _return;
+    }
+
+    if (cmd[0] == '!' || !strncmp(cmd, "%!", 2))
+    {
+        FilterCommand(cmd);
+        Render();
+        goto _return;
+    }
+
     char *ptr = strtok(bufWithPrompt + 1, " ");
     char *args[16];
     int argc = 0;
@@ -317,21 +471,142 @@ void PromptCommand(char *command)
         {
             EditorOpenFile("");
         }
-        else if (argc > 2)
-            // Command error
-            SetStatus(NULL, "too many args. usage: open [filepath]");
-        else if (EditorOpenFile(args[1]) == RETURN_ERROR)
-            // Try to open file with given name
-            SetStatus(NULL, "file not found");
+        else if (argc > 2 || strpbrk(args[1], "*?") != NULL)
+        {
+            // Several files or a pattern are loaded in parallel
+            if (!LoaderOpen(args + 1, argc - 1))
+                SetStatus(NULL, "no matching files");
+        }
+        else
+            EditorOpenFile(args[1]);
+    }
+
+    else if (is_cmd("view"))
+    {
+        // Open file read-only. Large files are indexed for faster search. A
+        // file that is open already is shown as it is, so its changes can
+        // still be saved.
+        if (argc != 2)
+            SetStatus(NULL, "usage: view <filepath>");
+        else
+        {
+            bool open = EditorFindBuffer(args[1]) != NULL;
+            if (EditorOpenFile(args[1]) == RETURN_SUCCESS && !open)
+            {
+                curBuffer->readOnly = true;
+                TrigramStart(curBuffer);
+            }
+        }
     }
 
     else if (is_cmd("save"))
         EditorSaveFile();
 
     else if (is_cmd("theme") && argc > 1)
+        ConfigRequestTheme(args[1]);
+
+    else if (is_cmd("grep"))
     {
-        if (!LoadTheme(args[1], &colors))
-            SetStatus(NULL, "theme not found");
+        // Search files in directory, current if none is given
+        if (argc == 1)
+        {
+            if (!GrepShowResults())
+                SetStatus(NULL, "no search results");
+        }
+        else if (argc > 3)
+            SetStatus(NULL, "too many args. usage: grep <pattern> [dir]");
+        else
+            GrepStart(args[1], strlen(args[1]), argc == 3 ? args[2] : ".");
+    }
+
+    else if (is_cmd("noh"))
+        // Hide search highlights until next search
+        curBuffer->hlSearch = false;
+
+    else if (is_cmd("single"))
+        // Remove extra cursors
+        MultiClear();
+
+    else if (is_cmd("sort"))
+    {
+        // Sort selected lines, or the whole buffer. Flags may be given together
+        bool unique = false, numeric = false, reverse = false, valid = true;
+        for (int i = 1; i < argc; i++)
+        {
+            for (char *f = args[i]; *f; f++)
+            {
+                unique |= *f == 'u';
+                numeric |= *f == 'n';
+                reverse |= *f == 'r';
+                valid &= *f == 'u' || *f == 'n' || *f == 'r';
+            }
+        }
+
+        int startRow = 0, endRow = curBuffer->numLines - 1;
+        if (curBuffer->selectMode != SELECT_NONE)
+        {
+            Range r = SelectRange();
+            startRow = r.startRow;
+            endRow = r.endRow;
+        }
+
+        if (!valid)
+            SetStatus(NULL, "usage: sort [u][n][r]");
+        else
+        {
+            int removed = SortLines(startRow, endRow, unique, numeric, reverse);
+            char info[64], num[16];
+            StrFormatInt(num, removed);
+            sprintf(info, "sorted, %s removed", num);
+            SetStatusInfo(removed == -1 ? "sort canceled" : info);
+        }
+    }
+
+    else if (is_cmd("bn"))
+        EditorCycleBuffer(1);
+
+    else if (is_cmd("bp"))
+        EditorCycleBuffer(-1);
+
+    else if (is_cmd("b"))
+    {
+        // Switch buffer by number or name, list buffers if none is given
+        if (argc == 1)
+        {
+            char list[256];
+            EditorListBuffers(list, sizeof(list));
+            SetStatusInfo(list);
+        }
+        else if (argc > 2)
+            SetStatus(NULL, "too many args. usage: b [number|name]");
+        else if (!EditorSwitchBuffer(args[1]))
+            SetStatus(NULL, "no single buffer matches");
+    }
+
+    else if (is_cmd("bd"))
+        // Close current buffer
+        EditorCloseBuffer();
+
+    else if (is_cmd("split") || is_cmd("vsplit"))
+    {
+        // Show current buffer in a second view
+        if (!ViewSplit(is_cmd("vsplit")))
+            SetStatus(NULL, "no room for another view");
+    }
+
+    else if (is_cmd("close"))
+    {
+        if (!ViewClose())
+            SetStatus(NULL, "cannot close last view");
+    }
+
+    else if (is_cmd("move"))
+    {
+        // Move current line below given line, 0 is the top
+        if (argc != 2)
+            SetStatus(NULL, "usage: move <line>");
+        else if (!MoveLines(curRow, 1, atoi(args[1])))
+            SetStatus(NULL, "invalid line");
     }
 
     else
@@ -346,8 +621,26 @@ _return:
 
 void EditorSetMode(InputMode mode)
 {
-    if (mode == MODE_VIM)
+    if (mode == MODE_VIM && editor.mode == MODE_INSERT)
         CursorMove(curBuffer, -1, 0);
+    if (mode != MODE_INSERT && editor.blockInsert != NULL)
+    {
+        // Column edit is done, see HandleVisualMode. The group and cursors are
+        // in the buffer it started in, another one may be shown by now.
+        int active = editor.activeBuffer;
+        int index = EditorBufferIndex(editor.blockInsert);
+        if (index != -1)
+        {
+            editor.activeBuffer = index;
+            MultiClear();
+            UndoGroupEnd();
+            editor.activeBuffer = active;
+        }
+
+        editor.blockInsert = NULL;
+    }
+    if (mode != MODE_VISUAL)
+        curBuffer->selectMode = SELECT_NONE;
 
     editor.mode = mode;
 }
@@ -355,7 +648,19 @@ void EditorSetMode(InputMode mode)
 extern char HELP_TEXT[];
 void EditorShowHelp()
 {
+    for (int i = 0; i < editor.numBuffers; i++)
+    {
+        Buffer *b = editor.buffers[i];
+        if (!b->isFile && b->readOnly && !strcmp(b->filepath, "Help"))
+        {
+            EditorShowBuffer(i);
+            return;
+        }
+    }
+
+    // Not a file, so it is never unloaded and read from disk
     Buffer *b = BufferLoadFile("Help", HELP_TEXT, strlen(HELP_TEXT));
+    b->isFile = false;
     b->readOnly = true;
     EditorSetCurrentBuffer(b);
 }
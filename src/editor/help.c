@@ -6,9 +6,13 @@ char HELP_TEXT[] = "Global keybinds\n"
                    "    ctrl-c    Enter edit mode\n"
                    "    ctrl-o    Open file\n"
                    "    ctrl-z    Undo\n"
+                   "    ctrl-r    Redo\n"
                    "    ctrl-h    Help\n"
                    "    ctrl-n    New file\n"
                    "    ctrl-x    Delete line\n"
+                   "    ctrl-f    Find\n"
+                   "    ctrl-v    Select block (edit mode)\n"
+                   "    ctrl-w    Go to next view\n"
                    "\n"
                    "Edit mode (ctrl-c)\n"
                    "\n"
@@ -18,6 +22,9 @@ char HELP_TEXT[] = "Global keybinds\n"
                    "  k/K    Move up / Move up by chunks\n"
                    "    w    Move to next word beginning\n"
                    "    b    Move to previous word beginning\n"
+                   "  f/F    Move to next / previous character, ; and , repeat\n"
+                   "d/c/y    Delete / change / yank to where a motion goes, eg. dw, c3j\n"
+                   "dd/yy    Delete / yank line, cc clears it and enters insert mode\n"
                    "    i    Enter insert mode\n"
                    "    I    Goto beginning of line and enter insert mode\n"
                    "    a    Move cursor one space to the right and enter insert mode\n"
@@ -27,5 +34,54 @@ char HELP_TEXT[] = "Global keybinds\n"
                    "    x    Delete one character\n"
                    "    D    Delete line segment after cursor\n"
                    "    C    Delete line segment after cursor and enter insert mode\n"
-                   "    u    Undo\n"
+                   "  u/U    Undo / Redo\n"
+                   "g-/g+    Goto older / newer state, across undo branches\n"
+                   "    m    Add cursor and move down\n"
+                   "    M    Add cursor at every search match\n"
+                   "  v/V    Select characters / lines\n"
+                   "    Y    Yank line\n"
+                   "  p/P    Put after / before cursor\n"
+                   "   \"x    Use register x (a-z) for the next yank, delete or put\n"
+                   "   qx    Record keys into macro x (a-z), q again to stop\n"
+                   "   @x    Play macro x, @@ plays the last one again\n"
+                   "    :    Enter command\n"
+                   "    /    Search with regex\n"
+                   "  n/N    Goto next / previous search match\n"
+                   "\n"
+                   "Visual mode (v, V or ctrl-v)\n"
+                   "\n"
+                   "    y    Yank selection\n"
+                   "  d/x    Delete selection\n"
+                   "    c    Delete selection and enter insert mode\n"
+                   "    o    Goto other end of selection\n"
+                   "  I/A    Insert before / after block on every row\n"
+                   "    :    Command on selected lines, eg. sort or s/pat/rep/\n"
+                   "  ESC    Stop selecting\n"
+                   "\n"
+                   "Commands (ctrl-c then :)\n"
+                   "\n"
+                   "    open [file...]    Open files in new buffers, * and ? match many\n"
+                   "    view <file>       Open file read-only\n"
+                   "    save              Save file\n"
+                   "    bn / bp           Show next / previous buffer\n"
+                   "    b [num|name]      Show buffer by number or part of name, list buffers\n"
+                   "    bd                Close buffer\n"
+                   "    split / vsplit    Split view in two, stacked or side by side\n"
+                   "    close             Close view\n"
+                   "    theme <name>      Load theme\n"
+                   "    noh               Hide search highlights\n"
+                   "    single            Remove extra cursors\n"
+                   "    move <line>       Move current line below line, 0 is the top\n"
+                   "    sort [u][n][r]    Sort selection or file: unique, numeric, reverse\n"
+                   "    grep <pat> [dir]  Search files in dir with regex\n"
+                   "    grep              Show last search results\n"
+                   "    s/pat/rep/[g]     Replace regex on current line or selection, & is the match\n"
+                   "    %s/pat/rep/[g]    Replace regex in whole file\n"
+                   "    !cmd              Replace current line or selection with output of cmd\n"
+                   "    %!cmd             Replace whole file with output of cmd\n"
+                   "\n"
+                   "Edit mode commands and motions take a count, eg. 3w or 500dd.\n"
+                   "Press enter on a grep result to open it.\n"
+                   "With extra cursors, typing in insert mode applies to all of them.\n"
+                   "Block c, I and A skip rows ending before the block and are undone at once.\n"
                    "";
@@ -1,6 +1,37 @@
 #include "rum.h"
 
 extern Editor editor;
+extern Config config;
+
+static void onFindInput(char *text, int length)
+{
+    FindIncUpdate(text, length);
+    Render();
+}
+
+// Prompts for a regex and moves the cursor to the next match.
+static void promptRegex()
+{
+    UiResult res = UiGetTextInput("/", MAX_SEARCH);
+    if (res.status != UI_OK)
+        return;
+
+    Search *s = &curBuffer->search;
+    SearchFree(s);
+
+    MatchIndexClear(curBuffer);
+
+    if (!SearchCompileRegex(s, res.buffer, res.length))
+        SetStatus(NULL, "invalid regex");
+    else
+    {
+        curBuffer->hlSearch = true;
+        CursorPos pos = FindNextMatch();
+        CursorSetPos(curBuffer, pos.col, pos.row, false);
+    }
+
+    UiFreeResult(res);
+}
 
 // Returns true if a key action was triggered
 static bool handleCtrlInputs(InputInfo *info)
@@ -17,6 +48,7 @@ static bool handleCtrlInputs(InputInfo *info)
         break;
 
     case 'r':
+        Redo();
         break;
 
     case 'c':
@@ -24,6 +56,18 @@ static bool handleCtrlInputs(InputInfo *info)
         EditorSetMode(MODE_VIM);
         break;
 
+    case 'v':
+        // Block selection, switches kind if already selecting
+        if (editor.mode == MODE_INSERT)
+            return false;
+        if (editor.mode == MODE_VISUAL && curBuffer->selectMode == SELECT_BLOCK)
+            SelectEnd();
+        else if (editor.mode == MODE_VISUAL)
+            curBuffer->selectMode = SELECT_BLOCK;
+        else
+            SelectStart(SELECT_BLOCK);
+        break;
+
     case 'o':
         PromptCommand("open");
         break;
@@ -44,14 +88,19 @@ static bool handleCtrlInputs(InputInfo *info)
         TypingDeleteLine();
         break;
 
+    case 'w':
+        ViewFocusNext();
+        break;
+
     case 'f':
-        UiResult res = UiGetTextInput("Find: ", MAX_SEARCH);
-        strncpy(curBuffer->search, res.buffer, res.length);
-        curBuffer->searchLen = res.length;
-        CursorPos pos = FindNext(res.buffer, res.length);
-        CursorSetPos(curBuffer, pos.col, pos.row, false);
+    {
+        // Search as the user types
+        FindIncStart();
+        UiResult res = UiGetTextInputEx("Find: ", MAX_SEARCH, onFindInput);
+        FindIncEnd(res.status != UI_OK);
         UiFreeResult(res);
         break;
+    }
 
     default:
         return false;
@@ -60,11 +109,61 @@ static bool handleCtrlInputs(InputInfo *info)
     return true;
 }
 
+// Applies the key to all cursors if there are extra cursors. Returns false if
+// the key is not batched and should only apply to the main cursor.
+static bool handleMultiInput(InputInfo *info)
+{
+    switch (info->keyCode)
+    {
+    case K_BACKSPACE:
+        MultiBackspace();
+        break;
+
+    case K_DELETE:
+        MultiDelete();
+        break;
+
+    case K_TAB:
+        MultiWrite("        ", min(config.tabSize, 8));
+        break;
+
+    case K_ENTER:
+        MultiClear();
+        return false;
+
+    case K_ARROW_UP:
+        MultiMove(0, -1);
+        break;
+
+    case K_ARROW_DOWN:
+        MultiMove(0, 1);
+        break;
+
+    case K_ARROW_LEFT:
+        MultiMove(-1, 0);
+        break;
+
+    case K_ARROW_RIGHT:
+        MultiMove(1, 0);
+        break;
+
+    default:
+        if (!isChar(info->asciiChar))
+            return false;
+        MultiWrite(&info->asciiChar, 1);
+    }
+
+    return true;
+}
+
 Status HandleInsertMode(InputInfo *info)
 {
     if (info->ctrlDown && handleCtrlInputs(info))
         return RETURN_SUCCESS;
 
+    if (curBuffer->numCursors > 0 && handleMultiInput(info))
+        return RETURN_SUCCESS;
+
     switch (info->keyCode)
     {
     case K_ESCAPE:
@@ -87,7 +186,8 @@ Status HandleInsertMode(InputInfo *info)
         break;
 
     case K_ENTER:
-        TypingNewline();
+        if (!GrepOpenResult())
+            TypingNewline();
         break;
 
     case K_TAB:
@@ -117,19 +217,270 @@ Status HandleInsertMode(InputInfo *info)
     return RETURN_SUCCESS;
 }
 
+// Last character searched for with f/F and its direction, 1 or -1
+static char findChar = 0;
+static int findDir = 1;
+
+// Moves the cursor for motion keys shared by edit and visual mode. Returns
+// false if c is not a motion.
+static bool handleMotion(char c)
+{
+    switch (c)
+    {
+    case 'j':
+        CursorMove(curBuffer, 0, 1);
+        break;
+
+    case 'J':
+        CursorSetPos(curBuffer, curCol, FindNextBlankLine(), false);
+        break;
+
+    case 'k':
+        CursorMove(curBuffer, 0, -1);
+        break;
+
+    case 'K':
+        CursorSetPos(curBuffer, curCol, FindPrevBlankLine(), false);
+        break;
+
+    case 'h':
+        CursorMove(curBuffer, -1, 0);
+        break;
+
+    case 'H':
+        CursorSetPos(curBuffer, FindLineBegin(), curRow, false);
+        break;
+
+    case 'L':
+        CursorSetPos(curBuffer, FindLineEnd(), curRow, false);
+        break;
+
+    case 'l':
+        CursorMove(curBuffer, 1, 0);
+        break;
+
+    case 'w':
+        CursorSetPos(curBuffer, FindNextWordBegin(), curRow, false);
+        break;
+
+    case 'b':
+        CursorSetPos(curBuffer, FindPrevWordBegin(), curRow, false);
+        break;
+
+    case ';':
+        if (findChar != 0)
+            CursorSetPos(curBuffer, FindNextChar(findChar, findDir == -1), curRow, false);
+        break;
+
+    case ',':
+        if (findChar != 0)
+            CursorSetPos(curBuffer, FindNextChar(findChar, findDir == 1), curRow, false);
+        break;
+
+    case 'n':
+        if (curBuffer->search.length != 0)
+        {
+            CursorPos pos = FindNextMatch();
+            CursorSetPos(curBuffer, pos.col, pos.row, false);
+            curBuffer->hlSearch = true;
+        }
+        break;
+
+    case 'N':
+        if (curBuffer->search.length != 0)
+        {
+            CursorPos pos = FindPrevMatch();
+            CursorSetPos(curBuffer, pos.col, pos.row, false);
+            curBuffer->hlSearch = true;
+        }
+        break;
+
+    default:
+        return false;
+    }
+
+    return true;
+}
+
+// Moves the cursor by motion c repeated n times. Vertical and horizontal steps
+// are one move. Returns false if c is not a motion.
+static bool moveCursor(char c, int n)
+{
+    switch (c)
+    {
+    case 'j':
+    case 'k':
+        CursorMove(curBuffer, 0, c == 'j' ? n : -n);
+        return true;
+
+    case 'h':
+    case 'l':
+        CursorMove(curBuffer, c == 'l' ? n : -n, 0);
+        return true;
+
+    default:
+        for (int i = 0; i < n; i++)
+            if (!handleMotion(c))
+                return false;
+        return true;
+    }
+}
+
+// Where a motion goes and how much text it covers for an operator.
+typedef struct Motion
+{
+    CursorPos to;
+    bool linewise;  // All lines from the cursor row to the target row
+    bool inclusive; // The character at the target is included
+} Motion;
+
+// Finds where motion c repeated n times goes without moving the cursor.
+// Returns false if c is not a motion.
+static bool findMotion(char c, int n, Motion *m)
+{
+    Buffer *b = curBuffer;
+    Cursor saved = b->cursor;
+
+    if (!moveCursor(c, n))
+    {
+        b->cursor = saved;
+        return false;
+    }
+
+    *m = (Motion){
+        .to = {curRow, curCol},
+        .linewise = strchr("jkJK", c) != NULL,
+        .inclusive = strchr("L;,", c) != NULL,
+    };
+
+    // A word motion at the last word goes to the end of the line
+    if (c == 'w' && m->to.row == saved.row && m->to.col == saved.col)
+        m->to.col = b->lines[saved.row].length;
+
+    b->cursor = saved;
+    return true;
+}
+
+// Returns the range between the cursor and the target of m.
+static Range motionRange(Motion m)
+{
+    CursorPos from = {curRow, curCol};
+    CursorPos to = m.to;
+
+    if (to.row < from.row || (to.row == from.row && to.col < from.col))
+    {
+        CursorPos tmp = from;
+        from = to;
+        to = tmp;
+        m.inclusive = false; // Backwards motions never include the cursor
+    }
+
+    return (Range){
+        .mode = m.linewise ? SELECT_LINE : SELECT_CHAR,
+        .startRow = from.row,
+        .startCol = from.col,
+        .endRow = to.row,
+        .endCol = min(to.col + m.inclusive, curBuffer->lines[to.row].length),
+    };
+}
+
+// Register for the next yank, delete or put, set with "x
+static char regName = '"';
+static bool readingReg = false;
+
+// Reads the register name after ". Returns true if the key was used.
+static bool handleRegister(InputInfo *info)
+{
+    if (readingReg)
+    {
+        readingReg = false;
+        if (isChar(info->asciiChar))
+            regName = info->asciiChar;
+        return true;
+    }
+
+    if (info->asciiChar == '"')
+    {
+        readingReg = true;
+        return true;
+    }
+
+    return false;
+}
+
+// Returns the register to use and resets it to the unnamed one.
+static char takeRegister()
+{
+    char name = regName;
+    regName = '"';
+    return name;
+}
+
+#define MAX_COUNT 1000000 // Largest count prefix
+
+// Count typed before a command, 0 if none
+static int count = 0;
+
+// Returns the typed count, 1 if none, and resets it.
+static int takeCount()
+{
+    int n = max(count, 1);
+    count = 0;
+    return n;
+}
+
+// Returns the operator count times the typed count, at most MAX_COUNT.
+static int takeOpCount(int opCount)
+{
+    return min((int64_t)opCount * takeCount(), MAX_COUNT);
+}
+
+// Runs operator d, c or y once over the range.
+static void applyOperator(char op, Range r)
+{
+    char name = takeRegister();
+    if (r.mode == SELECT_CHAR && r.startRow == r.endRow && r.startCol == r.endCol)
+        return;
+
+    switch (op)
+    {
+    case 'd':
+        DeleteRange(name, r);
+        break;
+
+    case 'c':
+        ChangeRange(name, r);
+        EditorSetMode(MODE_INSERT);
+        break;
+
+    case 'y':
+        Yank(name, r);
+        CursorSetPos(curBuffer, r.mode == SELECT_LINE ? curCol : r.startCol, r.startRow, false);
+        break;
+
+    default:
+        break;
+    }
+}
+
 typedef enum Sate
 {
     S_NONE,
     S_FIND,
-    S_DELETE,
-    S_DELETE_INSERT,
+    S_OPERATOR,
+    S_GOTO,
+    S_RECORD,
+    S_PLAY,
 } State;
 
+// Commands are [count] key, or [count] operator [count] motion where the
+// operator runs once over the range the motion covers. Doubling the operator,
+// as in dd, covers count lines.
 Status HandleVimMode(InputInfo *info)
 {
     static State state = S_NONE;
-    static char char2 = 0;
-    static int findDir = 1; // 1 or -1
+    static char operator = 0; // Operator waiting for a motion
+    static int opCount = 1;   // Count typed before the operator
 
     if (info->ctrlDown && handleCtrlInputs(info))
         return RETURN_SUCCESS;
@@ -138,71 +489,104 @@ Status HandleVimMode(InputInfo *info)
     {
     case K_ESCAPE:
         return RETURN_ERROR; // Exit
+    case K_ENTER:
+        if (GrepOpenResult())
+            return RETURN_SUCCESS;
+        break;
     default:
         break;
     }
 
+    if (state == S_NONE && handleRegister(info))
+        return RETURN_SUCCESS;
+
+    char c = info->asciiChar;
+    if ((state == S_NONE || state == S_OPERATOR) && isdigit(c) && (c != '0' || count > 0))
+    {
+        count = min(count * 10 + c - '0', MAX_COUNT);
+        return RETURN_SUCCESS;
+    }
+
     if (state != S_NONE)
     {
         switch (state)
         {
         case S_FIND:
         {
-            if (!isChar(info->asciiChar))
-                break;
-            char2 = info->asciiChar;
-            CursorSetPos(curBuffer, FindNextChar(char2, findDir == -1), curRow, false);
             state = S_NONE;
-            break;
-        }
-
-        case S_DELETE:
-        {
-            char c = info->asciiChar;
-            if (c == 'd')
-                TypingDeleteLine();
-            else if (c == 'w')
+            if (!isChar(c))
             {
-                int count = FindNextWordBegin() - curCol;
-                if (count == 0)
-                    count = curLine.length - curCol;
-                TypingDeleteMany(count);
+                operator = 0;
+                break;
             }
-            else if (c == 'b')
+
+            findChar = c;
+            if (operator == 0)
             {
-                int count = curCol - FindPrevWordBegin();
-                if (count == 0)
-                    count = curCol;
-                TypingBackspaceMany(count);
+                moveCursor(';', takeCount());
+                break;
             }
-            state = S_NONE;
+
+            Motion m;
+            findMotion(';', takeOpCount(opCount), &m);
+            applyOperator(operator, motionRange(m));
+            operator = 0;
             break;
         }
 
-        case S_DELETE_INSERT:
+        case S_OPERATOR:
         {
-            char c = info->asciiChar;
-            if (c == 'c')
-                TypingClearLine();
-            else if (c == 'w')
+            state = S_NONE;
+            int n = takeOpCount(opCount);
+
+            if (c == 'f' || c == 'F')
             {
-                int count = FindNextWordBegin() - curCol;
-                if (count == 0)
-                    count = curLine.length - curCol;
-                TypingDeleteMany(count);
+                // Motion is finished by the next key
+                findDir = c == 'f' ? 1 : -1;
+                count = n;
+                opCount = 1;
+                state = S_FIND;
+                return RETURN_SUCCESS;
             }
-            else if (c == 'b')
+
+            Motion m;
+            if (c == operator)
+            {
+                // Doubled operator covers n lines
+                int row = min(curRow + n - 1, curBuffer->numLines - 1);
+                m = (Motion){.to = {row, curCol}, .linewise = true};
+            }
+            else if (!findMotion(c, n, &m))
             {
-                int count = curCol - FindPrevWordBegin();
-                if (count == 0)
-                    count = curCol;
-                TypingBackspaceMany(count);
+                operator = 0;
+                break;
             }
+
+            applyOperator(operator, motionRange(m));
+            operator = 0;
+            break;
+        }
+
+        case S_GOTO:
+        {
+            if (c == '-')
+                UndoOlder();
+            else if (c == '+')
+                UndoNewer();
             state = S_NONE;
-            EditorSetMode(MODE_INSERT);
             break;
         }
 
+        case S_RECORD:
+            MacroRecordStart(c);
+            state = S_NONE;
+            break;
+
+        case S_PLAY:
+            state = S_NONE;
+            MacroPlay(c, takeCount());
+            break;
+
         default:
             Panic("Unhandled input state");
             break;
@@ -211,71 +595,51 @@ Status HandleVimMode(InputInfo *info)
         return RETURN_SUCCESS;
     }
 
-    switch (info->asciiChar)
+    switch (c)
     {
     case 'u':
-        Undo();
-        break;
-
-    case 'f':
-        state = S_FIND,
-        findDir = 1;
-        break;
-
-    case 'F':
-        state = S_FIND,
-        findDir = -1;
-        break;
-
-    case ';':
-        if (char2 != 0)
-            CursorSetPos(curBuffer, FindNextChar(char2, findDir == -1), curRow, false);
-        break;
-
-    case ',':
-        if (char2 != 0)
-            CursorSetPos(curBuffer, FindNextChar(char2, findDir == 1), curRow, false);
-        break;
-
-    case 'j':
-        CursorMove(curBuffer, 0, 1);
-        break;
-
-    case 'J':
-        CursorSetPos(curBuffer, curCol, FindNextBlankLine(), false);
+        for (int n = takeCount(); n > 0; n--)
+            Undo();
         break;
 
-    case 'k':
-        CursorMove(curBuffer, 0, -1);
+    case 'U':
+        for (int n = takeCount(); n > 0; n--)
+            Redo();
         break;
 
-    case 'K':
-        CursorSetPos(curBuffer, curCol, FindPrevBlankLine(), false);
-        break;
-
-    case 'h':
-        CursorMove(curBuffer, -1, 0);
+    case 'g':
+        state = S_GOTO;
         break;
 
-    case 'H':
-        CursorSetPos(curBuffer, FindLineBegin(), curRow, false);
+    case 'q':
+        if (MacroRecording())
+            MacroRecordStop();
+        else
+            state = S_RECORD;
         break;
 
-    case 'L':
-        CursorSetPos(curBuffer, FindLineEnd(), curRow, false);
+    case '@':
+        state = S_PLAY;
         break;
 
-    case 'l':
-        CursorMove(curBuffer, 1, 0);
+    case 'm':
+        MultiAddBelow();
         break;
 
-    case 'w':
-        CursorSetPos(curBuffer, FindNextWordBegin(), curRow, false);
+    case 'M':
+    {
+        char info[64], num[16];
+        StrFormatInt(num, MultiAddMatches());
+        sprintf(info, "%s cursors added", num);
+        SetStatusInfo(info);
         break;
+    }
 
-    case 'b':
-        CursorSetPos(curBuffer, FindPrevWordBegin(), curRow, false);
-        break;
+    case 'f':
+    case 'F':
+        state = S_FIND;
+        findDir = c == 'f' ? 1 : -1;
+        return RETURN_SUCCESS; // Count is used by the find
 
     case 'i':
         EditorSetMode(MODE_INSERT);
@@ -310,9 +674,13 @@ Status HandleVimMode(InputInfo *info)
         break;
 
     case 'x':
-        if (curCol < curLine.length)
-            TypingDelete();
+    {
+        int n = takeCount();
+        n = min(n, curLine.length - curCol);
+        if (n > 0)
+            TypingDeleteMany(n);
         break;
+    }
 
     case 's':
         if (curCol < curLine.length)
@@ -326,12 +694,12 @@ Status HandleVimMode(InputInfo *info)
         break;
 
     case 'd':
-        state = S_DELETE;
-        break;
-
     case 'c':
-        state = S_DELETE_INSERT;
-        break;
+    case 'y':
+        operator = c;
+        opCount = takeCount();
+        state = S_OPERATOR;
+        return RETURN_SUCCESS;
 
     case 'D':
         TypingDeleteMany(curLine.length - curCol);
@@ -342,14 +710,156 @@ Status HandleVimMode(InputInfo *info)
         EditorSetMode(MODE_INSERT);
         break;
 
-    case 'n':
-        if (curBuffer->searchLen != 0)
+    case ':':
+        PromptCommand(NULL);
+        break;
+
+    case '/':
+        promptRegex();
+        break;
+
+    case 'v':
+        SelectStart(SELECT_CHAR);
+        break;
+
+    case 'V':
+        SelectStart(SELECT_LINE);
+        break;
+
+    case 'Y':
+    {
+        int n = takeCount();
+        YankLines(takeRegister(), curRow, min(n, curBuffer->numLines - curRow));
+        break;
+    }
+
+    case 'p':
+        Put(takeRegister(), false);
+        break;
+
+    case 'P':
+        Put(takeRegister(), true);
+        break;
+
+    default:
+        moveCursor(c, takeCount());
+        break;
+    }
+
+    count = 0;
+    return RETURN_SUCCESS;
+}
+
+// Enters insert mode with a cursor at col on every row of the block, so typing
+// edits the whole column in one sweep per key. If change is set the block is
+// deleted first. The delete and typing are one undo step, the group is closed
+// when insert mode is left, see EditorSetMode.
+static void blockInsert(Range r, int col, bool change)
+{
+    SelectEnd();
+    UndoGroupBegin();
+
+    // Rows are picked first, a deleted block may leave rows ending at its column
+    MultiAddColumn(r, col);
+    if (change)
+    {
+        CursorPos main = {curRow, curCol};
+        DeleteRange(takeRegister(), r);
+        CursorSetPos(curBuffer, main.col, main.row, false);
+    }
+
+    editor.blockInsert = curBuffer;
+    EditorSetMode(MODE_INSERT);
+}
+
+Status HandleVisualMode(InputInfo *info)
+{
+    if (info->ctrlDown && handleCtrlInputs(info))
+        return RETURN_SUCCESS;
+
+    if (info->keyCode == K_ESCAPE)
+    {
+        SelectEnd();
+        return RETURN_SUCCESS;
+    }
+
+    if (handleRegister(info))
+        return RETURN_SUCCESS;
+
+    Buffer *b = curBuffer;
+    char c = info->asciiChar;
+
+    switch (c)
+    {
+    case 'v':
+    case 'V':
+    {
+        // Switch kind, or stop selecting if it is the same
+        SelectMode mode = c == 'v' ? SELECT_CHAR : SELECT_LINE;
+        if (b->selectMode == mode)
+            SelectEnd();
+        else
+            b->selectMode = mode;
+        break;
+    }
+
+    case ':':
+        // Commands apply to the selected lines
+        PromptCommand(NULL);
+        if (editor.mode == MODE_VISUAL)
+            SelectEnd();
+        break;
+
+    case 'o':
+    {
+        // Go to the other end of the selection
+        CursorPos start = b->selectStart;
+        b->selectStart = (CursorPos){curRow, curCol};
+        CursorSetPos(b, start.col, start.row, false);
+        break;
+    }
+
+    case 'y':
+    {
+        Range r = SelectRange();
+        Yank(takeRegister(), r);
+        CursorSetPos(b, r.mode == SELECT_LINE ? curCol : r.startCol, r.startRow, false);
+        SelectEnd();
+        break;
+    }
+
+    case 'd':
+    case 'x':
+        DeleteRange(takeRegister(), SelectRange());
+        SelectEnd();
+        break;
+
+    case 'c':
+    {
+        Range r = SelectRange();
+        if (r.mode == SELECT_BLOCK && !b->readOnly)
         {
-            CursorPos pos = FindNext(curBuffer->search, curBuffer->searchLen);
-            CursorSetPos(curBuffer, pos.col, pos.row, false);
+            blockInsert(r, r.startCol, true);
+            break;
         }
 
+        ChangeRange(takeRegister(), r);
+        SelectEnd();
+        EditorSetMode(MODE_INSERT);
+        break;
+    }
+
+    case 'I':
+    case 'A':
+        if (b->selectMode == SELECT_BLOCK && !b->readOnly)
+        {
+            Range r = SelectRange();
+            blockInsert(r, c == 'I' ? r.startCol : r.endCol, false);
+        }
+        break;
+
     default:
+        handleMotion(c);
         break;
     }
 
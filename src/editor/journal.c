@@ -0,0 +1,328 @@
+// Persistent undo journal. The undo tree of a file is appended to a journal in
+// the temp directory so the history survives restarts. Each finished undo state
+// is one entry, with its records copied as they are in the undo log, and all
+// entries finished since the last input are written with a single write. The
+// header holds a hash of the file content when it was last saved and the state
+// it was saved in. The journal is deleted if the file no longer matches.
+//
+// Opening a file only reads the header. The entries are mapped and copied into
+// the undo log the first time the history is used.
+
+#include "rum.h"
+
+extern Config config;
+
+#define JOURNAL_VERSION 1
+
+typedef struct JournalHeader
+{
+    char magic[8];
+    int version;
+    int savedNode; // State of the saved file, -1 if it was evicted
+    uint64_t contentHash;
+} JournalHeader;
+
+// Entry for one undo state, followed by length bytes of records.
+typedef struct JournalEntry
+{
+    int parent;
+    int length;
+} JournalEntry;
+
+struct UndoJournal
+{
+    char path[MAX_PATH];
+    HANDLE file;  // NULL until the first write
+    bool pending; // Entries on disk are not loaded yet
+    int end;      // Size of the valid part of the journal
+    JournalHeader header;
+};
+
+// Entries to write, kept between calls
+static char *writeBuf;
+static int writeCap;
+
+// Returns hash of file content, mixed 8 bytes at a time.
+static uint64_t hashContent(char *text, int length)
+{
+    uint64_t hash = 14695981039346656037ull;
+    int i = 0;
+
+    for (; i + 8 <= length; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, text + i, 8);
+        hash = (hash ^ word) * 1099511628211ull;
+        hash ^= hash >> 29;
+    }
+
+    for (; i < length; i++)
+        hash = (hash ^ (uint8_t)text[i]) * 1099511628211ull;
+
+    return hash ^ (uint64_t)length;
+}
+
+static UndoJournal *journalNew(Buffer *b, uint64_t hash)
+{
+    UndoJournal *j = MemZeroAlloc(sizeof(UndoJournal));
+    AssertNotNull(j);
+
+    if (!StrTempPath(j->path, b->filepath, ".undo"))
+    {
+        MemFree(j);
+        return NULL;
+    }
+
+    memcpy(j->header.magic, "RUMUNDO", 8);
+    j->header.version = JOURNAL_VERSION;
+    j->header.contentHash = hash;
+    return j;
+}
+
+// Opens the journal file for writing. Returns false on fail.
+static bool openFile(UndoJournal *j)
+{
+    if (j->file != NULL)
+        return true;
+
+    HANDLE file = CreateFileA(j->path, GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    j->file = file;
+    return true;
+}
+
+static bool writeAt(UndoJournal *j, int offset, void *src, int size)
+{
+    DWORD written;
+    SetFilePointer(j->file, offset, NULL, FILE_BEGIN);
+    return WriteFile(j->file, src, size, &written, NULL) && (int)written == size;
+}
+
+// Writes states from the first unwritten one up to, not including, end. The
+// whole journal is written again if the undo log was compacted.
+static void writeNodes(Buffer *b, int end)
+{
+    UndoLog *log = &b->undo;
+    UndoJournal *j = log->journal;
+    if (!openFile(j))
+        return;
+
+    int size = log->written == 0 ? sizeof(JournalHeader) : 0;
+    int first = max(log->written, 1);
+    for (int i = first; i < end; i++)
+        size += sizeof(JournalEntry) + log->nodes[i].length;
+
+    if (size > writeCap)
+    {
+        writeCap = max(writeCap * 2, size);
+        writeBuf = MemRealloc(writeBuf, writeCap);
+        AssertNotNull(writeBuf);
+    }
+
+    char *p = writeBuf;
+    if (log->written == 0)
+    {
+        // Start over, old entries refer to evicted states
+        j->header.savedNode = log->saved;
+        j->end = 0;
+        SetFilePointer(j->file, 0, NULL, FILE_BEGIN);
+        SetEndOfFile(j->file);
+        memcpy(p, &j->header, sizeof(JournalHeader));
+        p += sizeof(JournalHeader);
+    }
+
+    for (int i = first; i < end; i++)
+    {
+        UndoNode *n = &log->nodes[i];
+        JournalEntry e = {.parent = n->parent, .length = n->length};
+        memcpy(p, &e, sizeof(JournalEntry));
+        memcpy(p + sizeof(JournalEntry), log->data + n->offset, n->length);
+        p += sizeof(JournalEntry) + n->length;
+    }
+
+    if (!writeAt(j, j->end, writeBuf, size))
+    {
+        log->written = 0; // Try again from the start next time
+        return;
+    }
+
+    j->end += size;
+    log->written = max(end, 1);
+}
+
+// Sets up the journal for a file just read into b. The existing journal is
+// kept only if it was saved with the same content, it is loaded on first use.
+void JournalOpen(Buffer *b, char *text, int length)
+{
+    if (!config.undoJournal || !b->isFile)
+        return;
+
+    UndoJournal *j = journalNew(b, hashContent(text, length));
+    if (j == NULL)
+        return;
+
+    HANDLE file = CreateFileA(j->path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file != INVALID_HANDLE_VALUE)
+    {
+        JournalHeader header;
+        DWORD read;
+        bool ok = ReadFile(file, &header, sizeof(header), &read, NULL) && read == sizeof(header) &&
+                  !memcmp(header.magic, j->header.magic, 8) && header.version == JOURNAL_VERSION &&
+                  header.contentHash == j->header.contentHash && header.savedNode >= 0;
+        CloseHandle(file);
+
+        // A journal for other content no longer applies
+        if (ok)
+        {
+            j->header = header;
+            j->pending = true;
+        }
+        else
+            DeleteFileA(j->path);
+    }
+
+    b->undo.journal = j;
+}
+
+// Loads the journal entries into the undo log of b, which must only have the
+// root state. The current state is set to the one the file was saved in.
+void JournalLoad(Buffer *b)
+{
+    UndoLog *log = &b->undo;
+    UndoJournal *j = log->journal;
+    if (j == NULL || !j->pending)
+        return;
+
+    j->pending = false;
+
+    // The journal may be open for writing already if the buffer was saved
+    HANDLE file = CreateFileA(j->path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return;
+
+    LARGE_INTEGER size;
+    HANDLE mapping = NULL;
+    char *view = NULL;
+
+    if (GetFileSizeEx(file, &size) && size.QuadPart >= (LONGLONG)sizeof(JournalHeader) && size.QuadPart < INT_MAX)
+    {
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping != NULL)
+            view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    }
+
+    if (view != NULL)
+    {
+        // Stop at the first incomplete entry, eg. if the editor was killed
+        char *p = view + sizeof(JournalHeader);
+        char *end = view + size.QuadPart;
+
+        while (end - p >= (int)sizeof(JournalEntry))
+        {
+            JournalEntry e;
+            memcpy(&e, p, sizeof(JournalEntry));
+            char *records = p + sizeof(JournalEntry);
+
+            if (e.parent < 0 || e.parent >= log->numNodes || e.length < 0 || e.length > end - records)
+                break;
+            if (!UndoLoadNode(log, e.parent, records, e.length))
+                break;
+
+            p = records + e.length;
+        }
+
+        j->end = p - view;
+        UnmapViewOfFile(view);
+
+        // Entries after a torn write would be overwritten, write it all again
+        log->written = j->end == size.QuadPart ? log->numNodes : 0;
+    }
+
+    if (mapping != NULL)
+        CloseHandle(mapping);
+    CloseHandle(file);
+
+    if (view == NULL || j->header.savedNode >= log->numNodes)
+    {
+        // Unusable, start a new journal from the root state
+        log->nodes[0].redo = -1;
+        log->numNodes = 1;
+        log->length = 0;
+        log->written = 0;
+        return;
+    }
+
+    log->current = j->header.savedNode;
+    log->saved = log->current;
+}
+
+// Writes the finished states of b. The newest state is left until the next
+// edit since it may still be extended or joined.
+void JournalFlush(Buffer *b)
+{
+    UndoLog *log = &b->undo;
+    if (log->journal == NULL || log->journal->pending)
+        return;
+
+    int end = log->numNodes - 1;
+    if (end > 1 && end > log->written)
+        writeNodes(b, end);
+}
+
+// Writes all states of b and marks the current one as saved to the file with
+// the given content.
+void JournalSave(Buffer *b, char *text, int length)
+{
+    if (!config.undoJournal || b->readOnly)
+        return;
+
+    UndoLog *log = &b->undo;
+    uint64_t hash = hashContent(text, length);
+
+    if (log->journal == NULL)
+    {
+        // First save of a new file
+        log->journal = journalNew(b, hash);
+        if (log->journal == NULL)
+            return;
+    }
+
+    UndoJournal *j = log->journal;
+    j->header.contentHash = hash;
+
+    if (j->pending)
+    {
+        // No edits since open, only the content hash may have changed
+        if (openFile(j))
+            writeAt(j, 0, &j->header, sizeof(JournalHeader));
+        return;
+    }
+
+    log->saved = log->current;
+    j->header.savedNode = log->saved;
+
+    if (log->written == 0 || log->written < log->numNodes)
+        writeNodes(b, log->numNodes);
+    if (log->written != 0)
+        writeAt(j, 0, &j->header, sizeof(JournalHeader));
+}
+
+// Writes remaining states of b and frees the journal.
+void JournalClose(Buffer *b)
+{
+    UndoLog *log = &b->undo;
+    UndoJournal *j = log->journal;
+    if (j == NULL)
+        return;
+
+    if (!j->pending && log->numNodes > 1 && log->numNodes > log->written)
+        writeNodes(b, log->numNodes);
+
+    if (j->file != NULL)
+        CloseHandle(j->file);
+
+    MemFree(j);
+    log->journal = NULL;
+}
@@ -0,0 +1,287 @@
+// File loader. Files are read and split into lines on the worker pool, one task
+// per file, so opening many files uses every core. The first file is shown as
+// soon as it is loaded, the rest are added to the buffer list in order by the
+// input thread when it is woken. Large files are mapped instead of read, the
+// lines are copied out of the mapping so it is closed right away. Files that
+// are open already, or given twice, are never read again: every path to a file
+// shares its one buffer.
+
+#include "rum.h"
+
+extern Editor editor;
+
+#define LOAD_MMAP_MIN (64 * 1024) // Smaller files are read instead of mapped
+
+typedef struct LoadFile
+{
+    char path[MAX_PATH];
+    FileId id;
+    Buffer *buffer;     // NULL if the file could not be read
+    bool tooLarge;      // Not loaded, lines are indexed with int
+    bool open;          // Open already, not loaded
+    bool duplicate;     // Same file as an earlier one, not loaded
+    volatile LONG done; // Set when the file is loaded, or was open already
+} LoadFile;
+
+typedef struct Loader
+{
+    PoolJob *job;
+    LoadFile *files;
+    int count;
+    int cap;
+
+    HANDLE loaded; // Set when any file is finished
+    int next;            // Next file to add to the buffer list
+    int opened;          // Files added to the buffer list
+    bool shown;          // A file has been shown
+} Loader;
+
+static Loader *current;
+
+static void addPath(Loader *l, char *path)
+{
+    if (l->count == l->cap)
+    {
+        l->cap = max(l->cap * 2, 16);
+        l->files = MemRealloc(l->files, l->cap * sizeof(LoadFile));
+        AssertNotNull(l->files);
+    }
+
+    LoadFile *f = &l->files[l->count++];
+    *f = (LoadFile){0};
+    strncpy(f->path, path, MAX_PATH - 1);
+}
+
+// Adds the files matching pattern, which may have * and ? in its last part.
+// Patterns without wildcards are added as they are, so missing files are
+// reported.
+static void addPaths(Loader *l, char *pattern)
+{
+    if (strpbrk(pattern, "*?") == NULL)
+    {
+        addPath(l, pattern);
+        return;
+    }
+
+    WIN32_FIND_DATAA data;
+    HANDLE find = FindFirstFileA(pattern, &data);
+    if (find == INVALID_HANDLE_VALUE)
+        return;
+
+    // Found names are relative to the directory of the pattern
+    int dirLength = 0;
+    for (int i = 0; pattern[i] != 0; i++)
+        if (pattern[i] == '\\' || pattern[i] == '/')
+            dirLength = i + 1;
+
+    do
+    {
+        if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+            continue;
+
+        char path[MAX_PATH];
+        snprintf(path, MAX_PATH, "%.*s%s", dirLength, pattern, data.cFileName);
+        addPath(l, path);
+    } while (FindNextFileA(find, &data));
+
+    FindClose(find);
+}
+
+// Pool task, loads file index into a new buffer.
+static void loadFile(void *arg, int index, int worker)
+{
+    Loader *l = arg;
+    LoadFile *f = &l->files[index];
+    char *path = f->path;
+    if (f->done)
+        return;
+
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file != INVALID_HANDLE_VALUE)
+    {
+        LARGE_INTEGER fileSize;
+        f->tooLarge = !GetFileSizeEx(file, &fileSize) || fileSize.QuadPart >= INT_MAX;
+        DWORD size = f->tooLarge ? 0 : fileSize.QuadPart;
+        char *text = NULL;
+        HANDLE mapping = NULL;
+
+        if (size >= LOAD_MMAP_MIN)
+        {
+            mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+            if (mapping != NULL)
+                text = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        }
+        else if (!f->tooLarge)
+        {
+            DWORD read;
+            text = MemAlloc(size + 1);
+            AssertNotNull(text);
+            if (!ReadFile(file, text, size, &read, NULL))
+            {
+                MemFree(text);
+                text = NULL;
+            }
+            size = read;
+        }
+
+        if (text != NULL)
+        {
+            Buffer *b = BufferLoadFile(path, text, size);
+            JournalOpen(b, text, size);
+            f->buffer = b;
+        }
+
+        if (mapping != NULL)
+        {
+            if (text != NULL)
+                UnmapViewOfFile(text);
+            CloseHandle(mapping);
+        }
+        else
+            MemFree(text);
+
+        CloseHandle(file);
+    }
+
+    InterlockedExchange(&f->done, 1);
+    SetEvent(l->loaded);
+    EditorWake();
+}
+
+// Adds the files loaded so far to the buffer list, in order. The first one is
+// shown. Returns true if anything changed.
+static bool apply(Loader *l)
+{
+    bool changed = false;
+    for (; l->next < l->count && l->files[l->next].done; l->next++)
+    {
+        changed = true;
+        LoadFile *f = &l->files[l->next];
+        Buffer *b = f->buffer;
+        if (f->duplicate)
+            continue;
+
+        if (f->open)
+        {
+            // Looked up again since it may have been closed while waiting.
+            // Shown if it is first.
+            b = EditorFindBuffer(f->path);
+            if (b != NULL && !l->shown)
+                EditorSetCurrentBuffer(b);
+            l->shown = l->shown || b != NULL;
+            continue;
+        }
+
+        if (b == NULL)
+        {
+            char msg[MAX_PATH + 32];
+            snprintf(msg, sizeof(msg), "%s: %s", f->tooLarge ? "file too large" : "file not found", f->path);
+            SetStatus(NULL, msg);
+            continue;
+        }
+
+        // Opened while loading
+        if (EditorFindBuffer(b->filepath) != NULL)
+        {
+            BufferFree(b);
+            continue;
+        }
+
+        LoadSyntax(b, b->filepath);
+        if (l->shown)
+            EditorAddBuffer(b);
+        else
+            EditorSetCurrentBuffer(b);
+
+        l->shown = true;
+        l->opened++;
+    }
+
+    return changed;
+}
+
+// Frees l if every file has been added. Returns true if it was freed.
+static bool finish(Loader *l)
+{
+    if (l->next < l->count)
+        return false;
+
+    if (l->opened > 1)
+    {
+        char info[64];
+        sprintf(info, "%d files opened", l->opened);
+        SetStatusInfo(info);
+    }
+
+    if (current == l)
+        current = NULL;
+
+    PoolFinish(l->job);
+    CloseHandle(l->loaded);
+    MemFree(l->files);
+    MemFree(l);
+    return true;
+}
+
+// Opens the files matching the patterns, loading them in parallel. Waits for
+// the first file and shows it, the rest are added in the background. Returns
+// false if no file could be opened.
+bool LoaderOpen(char **patterns, int count)
+{
+    // Files of an earlier load are added first to keep the order
+    while (current != NULL)
+    {
+        apply(current);
+        if (!finish(current))
+            WaitForSingleObject(current->loaded, INFINITE);
+    }
+
+    Loader *l = MemZeroAlloc(sizeof(Loader));
+    AssertNotNull(l);
+    for (int i = 0; i < count; i++)
+        addPaths(l, patterns[i]);
+
+    if (l->count == 0)
+    {
+        MemFree(l);
+        return false;
+    }
+
+    // Open files are taken as they are and files given twice are skipped
+    for (int i = 0; i < l->count; i++)
+    {
+        LoadFile *f = &l->files[i];
+        f->open = EditorFindBuffer(f->path) != NULL;
+        EditorFileId(f->path, &f->id);
+        for (int j = 0; j < i && !f->open && !f->duplicate; j++)
+            f->duplicate = EditorSameFile(&f->id, &l->files[j].id);
+
+        f->done = f->open || f->duplicate;
+    }
+
+    l->loaded = CreateEventA(NULL, FALSE, FALSE, NULL);
+    current = l;
+    l->job = PoolStart(loadFile, l, l->count);
+
+    apply(l);
+    while (!l->shown && l->next < l->count)
+    {
+        WaitForSingleObject(l->loaded, INFINITE);
+        apply(l);
+    }
+
+    bool shown = l->shown;
+    finish(l);
+    return shown;
+}
+
+// Adds files loaded since the last call to the buffer list. Must be called from
+// the input thread. Returns true if anything changed.
+bool LoaderApplyResults()
+{
+    if (current == NULL)
+        return false;
+
+    bool changed = apply(current);
+    return finish(current) || changed;
+}
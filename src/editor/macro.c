@@ -0,0 +1,151 @@
+// Macros. While recording, every key read from the console is appended to a
+// macro register a-z. Playing a macro feeds its keys back through
+// EditorReadInput, so prompts and commands in it work as when typed. Nothing is
+// drawn while playing and the journal is only written at the end, the screen
+// is rendered once by the input loop when the macro is done. All changes made
+// by one play are undone as one step.
+
+#include "rum.h"
+
+extern Editor editor;
+
+#define MACRO_CANCEL_KEYS 4096 // Keys played between checks for a key press
+
+static Macro macros[26];
+static int recording = -1; // Register being recorded, -1 if none
+static char lastPlayed = 0;
+
+// Macro being played
+static Macro *playing = NULL;
+static int playPos = 0;
+static int playCount = 0;
+static int played = 0; // Keys played in total
+
+// Returns the register index for name, -1 if it is not a letter.
+static int registerIndex(char name)
+{
+    if (name >= 'a' && name <= 'z')
+        return name - 'a';
+    if (name >= 'A' && name <= 'Z')
+        return name - 'A';
+    return -1;
+}
+
+// Starts recording key presses into macro register name. Upper case names
+// append to the register.
+void MacroRecordStart(char name)
+{
+    int i = registerIndex(name);
+    if (i == -1 || playing != NULL)
+        return;
+
+    if (name >= 'a')
+        macros[i].numKeys = 0;
+
+    recording = i;
+}
+
+void MacroRecordStop()
+{
+    if (recording == -1)
+        return;
+
+    // Drop the key that stopped the recording
+    Macro *m = &macros[recording];
+    if (m->numKeys > 0)
+        m->numKeys--;
+
+    recording = -1;
+}
+
+char MacroRecording()
+{
+    return recording == -1 ? 0 : 'a' + recording;
+}
+
+void MacroRecordInput(InputInfo *info)
+{
+    if (recording == -1 || info->eventType != INPUT_KEYDOWN)
+        return;
+
+    Macro *m = &macros[recording];
+    if (m->numKeys == m->cap)
+    {
+        m->cap = max(m->cap * 2, 64);
+        m->keys = MemRealloc(m->keys, m->cap * sizeof(InputInfo));
+        AssertNotNull(m->keys);
+    }
+
+    m->keys[m->numKeys++] = *info;
+}
+
+bool MacroNextInput(InputInfo *info)
+{
+    if (playing == NULL)
+        return false;
+
+    // A key press cancels long plays and is discarded
+    if (++played % MACRO_CANCEL_KEYS == 0 && EditorKeyPending())
+    {
+        EditorDiscardKeys();
+        playing = NULL;
+        info->eventType = INPUT_UNKNOWN;
+
+        // A prompt opened by the macro goes on with live keys, it must be seen
+        editor.replaying = false;
+        Render();
+        return true;
+    }
+
+    *info = playing->keys[playPos++];
+    if (playPos == playing->numKeys)
+    {
+        playPos = 0;
+        if (--playCount == 0)
+            playing = NULL;
+    }
+
+    return true;
+}
+
+void MacroPlay(char name, int count)
+{
+    if (name == '@')
+        name = lastPlayed;
+
+    // Macros calling macros are not supported
+    int i = registerIndex(name);
+    if (i == -1 || i == recording || playing != NULL || macros[i].numKeys == 0)
+        return;
+
+    lastPlayed = name;
+    playing = &macros[i];
+    playPos = 0;
+    playCount = max(count, 1);
+    played = 0;
+
+    Buffer *b = curBuffer;
+    editor.replaying = true;
+    UndoGroupBegin();
+
+    // Keys are read from the macro until it is done. A key press cancels it,
+    // checked every MACRO_CANCEL_KEYS keys.
+    while (playing != NULL)
+    {
+        if (!EditorHandleInput())
+            break;
+    }
+
+    playing = NULL;
+    editor.replaying = false;
+
+    // The group is in the buffer the macro started in, unless it was closed
+    int active = editor.activeBuffer;
+    int index = EditorBufferIndex(b);
+    if (index != -1)
+    {
+        editor.activeBuffer = index;
+        UndoGroupEnd();
+        editor.activeBuffer = active;
+    }
+}
@@ -1,6 +1,303 @@
+// Undo tree. Each buffer keeps a log of variable length records packed back to
+// back in one allocation, and an array of nodes indexing into it. A node is a
+// state of the buffer and its records are the actions that turn its parent
+// state into it. Undo and redo replay the records of one node backwards or
+// forwards, and jumping to another state replays the path through the closest
+// common ancestor.
+//
+// Nodes are appended in the order they are created, so a parent always has a
+// lower index than its children, and the records of a node are contiguous and
+// after those of its parent. When the log grows past the configured memory
+// budget the oldest states are dropped by moving the root towards the current
+// state. States written to the journal are never changed, see journal.c.
+
 #include "rum.h"
 
 extern Editor editor;
+extern Config config;
+
+#define align4(n) (((n) + 3) & ~3)
+#define recordAt(log, offset) ((UndoRecord *)((log)->data + (offset)))
+#define recordText(r) ((char *)(r) + sizeof(UndoRecord))
+#define recordSize(r) ((int)sizeof(UndoRecord) + align4((r)->textLen))
+
+// Returns the undo log of the current buffer, adding the root node if empty.
+static UndoLog *getLog()
+{
+    UndoLog *log = &curBuffer->undo;
+    if (log->numNodes == 0)
+    {
+        log->nodeCap = 64;
+        log->nodes = MemAlloc(log->nodeCap * sizeof(UndoNode));
+        AssertNotNull(log->nodes);
+        log->nodes[0] = (UndoNode){.parent = -1, .redo = -1, .last = -1};
+        log->numNodes = 1;
+        log->current = 0;
+        JournalLoad(curBuffer);
+    }
+
+    return log;
+}
+
+// Grows log to fit size more bytes.
+static void reserve(UndoLog *log, int size)
+{
+    if (log->length + size <= log->cap)
+        return;
+
+    log->cap = max(log->cap * 2, log->length + size + 4096);
+    log->data = MemRealloc(log->data, log->cap);
+    AssertNotNull(log->data);
+}
+
+// Drops all states that are not descendants of root, which becomes the new
+// root state.
+static void setRoot(UndoLog *log, int root)
+{
+    int *index = MemAlloc(log->numNodes * sizeof(int));
+    AssertNotNull(index);
+
+    UndoNode *nodes = log->nodes;
+    int depth = nodes[root].depth;
+    int numNodes = 0;
+    int length = 0;
+
+    // Parents come before children, so one pass finds all descendants
+    for (int i = 0; i < log->numNodes; i++)
+    {
+        UndoNode n = nodes[i];
+        bool keep = i == root || (i > root && n.parent != -1 && index[n.parent] != -1);
+        index[i] = keep ? numNodes : -1;
+        if (!keep)
+            continue;
+
+        if (i == root)
+        {
+            // The root state has no records
+            nodes[numNodes++] = (UndoNode){.parent = -1, .redo = n.redo, .last = -1};
+            continue;
+        }
+
+        // Records of kept nodes only move towards the start
+        memmove(log->data + length, log->data + n.offset, n.length);
+        n.last = n.last == -1 ? -1 : n.last - n.offset + length;
+        n.offset = length;
+        n.parent = index[n.parent];
+        n.depth -= depth;
+        length += n.length;
+        nodes[numNodes++] = n;
+    }
+
+    for (int i = 0; i < numNodes; i++)
+        if (nodes[i].redo != -1)
+            nodes[i].redo = index[nodes[i].redo];
+
+    log->current = index[log->current];
+    log->saved = log->saved == -1 ? -1 : index[log->saved];
+    log->groupNode = log->groupNode == -1 ? -1 : index[log->groupNode];
+    log->numNodes = numNodes;
+    log->length = length;
+    log->written = 0; // Indexes changed, journal is written again
+    MemFree(index);
+}
+
+// Drops the oldest states until the log is below three quarters of the budget.
+// The current state can always be undone, even if it alone is over budget.
+static void evict(UndoLog *log)
+{
+    int budget = config.undoMemory * 1024;
+    if (log->length <= budget)
+        return;
+
+    UndoNode *nodes = log->nodes;
+    int depth = nodes[log->current].depth;
+    if (depth == 0)
+    {
+        // Only redo states left, drop them all
+        nodes[0].redo = -1;
+        log->saved = log->saved == 0 ? 0 : -1;
+        log->groupNode = -1;
+        log->numNodes = 1;
+        log->length = 0;
+        log->written = 0;
+        return;
+    }
+
+    // Size of records in the subtree of each node
+    int *size = MemZeroAlloc(log->numNodes * sizeof(int));
+    int *path = MemAlloc((depth + 1) * sizeof(int));
+    AssertNotNull(size);
+    AssertNotNull(path);
+
+    for (int i = log->numNodes - 1; i > 0; i--)
+    {
+        size[i] += nodes[i].length;
+        size[nodes[i].parent] += size[i];
+    }
+
+    for (int i = log->current; i != -1; i = nodes[i].parent)
+        path[nodes[i].depth] = i;
+
+    // Move the root down the path to the current state until enough is dropped
+    int target = budget / 4 * 3;
+    int d = 0;
+    while (d < depth - 1 && size[path[d]] - nodes[path[d]].length > target)
+        d++;
+
+    if (d > 0)
+        setRoot(log, path[d]);
+
+    MemFree(size);
+    MemFree(path);
+}
+
+// Adds a child state of the current state and makes it current.
+static void pushNode(UndoLog *log)
+{
+    if (log->numNodes == log->nodeCap)
+    {
+        log->nodeCap *= 2;
+        log->nodes = MemRealloc(log->nodes, log->nodeCap * sizeof(UndoNode));
+        AssertNotNull(log->nodes);
+    }
+
+    UndoNode *parent = &log->nodes[log->current];
+    log->nodes[log->numNodes] = (UndoNode){
+        .parent = log->current,
+        .redo = -1,
+        .depth = parent->depth + 1,
+        .offset = log->length,
+        .last = -1,
+    };
+
+    parent->redo = log->numNodes;
+    log->current = log->numNodes++;
+}
+
+// Appends a record with a copy of text to the current state, which must be the
+// newest node.
+static void pushRecord(UndoLog *log, Action type, int row, int col, char *text, int textLen)
+{
+    int size = sizeof(UndoRecord) + align4(textLen);
+    reserve(log, size);
+
+    UndoNode *n = &log->nodes[log->current];
+    UndoRecord *r = recordAt(log, log->length);
+    *r = (UndoRecord){
+        .type = type,
+        .row = row,
+        .col = col,
+        .textLen = textLen,
+        .prevSize = n->last == -1 ? 0 : log->length - n->last,
+    };
+
+    memcpy(recordText(r), text, textLen);
+    n->last = log->length;
+    n->length += size;
+    log->length += size;
+}
+
+// Adds text to the end of the last record, which is at the end of the log.
+static void extendLast(UndoLog *log, char *text, int textLen)
+{
+    UndoNode *n = &log->nodes[log->current];
+    UndoRecord *r = recordAt(log, n->last);
+    int oldSize = recordSize(r);
+    int newSize = sizeof(UndoRecord) + align4(r->textLen + textLen);
+    reserve(log, newSize - oldSize);
+
+    r = recordAt(log, n->last);
+    memcpy(recordText(r) + r->textLen, text, textLen);
+    r->textLen += textLen;
+    n->length += newSize - oldSize;
+    log->length = n->last + newSize;
+}
+
+// Replaces the text of the last record, which is at the end of the log.
+static void replaceLast(UndoLog *log, char *text, int textLen)
+{
+    UndoNode *n = &log->nodes[log->current];
+    int oldSize = recordSize(recordAt(log, n->last));
+    int newSize = sizeof(UndoRecord) + align4(textLen);
+    reserve(log, max(newSize - oldSize, 0));
+
+    UndoRecord *r = recordAt(log, n->last);
+    memcpy(recordText(r), text, textLen);
+    r->textLen = textLen;
+    n->length += newSize - oldSize;
+    log->length = n->last + newSize;
+}
+
+// Reads the entry at p of an A_WRITE_MANY or A_DELETE_MANY record, packed as
+// row, col, length and text. Returns its text and moves p to the next entry.
+static char *nextEntry(char **p, int *row, int *col, int *length)
+{
+    memcpy(row, *p, sizeof(int));
+    memcpy(col, *p + sizeof(int), sizeof(int));
+    memcpy(length, *p + sizeof(int) * 2, sizeof(int));
+    char *text = *p + sizeof(int) * 3;
+    *p = text + *length;
+    return text;
+}
+
+// Merges a batch of writes into the last record if each write continues the
+// text of the matching entry, like typing a word at every cursor. Entries are
+// relative to the buffer after the ones before them, so merged entries move
+// right by the text added before them on the same row. Returns false if the
+// batches do not line up.
+static bool extendWriteMany(UndoLog *log, UndoRecord *last, char *text, int textLen)
+{
+    static char *merged;
+    static int mergedCap;
+
+    if (last->textLen + textLen > mergedCap)
+    {
+        mergedCap = max(mergedCap * 2, last->textLen + textLen);
+        merged = MemRealloc(merged, mergedCap);
+        AssertNotNull(merged);
+    }
+
+    char *p = recordText(last);
+    char *pEnd = p + last->textLen;
+    char *q = text;
+    char *qEnd = text + textLen;
+    char *out = merged;
+    int shiftRow = -1;
+    int shift = 0;
+
+    while (p < pEnd && q < qEnd)
+    {
+        int row, col, length, newRow, newCol, newLength;
+        char *oldText = nextEntry(&p, &row, &col, &length);
+        char *newText = nextEntry(&q, &newRow, &newCol, &newLength);
+
+        if (newRow != shiftRow)
+        {
+            shiftRow = newRow;
+            shift = 0;
+        }
+
+        if (newRow != row || newCol != col + length + shift)
+            return false;
+
+        int mergedCol = col + shift;
+        int mergedLength = length + newLength;
+        memcpy(out, &row, sizeof(int));
+        memcpy(out + sizeof(int), &mergedCol, sizeof(int));
+        memcpy(out + sizeof(int) * 2, &mergedLength, sizeof(int));
+        out += sizeof(int) * 3;
+        memcpy(out, oldText, length);
+        memcpy(out + length, newText, newLength);
+        out += mergedLength;
+        shift += newLength;
+    }
+
+    if (p != pEnd || q != qEnd)
+        return false;
+
+    replaceLast(log, merged, out - merged);
+    return true;
+}
 
 void UndoSaveAction(Action type, char *text, int textLen)
 {
@@ -9,69 +306,215 @@ void UndoSaveAction(Action type, char *text, int textLen)
 
 void UndoSaveActionEx(Action type, int row, int col, char *text, int textLen)
 {
-    if (len(curBuffer->undos) > 0 && type == A_WRITE && isalnum(text[0]))
+    UndoLog *log = getLog();
+    UndoNode *n = &log->nodes[log->current];
+
+    // Only the newest state can be appended to, if it is not in the journal
+    UndoRecord *last = NULL;
+    if (log->current == log->numNodes - 1 && log->current >= log->written && n->last != -1)
+        last = recordAt(log, n->last);
+
+    if (last != NULL && type == A_WRITE && isalnum(text[0]))
     {
         // If there is no word break just append to the last undo
-        EditorAction *last = &curBuffer->undos[len(curBuffer->undos) - 1];
         if (last->type == A_WRITE && row == last->row && col == last->col + last->textLen)
         {
-            strncat(last->text, text, textLen);
-            last->textLen += textLen;
+            extendLast(log, text, textLen);
+            evict(log);
             return;
         }
     }
 
-    if (len(curBuffer->undos) > 0 && type == A_BACKSPACE && isalnum(text[0]))
+    if (last != NULL && type == A_BACKSPACE && isalnum(text[0]))
     {
         // If there is no word break just append to the last undo
-        EditorAction *last = &curBuffer->undos[len(curBuffer->undos) - 1];
         if (last->type == A_BACKSPACE && row == last->row && col == last->col - 1)
         {
-            strncat(last->text, text, textLen);
-            last->textLen += textLen;
             last->col -= textLen;
+            extendLast(log, text, textLen);
+            evict(log);
             return;
         }
     }
 
-    EditorAction action = {
-        .type = type,
-        .col = col,
-        .row = row,
-        .textLen = textLen,
-    };
+    if (last != NULL && type == A_WRITE_MANY && isalnum(text[sizeof(int) * 3]))
+    {
+        // Same as above for typing at many cursors
+        if (last->type == A_WRITE_MANY && extendWriteMany(log, last, text, textLen))
+        {
+            evict(log);
+            return;
+        }
+    }
+
+    // An open group keeps adding to its node while it is the newest state
+    bool inGroup = log->groupDepth > 0 && log->groupNode == log->current && last != NULL;
+    if (!inGroup)
+        pushNode(log);
+    if (log->groupDepth > 0)
+        log->groupNode = log->current;
+
+    pushRecord(log, type, row, col, text, textLen);
+    evict(log);
+}
 
-    strncpy(action.text, text, textLen);
-    append(curBuffer->undos, &action);
+// Starts a group of actions that are undone as one, until the matching
+// UndoGroupEnd. Groups can be nested, the outermost one is kept.
+void UndoGroupBegin()
+{
+    UndoLog *log = getLog();
+    if (log->groupDepth++ == 0)
+        log->groupNode = -1;
+}
+
+void UndoGroupEnd()
+{
+    UndoLog *log = getLog();
+    if (log->groupDepth > 0)
+        log->groupDepth--;
 }
 
 // Joins last n actions under same undo call.
 void UndoJoin(int n)
 {
-    EditorAction a = {
-        .type = A_JOIN,
-        .numUndos = n,
-    };
+    UndoLog *log = getLog();
+    if (log->groupDepth > 0)
+        return; // Already in one state
+
+    for (int i = 1; i < n; i++)
+    {
+        // Only the two newest nodes can be merged, their records are adjacent
+        int child = log->current;
+        int parent = log->nodes[child].parent;
+        if (child != log->numNodes - 1 || parent != child - 1 || parent == 0 || parent < log->written)
+            break;
 
-    append(curBuffer->undos, &a);
+        UndoNode *c = &log->nodes[child];
+        UndoNode *p = &log->nodes[parent];
+        if (c->last != -1)
+        {
+            if (p->last != -1)
+                recordAt(log, c->offset)->prevSize = c->offset - p->last;
+            p->last = c->last;
+        }
+
+        p->length += c->length;
+        p->redo = -1;
+        log->current = parent;
+        log->numNodes--;
+    }
 }
 
-void Undo()
+// Adds a state with a copy of the given records as a child of parent. Used
+// when loading the journal. Returns false if the records are malformed.
+bool UndoLoadNode(UndoLog *log, int parent, char *records, int length)
 {
-    if (len(curBuffer->undos) == 0)
-        return;
+    // Records must exactly fill length
+    for (int offset = 0; offset < length;)
+    {
+        UndoRecord r;
+        if (length - offset < (int)sizeof(UndoRecord))
+            return false;
 
-    EditorAction *a = pop(curBuffer->undos);
+        memcpy(&r, records + offset, sizeof(UndoRecord));
+        if (r.type < A_CURSOR || r.type > A_SORT_LINES || r.textLen < 0 || r.textLen > length - offset)
+            return false;
+        if (recordSize(&r) > length - offset)
+            return false;
 
-    switch (a->type)
+        offset += recordSize(&r);
+    }
+
+    int current = log->current;
+    log->current = parent;
+    pushNode(log);
+    reserve(log, length);
+    memcpy(log->data + log->length, records, length);
+
+    // Link records of the node again, offsets differ from when saved
+    UndoNode *n = &log->nodes[log->current];
+    for (int offset = log->length; offset < log->length + length;)
     {
-    case A_JOIN:
+        UndoRecord *r = recordAt(log, offset);
+        r->prevSize = n->last == -1 ? 0 : offset - n->last;
+        n->last = offset;
+        offset += recordSize(r);
+    }
+
+    n->length = length;
+    log->length += length;
+    log->current = current;
+    return true;
+}
+
+// Returns the number of lines packed in text as length and text.
+static int countLines(char *text, int textLen)
+{
+    int count = 0;
+    for (char *p = text; p < text + textLen; count++)
     {
-        for (int i = 0; i < a->numUndos; i++)
-            Undo();
+        int length;
+        memcpy(&length, p, sizeof(int));
+        p += sizeof(int) + length;
+    }
+
+    return count;
+}
+
+// Inserts the lines packed in text as length and text at row, all at once.
+static void insertLines(int row, char *text, int textLen)
+{
+    int count = countLines(text, textLen);
+    Line *lines = MemAlloc(count * sizeof(Line));
+    AssertNotNull(lines);
+
+    char *p = text;
+    for (int i = 0; i < count; i++)
+    {
+        int length;
+        memcpy(&length, p, sizeof(int));
+        int l = LINE_DEFAULT_LENGTH;
+        int cap = (length / l) * l + l;
+
+        lines[i] = (Line){.chars = LineAlloc(cap), .cap = cap, .length = length};
+        memcpy(lines[i].chars, p + sizeof(int), length);
+        p += sizeof(int) + length;
     }
-    break;
 
+    BufferInsertLines(curBuffer, row, lines, count);
+    MemFree(lines);
+}
+
+// Reads the line count, kept line count and new order of a sort action. The
+// order must be freed. Returns a pointer to the removed lines packed after it.
+static char *readSort(char *text, int *count, int *newCount, int **order)
+{
+    memcpy(count, text, sizeof(int));
+    memcpy(newCount, text + sizeof(int), sizeof(int));
+    *order = MemAlloc(*count * sizeof(int));
+    AssertNotNull(*order);
+    memcpy(*order, text + 2 * sizeof(int), *newCount * sizeof(int));
+    return text + 2 * sizeof(int) + *newCount * sizeof(int);
+}
+
+// Reverses text of given length in place.
+static void reverse(char *text, int length)
+{
+    for (int i = 0; i < length / 2; i++)
+    {
+        char c = text[i];
+        text[i] = text[length - 1 - i];
+        text[length - 1 - i] = c;
+    }
+}
+
+// Reverts a single record.
+static void undoRecord(UndoRecord *a)
+{
+    char *text = recordText(a);
+
+    switch (a->type)
+    {
     case A_CURSOR:
     {
         CursorSetPos(curBuffer, a->col, a->row, false);
@@ -80,36 +523,39 @@ void Undo()
 
     case A_WRITE:
     {
-        int length = a->textLen;
-        BufferDeleteEx(curBuffer, a->row, a->col + length, length);
+        BufferDeleteEx(curBuffer, a->row, a->col + a->textLen, a->textLen);
         CursorSetPos(curBuffer, a->col, a->row, false);
     }
     break;
 
     case A_DELETE:
     {
-        BufferWriteEx(curBuffer, a->row, a->col, a->text, a->textLen);
+        BufferWriteEx(curBuffer, a->row, a->col, text, a->textLen);
         CursorSetPos(curBuffer, a->col, a->row, false);
     }
     break;
 
     case A_DELETE_BACK:
     {
-        BufferWriteEx(curBuffer, a->row, a->col, a->text, a->textLen);
+        BufferWriteEx(curBuffer, a->row, a->col, text, a->textLen);
         CursorSetPos(curBuffer, a->col + a->textLen, a->row, false);
     }
     break;
 
     case A_BACKSPACE:
     {
-        BufferWriteEx(curBuffer, a->row, a->col, strrev(a->text), a->textLen);
+        // Text was saved in the order it was deleted, last char first. It is
+        // reversed back after so the record can be replayed again.
+        reverse(text, a->textLen);
+        BufferWriteEx(curBuffer, a->row, a->col, text, a->textLen);
+        reverse(text, a->textLen);
         CursorSetPos(curBuffer, a->col + a->textLen, a->row, false);
     }
     break;
 
     case A_INSERT_LINE:
     {
-        BufferOverWriteEx(curBuffer, a->row - 1, 0, a->text, a->textLen);
+        BufferOverWriteEx(curBuffer, a->row - 1, 0, text, a->textLen);
         BufferDeleteLine(curBuffer, a->row);
         CursorSetPos(curBuffer, a->col, a->row - 1, false);
     }
@@ -117,12 +563,371 @@ void Undo()
 
     case A_DELETE_LINE:
     {
-        BufferInsertLineEx(curBuffer, a->row, a->text, a->textLen);
+        BufferInsertLineEx(curBuffer, a->row, text, a->textLen);
         CursorSetPos(curBuffer, a->col, a->row, false);
     }
     break;
 
+    case A_REPLACE:
+    {
+        // Lines packed as row, old length, old text, new length, new text
+        char *p = text;
+        char *end = text + a->textLen;
+        while (p < end)
+        {
+            int row, length, newLength;
+            memcpy(&row, p, sizeof(int));
+            memcpy(&length, p + sizeof(int), sizeof(int));
+            p += sizeof(int) * 2;
+            BufferReplaceLine(curBuffer, row, p, length);
+            p += length;
+            memcpy(&newLength, p, sizeof(int));
+            p += sizeof(int) + newLength;
+        }
+
+        CursorSetPos(curBuffer, a->col, a->row, false);
+    }
+    break;
+
+    case A_WRITE_MANY:
+    case A_DELETE_MANY:
+    {
+        // Each entry is relative to the buffer after the ones before it, so
+        // going forwards every reverted entry shifts later ones on its row
+        char *p = text;
+        int shiftRow = -1;
+        int shift = 0;
+        while (p < text + a->textLen)
+        {
+            int row, col, length;
+            char *t = nextEntry(&p, &row, &col, &length);
+            if (row != shiftRow)
+            {
+                shiftRow = row;
+                shift = 0;
+            }
+
+            if (a->type == A_WRITE_MANY)
+                BufferDeleteEx(curBuffer, row, col - shift + length, length);
+            else
+                BufferWriteEx(curBuffer, row, col + shift, t, length);
+            shift += length;
+        }
+
+        // Record position is the main cursor before the change
+        CursorSetPos(curBuffer, a->col, a->row, false);
+    }
+    break;
+
+    case A_INSERT_LINES:
+    {
+        BufferDeleteLines(curBuffer, a->row, countLines(text, a->textLen));
+        CursorSetPos(curBuffer, a->col, a->row, false);
+    }
+    break;
+
+    case A_DELETE_LINES:
+    {
+        insertLines(a->row, text, a->textLen);
+        CursorSetPos(curBuffer, a->col, a->row, false);
+    }
+    break;
+
+    case A_MOVE_LINES:
+    {
+        // Move the lines back from where they ended up
+        int count, dest;
+        memcpy(&count, text, sizeof(int));
+        memcpy(&dest, text + sizeof(int), sizeof(int));
+        int to = dest < a->row ? dest : dest - count;
+        BufferMoveLines(curBuffer, to, count, a->row < to ? a->row : a->row + count);
+        CursorSetPos(curBuffer, a->col, a->row, false);
+    }
+    break;
+
+    case A_SORT_LINES:
+    {
+        int count, newCount, *order;
+        char *p = readSort(text, &count, &newCount, &order);
+
+        // Removed lines go back after the kept ones, then every line is moved
+        // to where it was before the sort
+        int *inverse = MemAlloc(count * sizeof(int));
+        Line *removed = MemAlloc((count - newCount) * sizeof(Line) + 1);
+        AssertNotNull(inverse);
+        AssertNotNull(removed);
+
+        for (int i = 0; i < newCount; i++)
+            inverse[order[i]] = i;
+
+        for (int i = 0; i < count - newCount; i++)
+        {
+            int row, length;
+            memcpy(&row, p, sizeof(int));
+            memcpy(&length, p + sizeof(int), sizeof(int));
+            int l = LINE_DEFAULT_LENGTH;
+            int cap = (length / l) * l + l;
+
+            removed[i] = (Line){.chars = LineAlloc(cap), .cap = cap, .length = length};
+            memcpy(removed[i].chars, p + 2 * sizeof(int), length);
+            inverse[row] = newCount + i;
+            p += 2 * sizeof(int) + length;
+        }
+
+        BufferInsertLines(curBuffer, a->row + newCount, removed, count - newCount);
+        BufferPermuteLines(curBuffer, a->row, count, inverse, count);
+        CursorSetPos(curBuffer, a->col, a->row, false);
+
+        MemFree(removed);
+        MemFree(inverse);
+        MemFree(order);
+    }
+    break;
+
     default:
         Errorf("Undo not implemented for action: %d", a->type);
     }
 }
+
+// Applies a single record again.
+static void redoRecord(UndoRecord *a)
+{
+    char *text = recordText(a);
+
+    switch (a->type)
+    {
+    case A_CURSOR:
+    {
+        CursorSetPos(curBuffer, a->col, a->row, false);
+    }
+    break;
+
+    case A_WRITE:
+    {
+        BufferWriteEx(curBuffer, a->row, a->col, text, a->textLen);
+        CursorSetPos(curBuffer, a->col + a->textLen, a->row, false);
+    }
+    break;
+
+    case A_DELETE:
+    case A_DELETE_BACK:
+    case A_BACKSPACE:
+    {
+        BufferDeleteEx(curBuffer, a->row, a->col + a->textLen, a->textLen);
+        CursorSetPos(curBuffer, a->col, a->row, false);
+    }
+    break;
+
+    case A_INSERT_LINE:
+    {
+        // The new line gets the indent of the line above, as when typed
+        CursorSetPos(curBuffer, a->col, a->row - 1, false);
+        BufferInsertLine(curBuffer, a->row);
+        BufferMoveTextDownEx(curBuffer, a->row - 1, a->col);
+        CursorSetPos(curBuffer, 0, a->row, false);
+    }
+    break;
+
+    case A_DELETE_LINE:
+    {
+        BufferDeleteLine(curBuffer, a->row);
+        CursorSetPos(curBuffer, a->col, min(a->row, curBuffer->numLines - 1), false);
+    }
+    break;
+
+    case A_REPLACE:
+    {
+        char *p = text;
+        char *end = text + a->textLen;
+        while (p < end)
+        {
+            int row, length, newLength;
+            memcpy(&row, p, sizeof(int));
+            memcpy(&length, p + sizeof(int), sizeof(int));
+            p += sizeof(int) * 2 + length;
+            memcpy(&newLength, p, sizeof(int));
+            p += sizeof(int);
+            BufferReplaceLine(curBuffer, row, p, newLength);
+            p += newLength;
+        }
+
+        CursorSetPos(curBuffer, a->col, a->row, false);
+    }
+    break;
+
+    case A_WRITE_MANY:
+    case A_DELETE_MANY:
+    {
+        char *p = text;
+        int shiftRow = -1;
+        int shift = 0;
+        int cursorCol = a->col;
+        while (p < text + a->textLen)
+        {
+            int row, col, length;
+            char *t = nextEntry(&p, &row, &col, &length);
+            if (row != shiftRow)
+            {
+                shiftRow = row;
+                shift = 0;
+            }
+
+            // Column of the entry before the change, to find the main cursor
+            int before = a->type == A_WRITE_MANY ? col - shift : col + shift;
+
+            if (a->type == A_WRITE_MANY)
+            {
+                BufferWriteEx(curBuffer, row, col, t, length);
+                if (row == a->row && before == a->col)
+                    cursorCol = col + length;
+            }
+            else
+            {
+                BufferDeleteEx(curBuffer, row, col + length, length);
+                if (row == a->row && a->col >= before && a->col <= before + length)
+                    cursorCol = col;
+            }
+
+            shift += length;
+        }
+
+        CursorSetPos(curBuffer, cursorCol, a->row, false);
+    }
+    break;
+
+    case A_INSERT_LINES:
+    {
+        insertLines(a->row, text, a->textLen);
+        CursorSetPos(curBuffer, a->col, a->row, false);
+    }
+    break;
+
+    case A_DELETE_LINES:
+    {
+        BufferDeleteLines(curBuffer, a->row, countLines(text, a->textLen));
+        CursorSetPos(curBuffer, a->col, min(a->row, curBuffer->numLines - 1), false);
+    }
+    break;
+
+    case A_MOVE_LINES:
+    {
+        int count, dest;
+        memcpy(&count, text, sizeof(int));
+        memcpy(&dest, text + sizeof(int), sizeof(int));
+        BufferMoveLines(curBuffer, a->row, count, dest);
+        CursorSetPos(curBuffer, a->col, dest < a->row ? dest : dest - count, false);
+    }
+    break;
+
+    case A_SORT_LINES:
+    {
+        int count, newCount, *order;
+        readSort(text, &count, &newCount, &order);
+        BufferPermuteLines(curBuffer, a->row, count, order, newCount);
+        CursorSetPos(curBuffer, a->col, a->row, false);
+        MemFree(order);
+    }
+    break;
+
+    default:
+        Errorf("Redo not implemented for action: %d", a->type);
+    }
+}
+
+// Reverts the current state and moves to its parent.
+static void undoNode(UndoLog *log)
+{
+    UndoNode *n = &log->nodes[log->current];
+    for (int offset = n->last; offset != -1;)
+    {
+        UndoRecord *r = recordAt(log, offset);
+        undoRecord(r);
+        offset = r->prevSize == 0 ? -1 : offset - r->prevSize;
+    }
+
+    log->nodes[n->parent].redo = log->current;
+    log->current = n->parent;
+}
+
+// Moves to the redo child of the current state and applies it.
+static void redoNode(UndoLog *log)
+{
+    int child = log->nodes[log->current].redo;
+    UndoNode *n = &log->nodes[child];
+    for (int offset = n->offset; offset < n->offset + n->length;)
+    {
+        UndoRecord *r = recordAt(log, offset);
+        redoRecord(r);
+        offset += recordSize(r);
+    }
+
+    log->current = child;
+}
+
+// Moves the buffer to the target state, undoing up to the closest common
+// ancestor and redoing down from there.
+static void gotoNode(UndoLog *log, int target)
+{
+    UndoNode *nodes = log->nodes;
+
+    int a = log->current;
+    int b = target;
+    while (a != b)
+    {
+        if (nodes[a].depth >= nodes[b].depth)
+            a = nodes[a].parent;
+        else
+            b = nodes[b].parent;
+    }
+
+    while (log->current != a)
+        undoNode(log);
+
+    // Point redo along the path from the ancestor to target
+    for (b = target; b != a; b = nodes[b].parent)
+        nodes[nodes[b].parent].redo = b;
+
+    while (log->current != target)
+        redoNode(log);
+}
+
+// Undos last action if any.
+void Undo()
+{
+    UndoLog *log = getLog();
+    if (log->current != 0)
+        undoNode(log);
+}
+
+// Redos last undone action if any.
+void Redo()
+{
+    UndoLog *log = getLog();
+    if (log->nodes[log->current].redo != -1)
+        redoNode(log);
+}
+
+// Moves to the state made before the current one, which may be on another
+// branch of the undo tree.
+void UndoOlder()
+{
+    UndoLog *log = getLog();
+    if (log->current > 0)
+        gotoNode(log, log->current - 1);
+}
+
+// Moves to the state made after the current one, which may be on another
+// branch of the undo tree.
+void UndoNewer()
+{
+    UndoLog *log = getLog();
+    if (log->current < log->numNodes - 1)
+        gotoNode(log, log->current + 1);
+}
+
+void UndoFree(UndoLog *log)
+{
+    MemFree(log->data);
+    MemFree(log->nodes);
+    *log = (UndoLog){.journal = log->journal};
+}
@@ -0,0 +1,305 @@
+// Filter lines through an external command. The lines are written to the
+// command's stdin and its output is read by two separate threads, so neither
+// side blocks on a full pipe and the input thread only checks for cancel and
+// shows progress. The lines are written straight
+// from the buffer and the output is inserted as one block, then the old lines
+// are removed. The whole filter is undone as one step.
+
+#include "rum.h"
+
+extern Editor editor;
+
+#define FILTER_WRITE_BUFFER (64 * 1024) // Lines are batched into writes of this size
+#define FILTER_PIPE_BUFFER (1024 * 1024) // Suggested size of the pipe buffers
+#define FILTER_READ_SIZE (256 * 1024)    // Smallest free space for a read
+#define FILTER_PROGRESS_DELAY 30        // Milliseconds before progress is shown
+#define FILTER_PROGRESS_INTERVAL 50     // Milliseconds between progress updates
+
+typedef struct FilterInput
+{
+    HANDLE pipe;
+    Line *lines;
+    int count;
+} FilterInput;
+
+typedef struct FilterOutput
+{
+    HANDLE pipe;
+    char *text;
+    int cap;
+    volatile LONG length;
+    volatile LONG canceled;
+} FilterOutput;
+
+static bool writeAll(HANDLE pipe, char *text, int length)
+{
+    while (length > 0)
+    {
+        DWORD written;
+        if (!WriteFile(pipe, text, length, &written, NULL))
+            return false;
+
+        text += written;
+        length -= written;
+    }
+
+    return true;
+}
+
+// Writes the lines to the pipe, each followed by a newline, and closes it. Stops
+// early if the command closes its input.
+static DWORD WINAPI writeLines(LPVOID param)
+{
+    FilterInput *in = param;
+    char *buf = MemAlloc(FILTER_WRITE_BUFFER);
+    AssertNotNull(buf);
+    int length = 0;
+    bool ok = true;
+
+    for (int i = 0; ok && i < in->count; i++)
+    {
+        Line *line = &in->lines[i];
+        if (length + line->length + 1 > FILTER_WRITE_BUFFER)
+        {
+            ok = writeAll(in->pipe, buf, length);
+            length = 0;
+        }
+
+        // Long lines are written directly
+        if (line->length + 1 > FILTER_WRITE_BUFFER)
+            ok = ok && writeAll(in->pipe, line->chars, line->length);
+        else
+        {
+            memcpy(buf + length, line->chars, line->length);
+            length += line->length;
+        }
+
+        buf[length++] = '\n';
+    }
+
+    if (ok)
+        writeAll(in->pipe, buf, length);
+
+    CloseHandle(in->pipe);
+    MemFree(buf);
+    return 0;
+}
+
+// Reads the output of the command until every write end of the pipe is closed
+// or the filter is canceled.
+static DWORD WINAPI readOutput(LPVOID param)
+{
+    FilterOutput *out = param;
+    while (!out->canceled)
+    {
+        if (out->cap - out->length < FILTER_READ_SIZE)
+        {
+            out->cap = max(out->cap * 2, out->length + FILTER_READ_SIZE);
+            out->text = MemRealloc(out->text, out->cap);
+            AssertNotNull(out->text);
+        }
+
+        DWORD read;
+        if (!ReadFile(out->pipe, out->text + out->length, out->cap - out->length, &read, NULL) || read == 0)
+            break;
+
+        InterlockedExchangeAdd(&out->length, read);
+    }
+
+    return 0;
+}
+
+// Waits for the reader thread to finish, showing progress. A key press kills
+// the process. Returns false if canceled.
+static bool waitOutput(HANDLE reader, FilterOutput *out, HANDLE process)
+{
+    DWORD wait = FILTER_PROGRESS_DELAY;
+    while (WaitForSingleObject(reader, wait) == WAIT_TIMEOUT)
+    {
+        if (EditorKeyPending())
+        {
+            TerminateProcess(process, 1);
+            EditorDiscardKeys();
+
+            // Programs started by the command may keep the pipe open
+            InterlockedExchange(&out->canceled, 1);
+            do
+                CancelSynchronousIo(reader);
+            while (WaitForSingleObject(reader, 10) == WAIT_TIMEOUT);
+            return false;
+        }
+
+        char info[128], num[16];
+        StrFormatInt(num, out->length / 1024);
+        sprintf(info, "filtering, %s KB read (press any key to cancel)", num);
+        SetStatusInfo(info);
+        Render();
+        wait = FILTER_PROGRESS_INTERVAL;
+    }
+
+    return true;
+}
+
+// Runs command with rows startRow to endRow, inclusive, as input and replaces
+// them with its output as one undo step. The buffer is left unchanged if the
+// command fails. Returns false if the command could not be run or failed.
+bool Filter(int startRow, int endRow, char *command)
+{
+    Buffer *b = curBuffer;
+    if (b->readOnly)
+        return false;
+
+    SECURITY_ATTRIBUTES sa = {.nLength = sizeof(sa), .bInheritHandle = TRUE};
+    HANDLE inRead, inWrite, outRead, outWrite;
+    if (!CreatePipe(&inRead, &inWrite, &sa, FILTER_PIPE_BUFFER))
+        return false;
+
+    if (!CreatePipe(&outRead, &outWrite, &sa, FILTER_PIPE_BUFFER))
+    {
+        CloseHandle(inRead);
+        CloseHandle(inWrite);
+        return false;
+    }
+
+    // Only the ends used by the command are inherited
+    SetHandleInformation(inWrite, HANDLE_FLAG_INHERIT, 0);
+    SetHandleInformation(outRead, HANDLE_FLAG_INHERIT, 0);
+
+    STARTUPINFOA si = {
+        .cb = sizeof(si),
+        .dwFlags = STARTF_USESTDHANDLES,
+        .hStdInput = inRead,
+        .hStdOutput = outWrite,
+        .hStdError = outWrite,
+    };
+
+    PROCESS_INFORMATION pi;
+    char cmdline[MAX_PATH * 4];
+    snprintf(cmdline, sizeof(cmdline), "cmd.exe /c %s", command);
+    bool started = CreateProcessA(NULL, cmdline, NULL, NULL, TRUE, CREATE_NO_WINDOW, NULL, NULL, &si, &pi);
+
+    CloseHandle(inRead);
+    CloseHandle(outWrite);
+
+    HANDLE writer = NULL, reader = NULL;
+    FilterInput in = {inWrite, b->lines + startRow, endRow - startRow + 1};
+    FilterOutput output = {.pipe = outRead};
+    if (started)
+    {
+        CloseHandle(pi.hThread);
+        writer = CreateThread(NULL, 0, writeLines, &in, 0, NULL);
+        reader = CreateThread(NULL, 0, readOutput, &output, 0, NULL);
+        if (writer == NULL || reader == NULL)
+            TerminateProcess(pi.hProcess, 1);
+    }
+
+    if (writer == NULL || reader == NULL)
+    {
+        if (writer != NULL)
+        {
+            WaitForSingleObject(writer, INFINITE);
+            CloseHandle(writer);
+        }
+        else
+            CloseHandle(inWrite);
+
+        if (reader != NULL)
+        {
+            WaitForSingleObject(reader, INFINITE);
+            CloseHandle(reader);
+        }
+
+        CloseHandle(outRead);
+        MemFree(output.text);
+        if (started)
+            CloseHandle(pi.hProcess);
+        SetStatus(NULL, "failed to run command");
+        return false;
+    }
+
+    bool done = waitOutput(reader, &output, pi.hProcess);
+    CloseHandle(reader);
+    CloseHandle(outRead);
+
+    char *out = output.text;
+    int length = output.length;
+    if (!done)
+    {
+        // The writer may be stuck on a pipe kept open by another program
+        CancelSynchronousIo(writer);
+        MemFree(out);
+        out = NULL;
+    }
+
+    WaitForSingleObject(writer, INFINITE);
+    CloseHandle(writer);
+
+    DWORD exitCode = 1;
+    WaitForSingleObject(pi.hProcess, INFINITE);
+    GetExitCodeProcess(pi.hProcess, &exitCode);
+    CloseHandle(pi.hProcess);
+    SetStatusInfo(NULL);
+
+    if (out == NULL)
+    {
+        SetStatus(NULL, "filter canceled");
+        return false;
+    }
+
+    if (exitCode != 0)
+    {
+        // Show the first line of output, usually the error
+        char msg[128];
+        char *newline = memchr(out, '\n', length);
+        int msgLength = min(newline != NULL ? newline - out : length, 100);
+        if (msgLength > 0)
+            sprintf(msg, "command failed: %.*s", msgLength, out);
+        else
+            sprintf(msg, "command failed with exit code %lu", exitCode);
+        SetStatus(NULL, msg);
+        MemFree(out);
+        return false;
+    }
+
+    // The newline ending the last line does not start another
+    int textLength = length;
+    if (textLength > 0 && out[textLength - 1] == '\n')
+        textLength--;
+    if (textLength > 0 && out[textLength - 1] == '\r')
+        textLength--;
+
+    ReplaceLines(startRow, endRow - startRow + 1, length > 0 ? out : NULL, textLength);
+    MemFree(out);
+    return true;
+}
+
+// Runs a filter command: !cmd on the current line or selection, or %!cmd on the
+// whole buffer.
+void FilterCommand(char *command)
+{
+    bool wholeBuffer = command[0] == '%';
+    char *cmd = command + (wholeBuffer ? 2 : 1); // Skip ! or %!
+    if (*cmd == 0)
+    {
+        SetStatus(NULL, "usage: [%]!command");
+        return;
+    }
+
+    int startRow = wholeBuffer ? 0 : curRow;
+    int endRow = wholeBuffer ? curBuffer->numLines - 1 : curRow;
+    if (!wholeBuffer && curBuffer->selectMode != SELECT_NONE)
+    {
+        Range r = SelectRange();
+        startRow = r.startRow;
+        endRow = r.endRow;
+    }
+
+    int before = curBuffer->numLines;
+    if (Filter(startRow, endRow, cmd))
+    {
+        char info[64], num[16];
+        StrFormatInt(num, endRow - startRow + 1 + curBuffer->numLines - before);
+        sprintf(info, "%s lines", num);
+        SetStatusInfo(info);
+    }
+}
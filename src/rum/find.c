@@ -143,49 +143,332 @@ int FindPrevBlankLine()
     return 0;
 }
 
-// dir is 1 for down, -1 for up
-static CursorPos find(char *search, int length, int dir, int startRow)
+// Ranges with more rows than this are searched on the worker pool
+#define FIND_PARALLEL_ROWS 65536
+// Rows per pool task
+#define FIND_CHUNK_ROWS 8192
+// Rows searched between each check for a nearer match in another chunk
+#define FIND_CHECK_ROWS 1024
+
+typedef struct FindJob
 {
-    char firstc = search[0];
+    Search *searches; // Copy of the search for each worker
+    uint8_t *filter;  // Trigram filter, NULL if none
+    int row, col, endRow, dir;
+    int numChunks;
+    CursorPos *results;    // First match in each chunk, row -1 if none
+    volatile LONG nearest; // Lowest chunk index with a match
+} FindJob;
 
-    for (int row = startRow;
-         dir == 1 ? (row < curBuffer->numLines) : (row > 0);
-         dir == 1 ? row++ : row--)
+// Searches rows from row towards endRow (exclusive) in direction dir. Rows in
+// blocks rejected by filter are skipped. Stops early if job is not NULL and a
+// chunk before index has found a match.
+static CursorPos findRange(Search *s, uint8_t *filter, int row, int col, int endRow, int dir, FindJob *job, int index)
+{
+    for (int n = 0; row != endRow; row += dir, n++)
     {
-        Line line = curBuffer->lines[row];
-        for (int col = 0; col < line.length; col++)
-        {
-            char c = line.chars[col];
-            if (c != firstc || col > line.length - length)
-                continue;
+        if (job != NULL && n % FIND_CHECK_ROWS == 0 && job->nearest < index)
+            break;
 
-            bool found = true;
-            for (int i = 0; i < length; i++)
-            {
-                if (line.chars[col + i] != search[i])
-                    found = false;
-            }
+        if (filter == NULL || filter[row >> TRIGRAM_BLOCK_SHIFT])
+        {
+            Line *line = &curBuffer->lines[row];
+            int found = dir == 1
+                            ? SearchForward(s, line->chars, line->length, col, NULL)
+                            : SearchBackward(s, line->chars, line->length, col, NULL);
 
-            if (found)
-                return (CursorPos){.row = row, .col = col};
+            if (found != -1)
+                return (CursorPos){.row = row, .col = found};
         }
+
+        col = dir == 1 ? 0 : INT_MAX;
     }
 
-    return (CursorPos){.row = curRow, .col = curCol};
+    return (CursorPos){.row = -1};
+}
+
+static void findChunk(void *arg, int index, int worker)
+{
+    FindJob *job = arg;
+    job->results[index].row = -1;
+
+    // A nearer chunk already has a match
+    if (job->nearest < index)
+        return;
+
+    int start = job->row + index * FIND_CHUNK_ROWS * job->dir;
+    int end = index == job->numChunks - 1 ? job->endRow : start + FIND_CHUNK_ROWS * job->dir;
+    int col = index == 0 ? job->col : (job->dir == 1 ? 0 : INT_MAX);
+
+    CursorPos pos = findRange(&job->searches[worker], job->filter, start, col, end, job->dir, job, index);
+    job->results[index] = pos;
+    if (pos.row == -1)
+        return;
+
+    // Lower nearest to index
+    LONG nearest = job->nearest;
+    while (index < nearest)
+    {
+        LONG prev = InterlockedCompareExchange(&job->nearest, index, nearest);
+        if (prev == nearest)
+            break;
+        nearest = prev;
+    }
+}
+
+// Searches rows from row towards endRow (exclusive) in direction dir, which is 1
+// for down and -1 for up. The first row is searched from col, the rest from their
+// beginning or end. Large ranges are split into chunks searched in parallel,
+// chunks after the nearest match found so far are skipped. Returns row -1 if
+// there is no match, -2 if the search was canceled.
+static CursorPos find(Search *s, int row, int col, int endRow, int dir)
+{
+    int numRows = abs(endRow - row);
+    uint8_t *filter = TrigramFilter(curBuffer, s);
+    if (numRows <= FIND_PARALLEL_ROWS)
+        return findRange(s, filter, row, col, endRow, dir, NULL, 0);
+
+    int numWorkers = PoolSize();
+    FindJob job = {
+        .searches = MemAlloc(numWorkers * sizeof(Search)),
+        .filter = filter,
+        .row = row,
+        .col = col,
+        .endRow = endRow,
+        .dir = dir,
+        .numChunks = (numRows + FIND_CHUNK_ROWS - 1) / FIND_CHUNK_ROWS,
+        .nearest = INT_MAX,
+    };
+    job.results = MemAlloc(job.numChunks * sizeof(CursorPos));
+    AssertNotNull(job.searches);
+    AssertNotNull(job.results);
+
+    for (int i = 0; i < numWorkers; i++)
+        SearchClone(&job.searches[i], s);
+
+    PoolJob *pj = PoolStart(findChunk, &job, job.numChunks);
+    bool done = EditorWaitJob(pj, job.numChunks, "searching");
+    PoolFinish(pj);
+
+    CursorPos pos = {.row = done ? -1 : -2};
+    if (done && job.nearest != INT_MAX)
+        pos = job.results[job.nearest];
+
+    for (int i = 0; i < numWorkers; i++)
+        SearchFree(&job.searches[i]);
+    MemFree(job.searches);
+    MemFree(job.results);
+    return pos;
 }
 
-CursorPos FindNext(char *search, int length)
+CursorPos FindNext(Search *s)
 {
-    CursorPos pos = find(search, length, 1, curRow + 1);
-    if (pos.col == curCol && pos.row == curRow)
-        return find(search, length, 1, 0);
+    CursorPos pos = find(s, curRow, curCol + 1, curBuffer->numLines, 1);
+    if (pos.row == -1)
+        pos = find(s, 0, 0, curRow + 1, 1); // Wrap around
+    if (pos.row < 0)
+        return (CursorPos){.row = curRow, .col = curCol};
     return pos;
 }
 
-CursorPos FindPrev(char *search, int length)
+CursorPos FindPrev(Search *s)
 {
-    CursorPos pos = find(search, length, -1, curRow - 1);
-    if (pos.col == curCol && pos.row == curRow)
-        return find(search, length, -1, curBuffer->numLines - 1);
+    CursorPos pos = find(s, curRow, curCol - 1, -1, -1);
+    if (pos.row == -1)
+        pos = find(s, curBuffer->numLines - 1, INT_MAX, curRow - 1, -1); // Wrap around
+    if (pos.row < 0)
+        return (CursorPos){.row = curRow, .col = curCol};
     return pos;
-}
\ No newline at end of file
+}
+
+static CursorPos findMatch(bool backwards)
+{
+    int i = MatchIndexFind(curBuffer, curRow, curCol, backwards);
+    if (i == -1)
+        return (CursorPos){.row = curRow, .col = curCol};
+    return curBuffer->matches.matches[i];
+}
+
+CursorPos FindNextMatch()
+{
+    return findMatch(false);
+}
+
+CursorPos FindPrevMatch()
+{
+    return findMatch(true);
+}
+
+// Number of rows searched between each check for pending input
+#define INC_CHECK_ROWS 4096
+
+// Incremental search state. Rows holds every row in [0, scanned) matching the
+// query, and possibly some that do not. A row can only match a query if it
+// matches every substring of it, so when the query grows only those rows are
+// searched again.
+static struct
+{
+    Search prev;      // Search before incremental search started
+    bool prevHl;      // Highlight state before start
+    CursorPos origin; // Cursor position at start
+    char query[MAX_SEARCH];
+    int queryLength;
+    int *rows;
+    int numRows;
+    int rowCap;
+    int scanned;
+} inc;
+
+static void incAddRow(int row)
+{
+    if (inc.numRows >= inc.rowCap)
+    {
+        inc.rowCap = inc.rowCap == 0 ? 1024 : inc.rowCap * 2;
+        inc.rows = MemRealloc(inc.rows, inc.rowCap * sizeof(int));
+        AssertNotNull(inc.rows);
+    }
+    inc.rows[inc.numRows++] = row;
+}
+
+static bool lineMatches(Search *s, int row)
+{
+    Line *line = &curBuffer->lines[row];
+    return SearchForward(s, line->chars, line->length, 0, NULL) != -1;
+}
+
+// Moves cursor to the first match in candidate rows after origin, wrapping around.
+static void incJump(Search *s)
+{
+    // Binary search first candidate at or after origin row
+    int lo = 0, hi = inc.numRows;
+    while (lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+        if (inc.rows[mid] < inc.origin.row)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    // The origin row is checked twice, after and before origin col
+    for (int i = 0; i <= inc.numRows && inc.numRows > 0; i++)
+    {
+        int row = inc.rows[(lo + i) % inc.numRows];
+        Line *line = &curBuffer->lines[row];
+        int from = row == inc.origin.row && i == 0 ? inc.origin.col : 0;
+        int col = SearchForward(s, line->chars, line->length, from, NULL);
+        if (col != -1)
+        {
+            CursorSetPos(curBuffer, col, row, false);
+            return;
+        }
+    }
+
+    CursorSetPos(curBuffer, inc.origin.col, inc.origin.row, false);
+}
+
+void FindIncStart()
+{
+    inc.prev = curBuffer->search;
+    inc.prevHl = curBuffer->hlSearch;
+    inc.origin = (CursorPos){.row = curRow, .col = curCol};
+    inc.queryLength = 0;
+    inc.numRows = 0;
+    inc.scanned = 0;
+
+    memset(&curBuffer->search, 0, sizeof(Search));
+    curBuffer->hlSearch = true;
+}
+
+bool FindIncUpdate(char *query, int length)
+{
+    Search *s = &curBuffer->search;
+    SearchFree(s);
+    SearchCompile(s, query, length);
+    MatchIndexClear(curBuffer);
+
+    bool refine = inc.queryLength > 0 && length >= inc.queryLength &&
+                  StrMemStr(query, inc.query, length) != NULL;
+
+    memcpy(inc.query, s->pattern, MAX_SEARCH);
+    inc.queryLength = s->length;
+
+    if (length == 0)
+    {
+        inc.numRows = 0;
+        inc.scanned = 0;
+        CursorSetPos(curBuffer, inc.origin.col, inc.origin.row, false);
+        return true;
+    }
+
+    if (refine)
+    {
+        // Only rows matching the previous query need to be searched again
+        int kept = 0;
+        for (int i = 0; i < inc.numRows; i++)
+        {
+            if (i % INC_CHECK_ROWS == 0 && EditorKeyPending())
+            {
+                // Unchecked rows are still candidates for the new query
+                memmove(inc.rows + kept, inc.rows + i, (inc.numRows - i) * sizeof(int));
+                inc.numRows = kept + inc.numRows - i;
+                return false;
+            }
+
+            if (lineMatches(s, inc.rows[i]))
+                inc.rows[kept++] = inc.rows[i];
+        }
+        inc.numRows = kept;
+    }
+    else
+    {
+        inc.numRows = 0;
+        inc.scanned = 0;
+    }
+
+    // Search rows not covered by the candidate set
+    uint8_t *filter = TrigramFilter(curBuffer, s);
+    for (int row = inc.scanned; row < curBuffer->numLines; row++)
+    {
+        if ((row - inc.scanned) % INC_CHECK_ROWS == 0 && row != inc.scanned && EditorKeyPending())
+        {
+            inc.scanned = row;
+            return false;
+        }
+
+        if ((filter == NULL || filter[row >> TRIGRAM_BLOCK_SHIFT]) && lineMatches(s, row))
+            incAddRow(row);
+    }
+
+    inc.scanned = curBuffer->numLines;
+    incJump(s);
+    return true;
+}
+
+void FindIncEnd(bool cancel)
+{
+    MatchIndexClear(curBuffer);
+
+    if (cancel)
+    {
+        SearchFree(&curBuffer->search);
+        curBuffer->search = inc.prev;
+        curBuffer->hlSearch = inc.prevHl;
+        CursorSetPos(curBuffer, inc.origin.col, inc.origin.row, false);
+        return;
+    }
+
+    SearchFree(&inc.prev);
+
+    // Candidate rows cover the whole buffer, no need to search all of it again
+    if (inc.scanned == curBuffer->numLines && curBuffer->search.length > 0)
+        MatchIndexBuildRows(curBuffer, inc.rows, inc.numRows);
+
+    // Last update was cancelled by the enter key, finish with a normal search
+    if (inc.scanned < curBuffer->numLines && curBuffer->search.length > 0)
+    {
+        CursorSetPos(curBuffer, inc.origin.col, inc.origin.row, false);
+        CursorPos pos = FindNext(&curBuffer->search);
+        CursorSetPos(curBuffer, pos.col, pos.row, false);
+    }
+}
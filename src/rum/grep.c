@@ -0,0 +1,589 @@
+// Find in files. Walks a directory tree on a set of threads, each taking files
+// and directories from a shared work list, and searches each file with the
+// regex engine. Results are collected as text and appended to the results
+// buffer by the input thread when woken, so the editor stays responsive while
+// the search runs. A new search cancels the previous one.
+
+#include "rum.h"
+
+extern Editor editor;
+
+#define GREP_MAX_THREADS 32
+#define GREP_MAX_LINE 256         // Longest part of a matched line shown in results
+#define GREP_BINARY_CHECK 8192    // Bytes checked for NUL to detect binary files
+#define GREP_MMAP_MIN (64 * 1024) // Smaller files are read instead of mapped
+#define GREP_MAX_SIZE (1 << 30)   // Larger files are skipped
+#define GREP_MAX_IGNORE 64        // Patterns read from .gitignore
+
+typedef struct GrepItem
+{
+    char *path;
+    bool isDir;
+} GrepItem;
+
+typedef struct GrepRun
+{
+    CRITICAL_SECTION lock;
+    volatile LONG refs; // Threads plus input thread
+    volatile LONG cancel;
+    Search search;
+
+    // Work list, used as a stack
+    GrepItem *items;
+    int numItems, itemCap;
+    int busy;    // Threads working on an item
+    HANDLE work; // Released for every item added, and for all when done
+
+    // Results not yet added to the buffer, newline separated
+    char *pending;
+    int pendingLength, pendingCap;
+    bool woken; // The input thread was woken and has not taken the results yet
+
+    int numFiles, numMatches;
+    int threadsLeft;
+
+    char ignore[GREP_MAX_IGNORE][64];
+    int numIgnore;
+} GrepRun;
+
+static GrepRun *current;
+static Buffer *results; // Owned by grep, not freed when switching buffer
+
+static void release(GrepRun *run)
+{
+    if (InterlockedDecrement(&run->refs) != 0)
+        return;
+
+    for (int i = 0; i < run->numItems; i++)
+        MemFree(run->items[i].path);
+
+    SearchFree(&run->search);
+    DeleteCriticalSection(&run->lock);
+    CloseHandle(run->work);
+    MemFree(run->items);
+    MemFree(run->pending);
+    MemFree(run);
+}
+
+// Must be called with lock held.
+static void pushItem(GrepRun *run, char *path, bool isDir)
+{
+    if (run->numItems >= run->itemCap)
+    {
+        run->itemCap = run->itemCap == 0 ? 256 : run->itemCap * 2;
+        run->items = MemRealloc(run->items, run->itemCap * sizeof(GrepItem));
+        AssertNotNull(run->items);
+    }
+
+    run->items[run->numItems++] = (GrepItem){.path = path, .isDir = isDir};
+    ReleaseSemaphore(run->work, 1, NULL);
+}
+
+// Matches name against pattern with * and ? wildcards.
+static bool globMatch(char *pattern, char *name)
+{
+    if (*pattern == 0)
+        return *name == 0;
+    if (*pattern == '*')
+        return globMatch(pattern + 1, name) || (*name != 0 && globMatch(pattern, name + 1));
+    if (*name != 0 && (*pattern == '?' || *pattern == *name))
+        return globMatch(pattern + 1, name + 1);
+    return false;
+}
+
+static bool isIgnored(GrepRun *run, char *name, bool isDir)
+{
+    // Hidden files and folders, eg. .git
+    if (name[0] == '.')
+        return true;
+
+    for (int i = 0; i < run->numIgnore; i++)
+    {
+        char *pattern = run->ignore[i];
+        int length = strlen(pattern);
+
+        // Patterns ending with / only match directories
+        if (pattern[length - 1] == '/')
+        {
+            if (!isDir)
+                continue;
+
+            char dirPattern[64];
+            strncpy(dirPattern, pattern, length - 1);
+            dirPattern[length - 1] = 0;
+            if (globMatch(dirPattern, name))
+                return true;
+        }
+        else if (globMatch(pattern, name))
+            return true;
+    }
+
+    return false;
+}
+
+// Reads simple name patterns from .gitignore in dir. Negations and patterns
+// with a path are skipped.
+static void loadIgnore(GrepRun *run, char *dir)
+{
+    char path[MAX_PATH];
+    snprintf(path, MAX_PATH, "%s\\.gitignore", dir);
+
+    FILE *f = fopen(path, "r");
+    if (f == NULL)
+        return;
+
+    char line[128];
+    while (fgets(line, sizeof(line), f) != NULL && run->numIgnore < GREP_MAX_IGNORE)
+    {
+        line[strcspn(line, "\r\n")] = 0;
+        char *pattern = line[0] == '/' ? line + 1 : line;
+        int length = strlen(pattern);
+
+        if (length == 0 || length >= 64 || pattern[0] == '#' || pattern[0] == '!')
+            continue;
+        if (strchr(pattern, '/') != NULL && strchr(pattern, '/') != pattern + length - 1)
+            continue;
+
+        strcpy(run->ignore[run->numIgnore++], pattern);
+    }
+
+    fclose(f);
+}
+
+// Results for a single file
+typedef struct GrepOut
+{
+    char *text;
+    int length;
+    int cap;
+} GrepOut;
+
+static void outAppend(GrepOut *out, char *src, int length)
+{
+    if (out->length + length > out->cap)
+    {
+        out->cap = max(out->cap * 2, out->length + length + 1024);
+        out->text = MemRealloc(out->text, out->cap);
+        AssertNotNull(out->text);
+    }
+
+    memcpy(out->text + out->length, src, length);
+    out->length += length;
+}
+
+// Adds a result line to out as path:row:col:text.
+static void addResult(GrepOut *out, char *path, int row, int col, char *line, int length)
+{
+    char prefix[MAX_PATH + 32];
+    int prefixLength = sprintf(prefix, "%s:%d:%d:", path, row + 1, col + 1);
+    outAppend(out, prefix, prefixLength);
+    outAppend(out, line, min(length, GREP_MAX_LINE));
+    outAppend(out, "\n", 1);
+}
+
+// Searches text and appends matching lines to out. Returns number of matches.
+static int searchText(Search *s, char *path, char *text, int size, GrepOut *out)
+{
+    // Look for the literal every match contains in the whole text first, so
+    // only lines that contain it are searched with the regex
+    Search *pre = s->regex != NULL ? RegexLiteral(s->regex) : s;
+
+    int pos = 0;
+    int row = 0, counted = 0;
+    int numMatches = 0;
+
+    while (pos < size)
+    {
+        int lineStart = pos;
+        if (pre->length > 0)
+        {
+            int hit = SearchForward(pre, text, size, pos, NULL);
+            if (hit == -1)
+                break;
+
+            lineStart = hit;
+            while (lineStart > pos && text[lineStart - 1] != '\n')
+                lineStart--;
+        }
+
+        char *newline = memchr(text + lineStart, '\n', size - lineStart);
+        int lineEnd = newline != NULL ? newline - text : size;
+        int length = lineEnd - lineStart;
+        if (length > 0 && text[lineEnd - 1] == '\r')
+            length--;
+
+        int col = SearchForward(s, text + lineStart, length, 0, NULL);
+        if (col != -1)
+        {
+            // Count lines up to this one
+            char *p = text + counted;
+            while ((p = memchr(p, '\n', lineStart - (p - text))) != NULL)
+            {
+                row++;
+                p++;
+            }
+            counted = lineStart;
+
+            addResult(out, path, row, col, text + lineStart, length);
+            numMatches++;
+        }
+
+        pos = lineEnd + 1;
+    }
+
+    return numMatches;
+}
+
+// Appends the results in out to the pending results and wakes the input thread
+// unless it is woken already. One wake picks up everything added until then.
+static void flushResults(GrepRun *run, GrepOut *out, int numMatches)
+{
+    int length = out->length;
+
+    EnterCriticalSection(&run->lock);
+    if (run->pendingLength + length > run->pendingCap)
+    {
+        run->pendingCap = max(run->pendingCap * 2, run->pendingLength + length);
+        run->pending = MemRealloc(run->pending, run->pendingCap);
+        AssertNotNull(run->pending);
+    }
+
+    memcpy(run->pending + run->pendingLength, out->text, length);
+    run->pendingLength += length;
+    run->numMatches += numMatches;
+
+    bool wake = !run->woken;
+    run->woken = true;
+    LeaveCriticalSection(&run->lock);
+
+    if (wake)
+        EditorWake();
+}
+
+static void searchFile(GrepRun *run, Search *s, char *path, char **readBuf)
+{
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0 || fileSize.QuadPart > GREP_MAX_SIZE)
+    {
+        CloseHandle(file);
+        return;
+    }
+
+    int size = fileSize.QuadPart;
+    char *text = NULL;
+    HANDLE mapping = NULL;
+
+    if (size >= GREP_MMAP_MIN)
+    {
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping != NULL)
+            text = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    }
+    else
+    {
+        DWORD read;
+        if (ReadFile(file, *readBuf, size, &read, NULL))
+        {
+            text = *readBuf;
+            size = read;
+        }
+    }
+
+    // Files with NUL bytes are considered binary
+    if (text != NULL && memchr(text, 0, min(size, GREP_BINARY_CHECK)) == NULL)
+    {
+        GrepOut out = {0};
+        int numMatches = searchText(s, path, text, size, &out);
+        if (numMatches > 0)
+            flushResults(run, &out, numMatches);
+        MemFree(out.text);
+    }
+
+    if (mapping != NULL)
+    {
+        if (text != NULL)
+            UnmapViewOfFile(text);
+        CloseHandle(mapping);
+    }
+
+    CloseHandle(file);
+
+    EnterCriticalSection(&run->lock);
+    run->numFiles++;
+    LeaveCriticalSection(&run->lock);
+}
+
+static void listDir(GrepRun *run, char *dir)
+{
+    char pattern[MAX_PATH];
+    snprintf(pattern, MAX_PATH, "%s\\*", dir);
+
+    WIN32_FIND_DATAA data;
+    HANDLE find = FindFirstFileA(pattern, &data);
+    if (find == INVALID_HANDLE_VALUE)
+        return;
+
+    do
+    {
+        bool isDir = data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY;
+        if (data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT || isIgnored(run, data.cFileName, isDir))
+            continue;
+
+        // Keep paths relative to the working directory short
+        char *path = MemAlloc(MAX_PATH);
+        AssertNotNull(path);
+        if (!strcmp(dir, "."))
+            snprintf(path, MAX_PATH, "%s", data.cFileName);
+        else
+            snprintf(path, MAX_PATH, "%s\\%s", dir, data.cFileName);
+
+        EnterCriticalSection(&run->lock);
+        pushItem(run, path, isDir);
+        LeaveCriticalSection(&run->lock);
+    } while (FindNextFileA(find, &data));
+
+    FindClose(find);
+}
+
+static DWORD WINAPI grepThread(LPVOID param)
+{
+    GrepRun *run = param;
+
+    Search s;
+    SearchClone(&s, &run->search);
+    char *readBuf = MemAlloc(GREP_MMAP_MIN);
+    AssertNotNull(readBuf);
+
+    while (!run->cancel)
+    {
+        EnterCriticalSection(&run->lock);
+        if (run->numItems == 0)
+        {
+            // Done when no other thread can add more work
+            bool done = run->busy == 0;
+            LeaveCriticalSection(&run->lock);
+            if (done)
+                break;
+
+            WaitForSingleObject(run->work, INFINITE);
+            continue;
+        }
+
+        GrepItem item = run->items[--run->numItems];
+        run->busy++;
+        LeaveCriticalSection(&run->lock);
+
+        if (item.isDir)
+            listDir(run, item.path);
+        else
+            searchFile(run, &s, item.path, &readBuf);
+
+        MemFree(item.path);
+
+        // The last item is done, wake the threads waiting for more
+        EnterCriticalSection(&run->lock);
+        if (--run->busy == 0 && run->numItems == 0)
+            ReleaseSemaphore(run->work, GREP_MAX_THREADS, NULL);
+        LeaveCriticalSection(&run->lock);
+    }
+
+    SearchFree(&s);
+    MemFree(readBuf);
+
+    EnterCriticalSection(&run->lock);
+    run->threadsLeft--;
+    LeaveCriticalSection(&run->lock);
+
+    EditorWake();
+    release(run);
+    return 0;
+}
+
+// Sets the first line of the results buffer to a summary of the search.
+static void setSummary(GrepRun *run, bool done)
+{
+    char summary[MAX_SEARCH + 128];
+    char matches[16], files[16];
+    StrFormatInt(matches, run->numMatches);
+    StrFormatInt(files, run->numFiles);
+
+    int length = sprintf(summary, "%s matches for \"%s\" in %s files%s",
+                         matches, run->search.pattern, files, done ? "" : " (searching)");
+
+    BufferInsertLineEx(results, 0, summary, length);
+    BufferDeleteLine(results, 1);
+}
+
+// Starts searching all files in dir and below for pattern and shows the results
+// buffer. Results are added as they are found.
+void GrepStart(char *pattern, int length, char *dir)
+{
+    GrepRun *run = MemZeroAlloc(sizeof(GrepRun));
+    AssertNotNull(run);
+
+    if (!SearchCompileRegex(&run->search, pattern, length))
+    {
+        SetStatus(NULL, "invalid regex");
+        MemFree(run);
+        return;
+    }
+
+    GrepCancel();
+
+    InitializeCriticalSection(&run->lock);
+    run->work = CreateSemaphoreA(NULL, 0, INT_MAX, NULL);
+    loadIgnore(run, dir);
+
+    char *root = MemAlloc(MAX_PATH);
+    AssertNotNull(root);
+    strncpy(root, dir, MAX_PATH - 1);
+    root[MAX_PATH - 1] = 0;
+    pushItem(run, root, true);
+
+    // New results buffer, replacing the old one
+    Buffer *old = results;
+    results = BufferNew();
+    results->readOnly = true;
+    results->isResults = true;
+    snprintf(results->filepath, sizeof(results->filepath), "grep %s", run->search.pattern);
+
+    EditorSetCurrentBuffer(results);
+    if (old != NULL)
+    {
+        EditorRemoveBuffer(old);
+        BufferFree(old);
+    }
+
+    int numThreads = min(PoolSize(), GREP_MAX_THREADS);
+    run->threadsLeft = numThreads;
+    run->refs = numThreads + 1;
+    current = run;
+    setSummary(run, false);
+
+    for (int i = 0; i < numThreads; i++)
+    {
+        if (CreateThread(NULL, 0, grepThread, run, 0, NULL) == NULL)
+        {
+            Error("failed to start grep thread");
+            EnterCriticalSection(&run->lock);
+            run->threadsLeft--;
+            LeaveCriticalSection(&run->lock);
+            release(run);
+        }
+    }
+}
+
+// Stops the running search, if any. Results found so far are kept.
+void GrepCancel()
+{
+    if (current == NULL)
+        return;
+
+    // Adding the last results may finish the search
+    GrepApplyResults();
+    if (current == NULL)
+        return;
+
+    InterlockedExchange(&current->cancel, 1);
+    setSummary(current, true);
+    release(current);
+    current = NULL;
+}
+
+// Adds results found since the last call to the results buffer. Must be called
+// from the input thread. Returns true if the results buffer changed.
+bool GrepApplyResults()
+{
+    GrepRun *run = current;
+    if (run == NULL)
+        return false;
+
+    EnterCriticalSection(&run->lock);
+    char *pending = run->pending;
+    int length = run->pendingLength;
+    bool done = run->threadsLeft == 0;
+    run->woken = false;
+    run->pending = NULL;
+    run->pendingLength = 0;
+    run->pendingCap = 0;
+    LeaveCriticalSection(&run->lock);
+
+    char *line = pending;
+    char *end = pending + length;
+    while (line < end)
+    {
+        char *newline = memchr(line, '\n', end - line);
+        BufferInsertLineEx(results, results->numLines, line, newline - line);
+        line = newline + 1;
+    }
+
+    MemFree(pending);
+    setSummary(run, done);
+
+    if (done)
+    {
+        release(run);
+        current = NULL;
+    }
+
+    return length > 0 || done;
+}
+
+// Switches to the results buffer of the last search. Returns false if there is none.
+bool GrepShowResults()
+{
+    if (results == NULL)
+        return false;
+
+    EditorSetCurrentBuffer(results);
+    return true;
+}
+
+// Opens the file of the result under the cursor in the results buffer and
+// moves the cursor to the match. Returns false if the line is not a result.
+bool GrepOpenResult()
+{
+    if (!curBuffer->isResults)
+        return false;
+
+    Line *line = &curLine;
+    char *end = line->chars + line->length;
+
+    // Find path:row:col:, the path may contain : after a drive letter
+    for (char *p = line->chars; (p = memchr(p, ':', end - p)) != NULL; p++)
+    {
+        char *q = p + 1;
+        int row = 0, col = 0;
+
+        if (q >= end || !isdigit(*q))
+            continue;
+        while (q < end && isdigit(*q))
+            row = row * 10 + (*q++ - '0');
+        if (q >= end || *q++ != ':')
+            continue;
+        while (q < end && isdigit(*q))
+            col = col * 10 + (*q++ - '0');
+        if (q >= end || *q != ':')
+            continue;
+
+        char path[MAX_PATH];
+        int length = min(p - line->chars, MAX_PATH - 1);
+        memcpy(path, line->chars, length);
+        path[length] = 0;
+
+        if (EditorOpenFile(path) == RETURN_ERROR)
+        {
+            SetStatus(NULL, "file not found");
+            return true;
+        }
+
+        CursorSetPos(curBuffer, max(col - 1, 0), max(row - 1, 0), false);
+        return true;
+    }
+
+    return false;
+}
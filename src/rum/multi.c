@@ -0,0 +1,358 @@
+// Multiple cursors. The buffer keeps a sorted list of extra cursors next to
+// the main one. A typed key is applied to all cursors as one batch: the
+// positions are gathered in row order, every affected line is changed once by
+// BufferWriteMany or BufferDeleteMany, and the whole batch is saved as one
+// undo record. Edits that are not batched only apply to the main cursor.
+
+#include "rum.h"
+
+extern Editor editor;
+
+// Positions of the current batch, kept between calls
+static CursorPos *batch;
+static int *counts;
+static int batchCap;
+
+// Undo record of the current batch
+static char *undoBuf;
+static int undoLength;
+static int undoCap;
+
+static int comparePos(const void *a, const void *b)
+{
+    const CursorPos *p = a;
+    const CursorPos *q = b;
+    if (p->row != q->row)
+        return p->row - q->row;
+    return p->col - q->col;
+}
+
+static void undoAppend(void *src, int length)
+{
+    if (undoLength + length > undoCap)
+    {
+        undoCap = max(undoCap * 2, undoLength + length + 1024);
+        undoBuf = MemRealloc(undoBuf, undoCap);
+        AssertNotNull(undoBuf);
+    }
+
+    memcpy(undoBuf + undoLength, src, length);
+    undoLength += length;
+}
+
+// Appends an entry of a batch undo record, see undo.c.
+static void undoEntry(int row, int col, char *text, int length)
+{
+    undoAppend(&row, sizeof(int));
+    undoAppend(&col, sizeof(int));
+    undoAppend(&length, sizeof(int));
+    undoAppend(text, length);
+}
+
+// Keeps the extra cursors of b sorted and without duplicates of each other or
+// the main cursor.
+static void normalize(Buffer *b)
+{
+    qsort(b->cursors, b->numCursors, sizeof(CursorPos), comparePos);
+
+    int n = 0;
+    for (int i = 0; i < b->numCursors; i++)
+    {
+        CursorPos p = b->cursors[i];
+        if (p.row == b->cursor.row && p.col == b->cursor.col)
+            continue;
+        if (n > 0 && !comparePos(&p, &b->cursors[n - 1]))
+            continue;
+        b->cursors[n++] = p;
+    }
+
+    b->numCursors = n;
+}
+
+// Copies all cursors into batch, clamped to the buffer and sorted by position.
+// Returns the number of cursors and writes the index of the main one to main.
+static int gather(Buffer *b, int *main)
+{
+    int count = b->numCursors + 1;
+    if (count > batchCap)
+    {
+        batchCap = max(batchCap * 2, count);
+        batch = MemRealloc(batch, batchCap * sizeof(CursorPos));
+        counts = MemRealloc(counts, batchCap * sizeof(int));
+        AssertNotNull(batch);
+        AssertNotNull(counts);
+    }
+
+    // Lines may have changed under the extra cursors since they were placed
+    bool sorted = true;
+    for (int i = 0; i < b->numCursors; i++)
+    {
+        CursorPos *p = &b->cursors[i];
+        p->row = min(max(p->row, 0), b->numLines - 1);
+        p->col = min(max(p->col, 0), b->lines[p->row].length);
+        sorted = sorted && (i == 0 || comparePos(&b->cursors[i - 1], p) < 0);
+    }
+
+    if (!sorted)
+        normalize(b);
+
+    CursorPos cur = {b->cursor.row, b->cursor.col};
+    int n = 0;
+    *main = -1;
+
+    for (int i = 0; i < b->numCursors; i++)
+    {
+        if (*main == -1 && comparePos(&cur, &b->cursors[i]) <= 0)
+        {
+            *main = n;
+            batch[n++] = cur;
+            if (!comparePos(&cur, &b->cursors[i]))
+                continue;
+        }
+
+        batch[n++] = b->cursors[i];
+    }
+
+    if (*main == -1)
+    {
+        *main = n;
+        batch[n++] = cur;
+    }
+
+    return n;
+}
+
+// Moves the cursors to their positions in batch after a change.
+static void scatter(Buffer *b, int count, int main)
+{
+    int n = 0;
+    for (int i = 0; i < count; i++)
+        if (i != main)
+            b->cursors[n++] = batch[i];
+
+    b->numCursors = n;
+    CursorSetPos(b, batch[main].col, batch[main].row, false);
+}
+
+// Adds an extra cursor at row/col, unless there already is one.
+void MultiAdd(int row, int col)
+{
+    Buffer *b = curBuffer;
+    CursorPos p = {row, col};
+
+    int lo = 0;
+    int hi = b->numCursors;
+    while (lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+        if (comparePos(&b->cursors[mid], &p) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if (lo < b->numCursors && !comparePos(&b->cursors[lo], &p))
+        return;
+
+    if (b->numCursors == b->cursorCap)
+    {
+        b->cursorCap = max(b->cursorCap * 2, 16);
+        b->cursors = MemRealloc(b->cursors, b->cursorCap * sizeof(CursorPos));
+        AssertNotNull(b->cursors);
+    }
+
+    memmove(b->cursors + lo + 1, b->cursors + lo, (b->numCursors - lo) * sizeof(CursorPos));
+    b->cursors[lo] = p;
+    b->numCursors++;
+}
+
+// Leaves an extra cursor at the cursor position and moves the cursor down.
+void MultiAddBelow()
+{
+    if (curRow == curBuffer->numLines - 1)
+        return;
+
+    MultiAdd(curRow, curCol);
+    CursorMove(curBuffer, 0, 1);
+}
+
+// Puts cursors at col on the rows of block r that reach into it, the main
+// cursor on the first. Returns false if no row reaches into the block. Used for
+// column edits, rows ending before the block are left alone and cursors on rows
+// ending inside it go to the end of the row.
+bool MultiAddColumn(Range r, int col)
+{
+    Buffer *b = curBuffer;
+    int total = b->numCursors + r.endRow - r.startRow + 1;
+
+    if (total > b->cursorCap)
+    {
+        b->cursorCap = total;
+        b->cursors = MemRealloc(b->cursors, b->cursorCap * sizeof(CursorPos));
+        AssertNotNull(b->cursors);
+    }
+
+    CursorPos main = {-1, 0};
+    for (int row = r.startRow; row <= r.endRow; row++)
+    {
+        int length = b->lines[row].length;
+        if (length <= r.startCol)
+            continue;
+
+        CursorPos p = {row, min(col, length)};
+        if (main.row == -1)
+            main = p;
+        else
+            b->cursors[b->numCursors++] = p;
+    }
+
+    if (main.row == -1)
+        return false;
+
+    CursorSetPos(b, main.col, main.row, false);
+    normalize(b);
+    return true;
+}
+
+// Adds an extra cursor at every match of the buffer search. Returns the
+// number of cursors added.
+int MultiAddMatches()
+{
+    Buffer *b = curBuffer;
+    if (b->search.length == 0)
+        return 0;
+
+    MatchIndexUpdate(b);
+    MatchIndex *m = &b->matches;
+    int total = b->numCursors + m->numMatches;
+
+    if (total > b->cursorCap)
+    {
+        b->cursorCap = total;
+        b->cursors = MemRealloc(b->cursors, b->cursorCap * sizeof(CursorPos));
+        AssertNotNull(b->cursors);
+    }
+
+    int before = b->numCursors;
+    memcpy(b->cursors + before, m->matches, m->numMatches * sizeof(CursorPos));
+    b->numCursors = total;
+    normalize(b);
+
+    return b->numCursors - before;
+}
+
+// Removes all extra cursors.
+void MultiClear()
+{
+    curBuffer->numCursors = 0;
+}
+
+// Writes text at all cursors as one change.
+void MultiWrite(char *text, int length)
+{
+    Buffer *b = curBuffer;
+    if (b->readOnly)
+        return;
+
+    int main;
+    int count = gather(b, &main);
+    CursorPos before = batch[main];
+
+    BufferWriteMany(b, batch, count, text, length);
+
+    // Entries are relative to the buffer after the ones before them, which
+    // are the final positions since earlier writes are to the left
+    undoLength = 0;
+    for (int i = 0; i < count; i++)
+        undoEntry(batch[i].row, batch[i].col - length, text, length);
+
+    UndoSaveActionEx(A_WRITE_MANY, before.row, before.col, undoBuf, undoLength);
+    scatter(b, count, main);
+}
+
+// Deletes counts[i] characters before every cursor in batch as one change.
+static void deleteBatch(Buffer *b, int count, int main, CursorPos before)
+{
+    undoLength = 0;
+    int shiftRow = -1;
+    int shift = 0;
+
+    for (int i = 0; i < count; i++)
+    {
+        CursorPos p = batch[i];
+        if (p.row != shiftRow)
+        {
+            shiftRow = p.row;
+            shift = 0;
+        }
+
+        if (counts[i] == 0)
+            continue;
+
+        // Deleted text is where it starts once the deletes before it are done
+        undoEntry(p.row, p.col - counts[i] - shift, b->lines[p.row].chars + p.col - counts[i], counts[i]);
+        shift += counts[i];
+    }
+
+    if (undoLength == 0)
+        return;
+
+    BufferDeleteMany(b, batch, counts, count);
+    UndoSaveActionEx(A_DELETE_MANY, before.row, before.col, undoBuf, undoLength);
+    scatter(b, count, main);
+}
+
+// Deletes the character before every cursor as one change. Lines are not
+// joined, cursors at the start of a line stay.
+void MultiBackspace()
+{
+    Buffer *b = curBuffer;
+    if (b->readOnly)
+        return;
+
+    int main;
+    int count = gather(b, &main);
+    CursorPos before = batch[main];
+
+    for (int i = 0; i < count; i++)
+        counts[i] = batch[i].col > 0;
+
+    deleteBatch(b, count, main, before);
+}
+
+// Deletes the character after every cursor as one change. Lines are not
+// joined.
+void MultiDelete()
+{
+    Buffer *b = curBuffer;
+    if (b->readOnly)
+        return;
+
+    int main;
+    int count = gather(b, &main);
+    CursorPos before = batch[main];
+
+    // Same as backspace from one character to the right
+    for (int i = 0; i < count; i++)
+    {
+        counts[i] = batch[i].col < b->lines[batch[i].row].length;
+        batch[i].col += counts[i];
+    }
+
+    deleteBatch(b, count, main, before);
+}
+
+// Moves all cursors by x, y.
+void MultiMove(int x, int y)
+{
+    Buffer *b = curBuffer;
+    for (int i = 0; i < b->numCursors; i++)
+    {
+        CursorPos *p = &b->cursors[i];
+        p->row = min(max(p->row + y, 0), b->numLines - 1);
+        p->col = min(max(p->col + x, 0), b->lines[p->row].length);
+    }
+
+    CursorMove(b, x, y);
+    normalize(b);
+}
@@ -0,0 +1,200 @@
+// Search and replace. Each changed line is built once in a scratch buffer and
+// copied into a single new allocation. The old and new text of every changed
+// line is packed into one block and saved as a single undo action.
+
+#include "rum.h"
+
+extern Editor editor;
+
+// Growable scratch text, kept between calls
+typedef struct Scratch
+{
+    char *text;
+    int length;
+    int cap;
+} Scratch;
+
+static Scratch lineBuf, undoBuf;
+
+static void scratchAppend(Scratch *s, void *src, int length)
+{
+    if (length == 0)
+        return;
+
+    if (s->length + length > s->cap)
+    {
+        s->cap = max(s->cap * 2, s->length + length + 1024);
+        s->text = MemRealloc(s->text, s->cap);
+        AssertNotNull(s->text);
+    }
+
+    memcpy(s->text + s->length, src, length);
+    s->length += length;
+}
+
+// Appends rep to out with & replaced by the match. \ escapes the next character.
+static void appendReplacement(Scratch *out, char *rep, int repLength, char *match, int matchLength)
+{
+    for (int i = 0; i < repLength; i++)
+    {
+        if (rep[i] == '\\' && i + 1 < repLength)
+            scratchAppend(out, &rep[++i], 1);
+        else if (rep[i] == '&')
+            scratchAppend(out, match, matchLength);
+        else
+            scratchAppend(out, &rep[i], 1);
+    }
+}
+
+// Replaces matches of s in rows startRow to endRow, inclusive, with rep. Only
+// the first match in each line is replaced unless global is true. The whole
+// replace is one undo action. Read only buffers are left as they are. Returns
+// number of replaced matches.
+int Replace(Search *s, char *rep, int repLength, int startRow, int endRow, bool global)
+{
+    Buffer *b = curBuffer;
+    if (b->readOnly)
+        return 0;
+
+    int count = 0;
+    int lastRow = -1;
+    undoBuf.length = 0;
+
+    for (int row = startRow; row <= endRow; row++)
+    {
+        Line *line = &b->lines[row];
+        int matchLength;
+        int col = SearchForward(s, line->chars, line->length, 0, &matchLength);
+        if (col == -1)
+            continue;
+
+        lineBuf.length = 0;
+        int pos = 0;
+
+        while (col != -1)
+        {
+            scratchAppend(&lineBuf, line->chars + pos, col - pos);
+            appendReplacement(&lineBuf, rep, repLength, line->chars + col, matchLength);
+            pos = col + matchLength;
+            count++;
+
+            if (!global)
+                break;
+
+            // Step past empty matches so they are not replaced again
+            col = SearchForward(s, line->chars, line->length, matchLength == 0 ? col + 1 : pos, &matchLength);
+        }
+
+        scratchAppend(&lineBuf, line->chars + pos, line->length - pos);
+
+        // Row, old length and text, new length and text
+        scratchAppend(&undoBuf, &row, sizeof(int));
+        scratchAppend(&undoBuf, &line->length, sizeof(int));
+        scratchAppend(&undoBuf, line->chars, line->length);
+        scratchAppend(&undoBuf, &lineBuf.length, sizeof(int));
+        scratchAppend(&undoBuf, lineBuf.text, lineBuf.length);
+
+        BufferReplaceLine(b, row, lineBuf.text, lineBuf.length);
+        lastRow = row;
+    }
+
+    if (count == 0)
+        return 0;
+
+    UndoSaveActionEx(A_REPLACE, curRow, curCol, undoBuf.text, undoBuf.length);
+
+    CursorSetPos(b, 0, lastRow, false);
+    return count;
+}
+
+// Splits the next / separated part of src into dest. Returns pointer to the
+// character after the separator, or end of string if there is none. \/ is
+// kept as / in patterns and as \/ otherwise. Returns NULL if the part does not
+// fit in dest.
+static char *nextPart(char *src, char *dest, int size, int *length, bool isPattern)
+{
+    *length = 0;
+
+    while (*src != 0 && *src != '/')
+    {
+        if (src[0] == '\\' && src[1] == '/' && isPattern)
+            src++;
+        else if (src[0] == '\\' && src[1] != 0)
+        {
+            if (*length >= size - 1)
+                return NULL;
+            dest[(*length)++] = *src++;
+        }
+
+        if (*length >= size - 1)
+            return NULL;
+        dest[(*length)++] = *src;
+        src++;
+    }
+
+    dest[*length] = 0;
+    return *src == '/' ? src + 1 : src;
+}
+
+// Runs a substitute command: s/pattern/replacement/[g] on the current line or
+// %s/pattern/replacement/[g] on the whole buffer. Pattern is a regex.
+void Substitute(char *command)
+{
+    if (curBuffer->readOnly)
+    {
+        SetStatus(NULL, "buffer is read only");
+        return;
+    }
+
+    bool wholeBuffer = command[0] == '%';
+    char *p = command + (wholeBuffer ? 3 : 2); // Skip s/ or %s/
+
+    char pattern[MAX_SEARCH];
+    char rep[256];
+    int patternLength, repLength;
+
+    p = nextPart(p, pattern, MAX_SEARCH, &patternLength, true);
+    if (p == NULL)
+    {
+        SetStatus(NULL, "pattern too long");
+        return;
+    }
+
+    p = nextPart(p, rep, sizeof(rep), &repLength, false);
+    if (p == NULL)
+    {
+        SetStatus(NULL, "replacement too long");
+        return;
+    }
+
+    bool global = strchr(p, 'g') != NULL;
+
+    if (patternLength == 0)
+    {
+        SetStatus(NULL, "usage: [%]s/pattern/replacement/[g]");
+        return;
+    }
+
+    Search s = {0};
+    if (!SearchCompileRegex(&s, pattern, patternLength))
+    {
+        SetStatus(NULL, "invalid regex");
+        return;
+    }
+
+    int startRow = wholeBuffer ? 0 : curRow;
+    int endRow = wholeBuffer ? curBuffer->numLines - 1 : curRow;
+    if (!wholeBuffer && curBuffer->selectMode != SELECT_NONE)
+    {
+        Range r = SelectRange();
+        startRow = r.startRow;
+        endRow = r.endRow;
+    }
+    int count = Replace(&s, rep, repLength, startRow, endRow, global);
+    SearchFree(&s);
+
+    char info[64], num[16];
+    StrFormatInt(num, count);
+    sprintf(info, "%s replaced", num);
+    SetStatusInfo(info);
+}
@@ -0,0 +1,279 @@
+// Line sort. Only an array of row indexes is sorted, the lines are then moved
+// into place by handle. Large ranges are split into chunks that are merge
+// sorted on the worker pool and merged pairwise, one pool job per pass. Merging
+// takes from the left on ties, so the sort is stable. The new order and any
+// removed duplicates are saved as a single undo action.
+
+#include "rum.h"
+
+extern Editor editor;
+
+#define SORT_PARALLEL_ROWS 65536 // Smaller ranges are sorted on the main thread
+#define SORT_CHUNK_ROWS 16384    // Minimum rows per parallel chunk
+#define SORT_SMALL 16            // Ranges sorted with insertion sort
+
+typedef struct SortJob
+{
+    Line *lines;        // First line of the range
+    int *order;         // Indexes being sorted, relative to lines
+    int *tmp;           // Merge buffer, same size as order
+    long long *numbers; // First number in each line for numeric sort
+    bool *hasNumber;
+    int count;
+    int width; // Rows per sorted run in the current pass
+    bool numeric;
+    bool reverse;
+} SortJob;
+
+// Finds the first decimal number in line, with its sign. Returns false if
+// there is none.
+static bool parseNumber(Line *line, long long *value)
+{
+    int i = 0;
+    while (i < line->length && (line->chars[i] < '0' || line->chars[i] > '9'))
+        i++;
+
+    if (i == line->length)
+        return false;
+
+    bool negative = i > 0 && line->chars[i - 1] == '-';
+    long long n = 0;
+    for (; i < line->length && line->chars[i] >= '0' && line->chars[i] <= '9'; i++)
+        n = n > (LLONG_MAX - 9) / 10 ? LLONG_MAX : n * 10 + (line->chars[i] - '0');
+
+    *value = negative ? -n : n;
+    return true;
+}
+
+static int compare(SortJob *job, int a, int b)
+{
+    int c;
+    if (job->numeric)
+    {
+        // Lines without a number go first
+        if (job->hasNumber[a] != job->hasNumber[b])
+            c = job->hasNumber[a] ? 1 : -1;
+        else if (!job->hasNumber[a])
+            c = 0;
+        else
+            c = (job->numbers[a] > job->numbers[b]) - (job->numbers[a] < job->numbers[b]);
+    }
+    else
+    {
+        Line *p = &job->lines[a];
+        Line *q = &job->lines[b];
+        c = memcmp(p->chars, q->chars, min(p->length, q->length));
+        if (c == 0)
+            c = p->length - q->length;
+    }
+
+    return job->reverse ? -c : c;
+}
+
+// Merges the sorted runs order[lo, mid) and order[mid, hi).
+static void merge(SortJob *job, int lo, int mid, int hi)
+{
+    if (mid >= hi || compare(job, job->order[mid - 1], job->order[mid]) <= 0)
+        return;
+
+    int i = lo, j = mid, k = lo;
+    while (i < mid && j < hi)
+    {
+        if (compare(job, job->order[i], job->order[j]) <= 0)
+            job->tmp[k++] = job->order[i++];
+        else
+            job->tmp[k++] = job->order[j++];
+    }
+
+    while (i < mid)
+        job->tmp[k++] = job->order[i++];
+    while (j < hi)
+        job->tmp[k++] = job->order[j++];
+
+    memcpy(job->order + lo, job->tmp + lo, (hi - lo) * sizeof(int));
+}
+
+static void mergeSort(SortJob *job, int lo, int hi)
+{
+    if (hi - lo <= SORT_SMALL)
+    {
+        for (int i = lo + 1; i < hi; i++)
+        {
+            int v = job->order[i];
+            int j = i;
+            for (; j > lo && compare(job, job->order[j - 1], v) > 0; j--)
+                job->order[j] = job->order[j - 1];
+            job->order[j] = v;
+        }
+        return;
+    }
+
+    int mid = lo + (hi - lo) / 2;
+    mergeSort(job, lo, mid);
+    mergeSort(job, mid, hi);
+    merge(job, lo, mid, hi);
+}
+
+// Pool task, sorts chunk index of the range.
+static void sortChunk(void *arg, int index, int worker)
+{
+    SortJob *job = arg;
+    int lo = index * job->width;
+    int hi = min(lo + job->width, job->count);
+
+    for (int i = lo; job->numeric && i < hi; i++)
+        job->hasNumber[i] = parseNumber(&job->lines[i], &job->numbers[i]);
+
+    mergeSort(job, lo, hi);
+}
+
+// Pool task, merges pair index of sorted runs.
+static void mergeChunks(void *arg, int index, int worker)
+{
+    SortJob *job = arg;
+    int lo = index * 2 * job->width;
+    int mid = min(lo + job->width, job->count);
+    int hi = min(lo + 2 * job->width, job->count);
+    merge(job, lo, mid, hi);
+}
+
+// Runs one pass of count tasks on the pool. Returns false if it was canceled.
+static bool runPass(PoolFunc fn, SortJob *job, int count, char *label)
+{
+    PoolJob *pj = PoolStart(fn, job, count);
+    bool done = EditorWaitJob(pj, count, label);
+    PoolFinish(pj);
+    return done;
+}
+
+// Sorts job->order. Returns false if the sort was canceled.
+static bool sortOrder(SortJob *job)
+{
+    if (job->count <= SORT_PARALLEL_ROWS)
+    {
+        job->width = job->count;
+        sortChunk(job, 0, 0);
+        return true;
+    }
+
+    int numChunks = min(PoolSize() * 2, (job->count + SORT_CHUNK_ROWS - 1) / SORT_CHUNK_ROWS);
+    job->width = (job->count + numChunks - 1) / numChunks;
+    if (!runPass(sortChunk, job, numChunks, "sorting"))
+        return false;
+
+    while (job->width < job->count)
+    {
+        int numPairs = (job->count + 2 * job->width - 1) / (2 * job->width);
+        if (!runPass(mergeChunks, job, numPairs, "merging"))
+            return false;
+        job->width *= 2;
+    }
+
+    return true;
+}
+
+// Saves the sort of count lines from row as one undo action: the new order
+// followed by the index and text of every removed line.
+static void saveUndo(Buffer *b, int row, int count, int *order, int newCount)
+{
+    bool *kept = MemZeroAlloc(count * sizeof(bool));
+    AssertNotNull(kept);
+    for (int i = 0; i < newCount; i++)
+        kept[order[i]] = true;
+
+    int length = 2 * sizeof(int) + newCount * sizeof(int);
+    for (int i = 0; i < count; i++)
+        if (!kept[i])
+            length += 2 * sizeof(int) + b->lines[row + i].length;
+
+    char *text = MemAlloc(length);
+    AssertNotNull(text);
+    char *p = text;
+
+    memcpy(p, &count, sizeof(int));
+    memcpy(p + sizeof(int), &newCount, sizeof(int));
+    memcpy(p + 2 * sizeof(int), order, newCount * sizeof(int));
+    p += 2 * sizeof(int) + newCount * sizeof(int);
+
+    for (int i = 0; i < count; i++)
+    {
+        if (kept[i])
+            continue;
+
+        Line *line = &b->lines[row + i];
+        memcpy(p, &i, sizeof(int));
+        memcpy(p + sizeof(int), &line->length, sizeof(int));
+        memcpy(p + 2 * sizeof(int), line->chars, line->length);
+        p += 2 * sizeof(int) + line->length;
+    }
+
+    UndoSaveActionEx(A_SORT_LINES, row, curCol, text, length);
+    MemFree(text);
+    MemFree(kept);
+}
+
+// Sorts rows startRow to endRow, inclusive, as one undo action. Equal lines
+// keep their order. Numeric sorts by the first number in each line. Unique
+// keeps only the first of equal lines. Returns the number of lines removed,
+// or -1 if the sort was canceled.
+int SortLines(int startRow, int endRow, bool unique, bool numeric, bool reverse)
+{
+    Buffer *b = curBuffer;
+    int count = endRow - startRow + 1;
+    if (b->readOnly || count <= 1)
+        return 0;
+
+    SortJob job = {
+        .lines = b->lines + startRow,
+        .order = MemAlloc(count * sizeof(int)),
+        .tmp = MemAlloc(count * sizeof(int)),
+        .count = count,
+        .numeric = numeric,
+        .reverse = reverse,
+    };
+    AssertNotNull(job.order);
+    AssertNotNull(job.tmp);
+
+    if (numeric)
+    {
+        job.numbers = MemAlloc(count * sizeof(long long));
+        job.hasNumber = MemAlloc(count * sizeof(bool));
+        AssertNotNull(job.numbers);
+        AssertNotNull(job.hasNumber);
+    }
+
+    for (int i = 0; i < count; i++)
+        job.order[i] = i;
+
+    int removed = -1;
+    if (sortOrder(&job))
+    {
+        int newCount = count;
+        if (unique)
+        {
+            newCount = 1;
+            for (int i = 1; i < count; i++)
+                if (compare(&job, job.order[newCount - 1], job.order[i]) != 0)
+                    job.order[newCount++] = job.order[i];
+        }
+
+        bool changed = newCount < count;
+        for (int i = 0; !changed && i < count; i++)
+            changed = job.order[i] != i;
+
+        if (changed)
+        {
+            saveUndo(b, startRow, count, job.order, newCount);
+            BufferPermuteLines(b, startRow, count, job.order, newCount);
+            CursorSetPos(b, curCol, min(curRow, b->numLines - 1), false);
+        }
+
+        removed = count - newCount;
+    }
+
+    MemFree(job.order);
+    MemFree(job.tmp);
+    MemFree(job.numbers);
+    MemFree(job.hasNumber);
+    return removed;
+}
@@ -0,0 +1,542 @@
+// Selection, registers, yank and put. A register holds lines like a buffer
+// does. Yanking whole lines shares their text with the buffer, see
+// snapshot.c, so yanking a million lines copies a million line headers and no
+// text. Putting whole lines inserts them into the line array in one go, again
+// sharing the text. Partial lines, at the ends of a character selection or in
+// a block, are copied.
+
+#include "rum.h"
+
+extern Editor editor;
+
+#define NUM_REGISTERS 27 // Unnamed and a-z
+
+static Register registers[NUM_REGISTERS];
+static Register *last = &registers[0]; // Register the unnamed one refers to
+
+// Growable scratch text, kept between calls
+typedef struct Scratch
+{
+    char *text;
+    int length;
+    int cap;
+} Scratch;
+
+static Scratch undoBuf, lineBuf;
+
+static void scratchAppend(Scratch *s, void *src, int length)
+{
+    if (length == 0)
+        return;
+
+    if (s->length + length > s->cap)
+    {
+        s->cap = max(s->cap * 2, s->length + length + 1024);
+        s->text = MemRealloc(s->text, s->cap);
+        AssertNotNull(s->text);
+    }
+
+    memcpy(s->text + s->length, src, length);
+    s->length += length;
+}
+
+// Appends count spaces to s.
+static void scratchPad(Scratch *s, int count)
+{
+    for (int i = 0; i < count; i++)
+        scratchAppend(s, " ", 1);
+}
+
+// Returns a new line with a copy of text.
+static Line copyLine(char *text, int length)
+{
+    int l = LINE_DEFAULT_LENGTH;
+    int cap = (length / l) * l + l;
+    Line line = {.chars = LineAlloc(cap), .cap = cap, .length = length};
+    memcpy(line.chars, text, length);
+    return line;
+}
+
+// Returns register a-z, or the unnamed one for any other name. The unnamed
+// register refers to the last one written when reading.
+static Register *getRegister(char name, bool write)
+{
+    if (name >= 'a' && name <= 'z')
+        return &registers[name - 'a' + 1];
+    return write ? &registers[0] : last;
+}
+
+static void registerFree(Register *reg)
+{
+    for (int i = 0; i < reg->numLines; i++)
+        LineFree(reg->lines[i].chars);
+
+    MemFree(reg->lines);
+    *reg = (Register){0};
+}
+
+// Inserts count lines at row as one undo record, taking over their text.
+static void insertLines(int row, Line *lines, int count)
+{
+    undoBuf.length = 0;
+    for (int i = 0; i < count; i++)
+    {
+        scratchAppend(&undoBuf, &lines[i].length, sizeof(int));
+        scratchAppend(&undoBuf, lines[i].chars, lines[i].length);
+    }
+
+    UndoSaveActionEx(A_INSERT_LINES, row, 0, undoBuf.text, undoBuf.length);
+    BufferInsertLines(curBuffer, row, lines, count);
+}
+
+// Deletes count lines from row as one undo record. Returns number of records.
+static int deleteLines(int row, int count)
+{
+    if (count <= 0)
+        return 0;
+
+    Buffer *b = curBuffer;
+    undoBuf.length = 0;
+    for (int i = row; i < row + count; i++)
+    {
+        scratchAppend(&undoBuf, &b->lines[i].length, sizeof(int));
+        scratchAppend(&undoBuf, b->lines[i].chars, b->lines[i].length);
+    }
+
+    UndoSaveActionEx(A_DELETE_LINES, row, 0, undoBuf.text, undoBuf.length);
+    BufferDeleteLines(b, row, count);
+    return 1;
+}
+
+// Moves count lines from row to before the line at dest as one undo record.
+// Returns false if dest is inside the lines.
+bool MoveLines(int row, int count, int dest)
+{
+    Buffer *b = curBuffer;
+    count = min(count, b->numLines - row);
+    if (b->readOnly || count <= 0 || dest < 0 || dest > b->numLines || (dest >= row && dest <= row + count))
+        return false;
+
+    int args[2] = {count, dest};
+    UndoSaveActionEx(A_MOVE_LINES, row, curCol, (char *)args, sizeof(args));
+    BufferMoveLines(b, row, count, dest);
+    CursorSetPos(b, curCol, dest < row ? dest : dest - count, false);
+    return true;
+}
+
+// Replaces count lines from row with the newline separated lines of text as
+// one undo step. Text may be NULL to only delete the lines.
+void ReplaceLines(int row, int count, char *text, int length)
+{
+    Buffer *b = curBuffer;
+    if (b->readOnly)
+        return;
+
+    UndoSaveActionEx(A_CURSOR, curRow, curCol, "", 0);
+    int records = 1;
+
+    // New lines go after the old ones first, so the buffer is never emptied
+    if (text != NULL)
+    {
+        int added = BufferInsertText(b, row + count, text, length);
+        undoBuf.length = 0;
+        for (int i = row + count; i < row + count + added; i++)
+        {
+            scratchAppend(&undoBuf, &b->lines[i].length, sizeof(int));
+            scratchAppend(&undoBuf, b->lines[i].chars, b->lines[i].length);
+        }
+
+        UndoSaveActionEx(A_INSERT_LINES, row + count, 0, undoBuf.text, undoBuf.length);
+        records++;
+    }
+
+    records += deleteLines(row, count);
+    CursorSetPos(b, 0, min(row, b->numLines - 1), false);
+    UndoJoin(records);
+}
+
+// Replaces the text of row with the line scratch as one undo record.
+static void replaceLine(int row)
+{
+    Line *line = &curBuffer->lines[row];
+    undoBuf.length = 0;
+    scratchAppend(&undoBuf, &row, sizeof(int));
+    scratchAppend(&undoBuf, &line->length, sizeof(int));
+    scratchAppend(&undoBuf, line->chars, line->length);
+    scratchAppend(&undoBuf, &lineBuf.length, sizeof(int));
+    scratchAppend(&undoBuf, lineBuf.text, lineBuf.length);
+
+    UndoSaveActionEx(A_REPLACE, row, 0, undoBuf.text, undoBuf.length);
+    BufferReplaceLine(curBuffer, row, lineBuf.text, lineBuf.length);
+}
+
+// Starts selecting text of the given kind from the cursor and enters visual
+// mode.
+void SelectStart(SelectMode mode)
+{
+    curBuffer->selectMode = mode;
+    curBuffer->selectStart = (CursorPos){curRow, curCol};
+    EditorSetMode(MODE_VISUAL);
+}
+
+// Ends the selection and returns to edit mode.
+void SelectEnd()
+{
+    curBuffer->selectMode = SELECT_NONE;
+    EditorSetMode(MODE_VIM);
+}
+
+// Returns the selected range of the current buffer. The cursor char is
+// included.
+Range SelectRange()
+{
+    Buffer *b = curBuffer;
+    CursorPos a = b->selectStart;
+    CursorPos c = {curRow, curCol};
+
+    // The buffer may have changed under the start, eg. by undo
+    a.row = min(a.row, b->numLines - 1);
+
+    if (a.row > c.row || (a.row == c.row && a.col > c.col))
+    {
+        CursorPos tmp = a;
+        a = c;
+        c = tmp;
+    }
+
+    Range r = {
+        .mode = b->selectMode,
+        .startRow = a.row,
+        .startCol = min(a.col, b->lines[a.row].length),
+        .endRow = c.row,
+        .endCol = min(c.col + 1, b->lines[c.row].length),
+    };
+
+    if (r.mode == SELECT_BLOCK)
+    {
+        r.startCol = min(a.col, c.col);
+        r.endCol = max(a.col, c.col) + 1;
+    }
+
+    return r;
+}
+
+// Copies range of the current buffer into register name, a-z or any other
+// character for the unnamed register.
+void Yank(char name, Range r)
+{
+    Buffer *b = curBuffer;
+    Register *reg = getRegister(name, true);
+    registerFree(reg);
+
+    int count = r.endRow - r.startRow + 1;
+    reg->lines = MemAlloc(count * sizeof(Line));
+    AssertNotNull(reg->lines);
+    reg->numLines = count;
+    reg->mode = r.mode;
+
+    for (int i = 0; i < count; i++)
+    {
+        Line *line = &b->lines[r.startRow + i];
+        int start = 0;
+        int end = line->length;
+
+        if (r.mode == SELECT_BLOCK)
+        {
+            start = min(r.startCol, line->length);
+            end = min(r.endCol, line->length);
+        }
+        else if (r.mode == SELECT_CHAR)
+        {
+            if (i == 0)
+                start = min(r.startCol, line->length);
+            if (i == count - 1)
+                end = min(r.endCol, line->length);
+        }
+
+        // Whole lines are shared until either side changes them
+        if (start == 0 && end == line->length)
+            reg->lines[i] = (Line){.chars = LineShare(line->chars), .cap = line->cap, .length = line->length};
+        else
+            reg->lines[i] = copyLine(line->chars + start, max(end - start, 0));
+    }
+
+    last = reg;
+}
+
+// Yanks lines from row into register name.
+void YankLines(char name, int row, int count)
+{
+    Range r = {.mode = SELECT_LINE, .startRow = row, .endRow = min(row + count, curBuffer->numLines) - 1};
+    Yank(name, r);
+}
+
+// Deletes the block range as one undo record.
+static void deleteBlock(Range r)
+{
+    Buffer *b = curBuffer;
+    int count = r.endRow - r.startRow + 1;
+    CursorPos *pos = MemAlloc(count * sizeof(CursorPos));
+    int *counts = MemAlloc(count * sizeof(int));
+    AssertNotNull(pos);
+    AssertNotNull(counts);
+
+    undoBuf.length = 0;
+    for (int i = 0; i < count; i++)
+    {
+        int row = r.startRow + i;
+        Line *line = &b->lines[row];
+        int start = min(r.startCol, line->length);
+        int end = min(r.endCol, line->length);
+
+        pos[i] = (CursorPos){row, end};
+        counts[i] = end - start;
+        if (counts[i] == 0)
+            continue;
+
+        // Entries as in rum/multi.c, one per row so nothing shifts
+        int length = counts[i];
+        scratchAppend(&undoBuf, &row, sizeof(int));
+        scratchAppend(&undoBuf, &start, sizeof(int));
+        scratchAppend(&undoBuf, &length, sizeof(int));
+        scratchAppend(&undoBuf, line->chars + start, length);
+    }
+
+    if (undoBuf.length > 0)
+    {
+        UndoSaveActionEx(A_DELETE_MANY, r.startRow, r.startCol, undoBuf.text, undoBuf.length);
+        BufferDeleteMany(b, pos, counts, count);
+    }
+
+    MemFree(pos);
+    MemFree(counts);
+}
+
+// Yanks range into register name and deletes it as one undo step.
+void DeleteRange(char name, Range r)
+{
+    Buffer *b = curBuffer;
+    if (b->readOnly)
+        return;
+
+    Yank(name, r);
+    UndoSaveActionEx(A_CURSOR, curRow, curCol, "", 0);
+    int records = 1;
+
+    switch (r.mode)
+    {
+    case SELECT_LINE:
+    {
+        int count = r.endRow - r.startRow + 1;
+        if (count == b->numLines)
+        {
+            // The last line is emptied, not removed
+            records += deleteLines(1, count - 1);
+            lineBuf.length = 0;
+            replaceLine(0);
+            records++;
+        }
+        else
+            records += deleteLines(r.startRow, count);
+
+        CursorSetPos(b, 0, r.startRow, false);
+    }
+    break;
+
+    case SELECT_CHAR:
+    {
+        if (r.startRow == r.endRow)
+        {
+            int length = r.endCol - r.startCol;
+            if (length > 0)
+            {
+                UndoSaveActionEx(A_DELETE, r.startRow, r.startCol, b->lines[r.startRow].chars + r.startCol, length);
+                BufferDeleteEx(b, r.startRow, r.endCol, length);
+                records++;
+            }
+        }
+        else
+        {
+            // First line up to the start joined with last line after the end
+            Line *first = &b->lines[r.startRow];
+            Line *end = &b->lines[r.endRow];
+            lineBuf.length = 0;
+            scratchAppend(&lineBuf, first->chars, r.startCol);
+            scratchAppend(&lineBuf, end->chars + r.endCol, end->length - r.endCol);
+
+            records += deleteLines(r.startRow + 1, r.endRow - r.startRow);
+            replaceLine(r.startRow);
+            records++;
+        }
+
+        CursorSetPos(b, r.startCol, r.startRow, false);
+    }
+    break;
+
+    case SELECT_BLOCK:
+    {
+        deleteBlock(r);
+        records++;
+        CursorSetPos(b, r.startCol, r.startRow, false);
+    }
+    break;
+
+    default:
+        break;
+    }
+
+    UndoJoin(records);
+}
+
+// Like DeleteRange, but whole lines are replaced by one line with the indent
+// of the first, where the cursor is left for typing.
+void ChangeRange(char name, Range r)
+{
+    Buffer *b = curBuffer;
+    if (r.mode != SELECT_LINE)
+    {
+        DeleteRange(name, r);
+        return;
+    }
+
+    if (b->readOnly)
+        return;
+
+    Yank(name, r);
+    UndoSaveActionEx(A_CURSOR, curRow, curCol, "", 0);
+    int records = 1 + deleteLines(r.startRow + 1, r.endRow - r.startRow);
+
+    Line *first = &b->lines[r.startRow];
+    int indent = 0;
+    while (indent < first->length && first->chars[indent] == ' ')
+        indent++;
+
+    lineBuf.length = 0;
+    scratchAppend(&lineBuf, first->chars, indent);
+    replaceLine(r.startRow);
+    records++;
+
+    CursorSetPos(b, indent, r.startRow, false);
+    UndoJoin(records);
+}
+
+// Puts register name after the cursor, or before it if before is true.
+void Put(char name, bool before)
+{
+    Buffer *b = curBuffer;
+    Register *reg = getRegister(name, false);
+    if (b->readOnly || reg->numLines == 0)
+        return;
+
+    UndoSaveActionEx(A_CURSOR, curRow, curCol, "", 0);
+    int records = 2;
+    int row = curRow;
+    int col = before ? curCol : min(curCol + 1, curLine.length);
+
+    switch (reg->mode)
+    {
+    case SELECT_LINE:
+    {
+        // The buffer takes a reference to the text of every line
+        for (int i = 0; i < reg->numLines; i++)
+            LineShare(reg->lines[i].chars);
+
+        row = before ? curRow : curRow + 1;
+        insertLines(row, reg->lines, reg->numLines);
+        CursorSetPos(b, 0, row, false);
+    }
+    break;
+
+    case SELECT_CHAR:
+    {
+        Line *first = &reg->lines[0];
+        if (reg->numLines == 1)
+        {
+            BufferWriteEx(b, row, col, first->chars, first->length);
+            UndoSaveActionEx(A_WRITE, row, col, first->chars, first->length);
+            CursorSetPos(b, col + max(first->length - 1, 0), row, false);
+            break;
+        }
+
+        // Middle lines are shared, the last one gets the rest of the line
+        int count = reg->numLines - 1;
+        Line *lines = MemAlloc(count * sizeof(Line));
+        AssertNotNull(lines);
+
+        for (int i = 0; i < count - 1; i++)
+        {
+            lines[i] = reg->lines[i + 1];
+            LineShare(lines[i].chars);
+        }
+
+        Line *line = &b->lines[row];
+        Line *end = &reg->lines[count];
+        lineBuf.length = 0;
+        scratchAppend(&lineBuf, end->chars, end->length);
+        scratchAppend(&lineBuf, line->chars + col, line->length - col);
+        lines[count - 1] = copyLine(lineBuf.text, lineBuf.length);
+
+        lineBuf.length = 0;
+        scratchAppend(&lineBuf, line->chars, col);
+        scratchAppend(&lineBuf, first->chars, first->length);
+        replaceLine(row);
+        insertLines(row + 1, lines, count);
+        MemFree(lines);
+
+        records++;
+        CursorSetPos(b, col, row, false);
+    }
+    break;
+
+    case SELECT_BLOCK:
+    {
+        // Add empty lines if the block goes past the end
+        int missing = row + reg->numLines - b->numLines;
+        if (missing > 0)
+        {
+            Line *lines = MemAlloc(missing * sizeof(Line));
+            AssertNotNull(lines);
+            for (int i = 0; i < missing; i++)
+                lines[i] = copyLine("", 0);
+
+            insertLines(b->numLines, lines, missing);
+            MemFree(lines);
+            records++;
+        }
+
+        // Every line is rebuilt once and saved in one replace record
+        Scratch rep = {0};
+        for (int i = 0; i < reg->numLines; i++)
+        {
+            int r = row + i;
+            Line *line = &b->lines[r];
+            Line *text = &reg->lines[i];
+            int split = min(col, line->length);
+
+            lineBuf.length = 0;
+            scratchAppend(&lineBuf, line->chars, split);
+            scratchPad(&lineBuf, col - split);
+            scratchAppend(&lineBuf, text->chars, text->length);
+            scratchAppend(&lineBuf, line->chars + split, line->length - split);
+
+            scratchAppend(&rep, &r, sizeof(int));
+            scratchAppend(&rep, &line->length, sizeof(int));
+            scratchAppend(&rep, line->chars, line->length);
+            scratchAppend(&rep, &lineBuf.length, sizeof(int));
+            scratchAppend(&rep, lineBuf.text, lineBuf.length);
+
+            BufferReplaceLine(b, r, lineBuf.text, lineBuf.length);
+        }
+
+        UndoSaveActionEx(A_REPLACE, row, col, rep.text, rep.length);
+        MemFree(rep.text);
+        CursorSetPos(b, col, row, false);
+    }
+    break;
+
+    default:
+        break;
+    }
+
+    UndoJoin(records);
+}
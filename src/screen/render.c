@@ -5,6 +5,8 @@ extern Colors colors;
 
 char errorMsg[256];
 bool hasError = false;
+char infoMsg[256];
+bool hasInfo = false;
 
 // Sets status bar info. Passing NULL for filename will leave the current one.
 // Passing NULL for error will remove the current error. Call Render to update.
@@ -16,6 +18,16 @@ void SetStatus(char *filename, char *error)
     hasError = error != NULL;
 }
 
+// Sets message shown on the command line when there is no error. Passing NULL
+// removes it. Call Render to update.
+void SetStatusInfo(char *info)
+{
+    if (info != NULL)
+        strncpy(infoMsg, info, sizeof(infoMsg) - 1);
+
+    hasInfo = info != NULL;
+}
+
 static void drawStatusLine(CharBuf *buf)
 {
     // Draw status line and command line
@@ -24,6 +36,19 @@ static void drawStatusLine(CharBuf *buf)
         CbAppend(buf, "EDIT", 4);
     else if (editor.mode == MODE_INSERT)
         CbAppend(buf, "INSERT", 6);
+    else if (editor.mode == MODE_VISUAL && curBuffer->selectMode == SELECT_LINE)
+        CbAppend(buf, "V-LINE", 6);
+    else if (editor.mode == MODE_VISUAL && curBuffer->selectMode == SELECT_BLOCK)
+        CbAppend(buf, "V-BLOCK", 7);
+    else if (editor.mode == MODE_VISUAL)
+        CbAppend(buf, "VISUAL", 6);
+
+    char reg = MacroRecording();
+    if (reg != 0)
+    {
+        char rec[4] = {' ', '@', reg, 0};
+        CbAppend(buf, rec, 3);
+    }
 
     CbColor(buf, colors.bg1, colors.fg0);
     CbAppend(buf, " ", 1);
@@ -46,6 +71,47 @@ static void drawStatusLine(CharBuf *buf)
         CbAppend(buf, "[empty]", 7);
 
     CbColor(buf, colors.bg1, colors.fg0);
+
+    if (editor.numBuffers > 1)
+    {
+        char pos[32];
+        sprintf(pos, " [%d/%d]", editor.activeBuffer + 1, editor.numBuffers);
+        CbAppend(buf, pos, strlen(pos));
+    }
+
+    // Match count, right aligned. After large edits the count from before them
+    // is shown, marked with ~, until the next n/N rebuilds the index.
+    Buffer *b = curBuffer;
+    if (b->hlSearch && b->search.length > 0 && (b->matches.valid || b->matches.stale))
+    {
+        char total[16], current[16], count[64];
+        int i = -1;
+
+        if (b->matches.valid)
+        {
+            MatchIndexUpdate(b);
+            StrFormatInt(total, b->matches.numMatches);
+            i = MatchIndexAt(b, b->cursor.row, b->cursor.col);
+        }
+        else
+            StrFormatInt(total, b->matches.staleCount);
+
+        if (i != -1)
+        {
+            StrFormatInt(current, i + 1);
+            sprintf(count, "match %s of %s ", current, total);
+        }
+        else
+            sprintf(count, "%s%s matches ", b->matches.valid ? "" : "~", total);
+
+        int length = strlen(count);
+        int pad = editor.width - buf->lineLength - length;
+        for (int j = 0; j < pad; j++)
+            CbAppend(buf, " ", 1);
+        if (pad >= 0)
+            CbAppend(buf, count, length);
+    }
+
     CbNextLine(buf);
 
     // Command line
@@ -57,12 +123,16 @@ static void drawStatusLine(CharBuf *buf)
         CbAppend(buf, "error: ", 7);
         CbAppend(buf, errorMsg, strlen(errorMsg));
     }
+    else if (hasInfo)
+        CbAppend(buf, infoMsg, strlen(infoMsg));
 
     CbNextLine(buf);
     CbColorReset(buf);
 }
 
-static void drawWelcomeScreen(CharBuf *buf)
+// Appends row y of the welcome screen to buf. Returns false if the row has no
+// welcome text.
+static bool drawWelcomeLine(CharBuf *buf, int y)
 {
     char *lines[] = {
         TITLE,
@@ -74,46 +144,50 @@ static void drawWelcomeScreen(CharBuf *buf)
     };
 
     int numlines = sizeof(lines) / sizeof(lines[0]);
-    int y = editor.height / 2 - numlines / 2;
-
-    ScreenColor(colors.bg0, colors.blue);
-
-    for (int i = 0; i < numlines; i++)
-    {
-        if (i == 1)
-            ScreenFg(colors.fg0);
-        if (i == 2)
-            ScreenFg(colors.gray);
-
-        char *text = lines[i];
-        int pad = editor.width / 2 - strlen(text) / 2;
-        ScreenWriteAt(pad, y + i, text);
-    }
+    int i = y - (editor.height / 2 - numlines / 2);
+    if (i < 0 || i >= numlines)
+        return false;
+
+    char *fg = i == 0 ? colors.blue : i == 1 ? colors.fg0 : colors.gray;
+    CbColor(buf, colors.bg0, fg);
+
+    char *text = lines[i];
+    int length = min((int)strlen(text), editor.width);
+    int pad = max(editor.width / 2 - length / 2, 0);
+    for (int j = 0; j < pad; j++)
+        CbAppend(buf, " ", 1);
+    CbAppend(buf, text, length);
+    CbNextLine(buf);
+    return true;
 }
 
-// Renders everything to the terminal. Sets cursor position. Shows welcome screen.
+// Renders everything to the terminal in one write. Sets cursor position. Shows
+// welcome screen.
 void Render()
 {
     if (editor.hbuffer == INVALID_HANDLE_VALUE)
         Error("Render called before csb init");
+    if (editor.replaying)
+        return;
 
-    BufferRender(curBuffer, 0, editor.height - 2);
+    int height = editor.height - 2;
+    ViewLayout(editor.width, height);
+
+    // Show welcome screen on empty buffers
+    bool welcome = ViewCount(NULL) == 1 && !curBuffer->dirty && !curBuffer->isFile;
 
     CharBuf buf = CbNew(editor.renderBuffer);
+    for (int y = 0; y < height; y++)
+    {
+        buf.lineLength = 0; // Rows are always full width
+        if (!welcome || !drawWelcomeLine(&buf, y))
+            ViewRenderRow(&buf, y);
+    }
 
     // Draw status line and command line
+    buf.lineLength = 0;
     drawStatusLine(&buf);
+    CbRender(&buf, 0, 0);
 
-    // Show welcome screen on empty buffers
-    if (!curBuffer->dirty && !curBuffer->isFile)
-        drawWelcomeScreen(&buf);
-
-    CbRender(&buf, 0, editor.height - 2);
-
-    // Set cursor pos
-    COORD pos = {
-        .X = curBuffer->cursor.col - curBuffer->cursor.offx + curBuffer->padX, //+ curBuffer->x,
-        .Y = curBuffer->cursor.row - curBuffer->cursor.offy + curBuffer->padY, // + curBuffer->y,
-    };
-    SetConsoleCursorPosition(editor.hbuffer, pos);
-}
\ No newline at end of file
+    SetConsoleCursorPosition(editor.hbuffer, ViewCursorPos());
+}
@@ -90,6 +90,11 @@ void UiFreeResult(UiResult res)
 }
 
 UiResult UiGetTextInput(char *prompt, int maxSize)
+{
+    return UiGetTextInputEx(prompt, maxSize, NULL);
+}
+
+UiResult UiGetTextInputEx(char *prompt, int maxSize, void (*onChange)(char *text, int length))
 {
     char cbuf[1024];
     CharBuf buf = CbNew(cbuf);
@@ -130,17 +135,20 @@ UiResult UiGetTextInput(char *prompt, int maxSize)
 
         case K_BACKSPACE:
         {
-            if (res.length > 0)
-                res.buffer[--res.length] = 0;
+            if (res.length == 0)
+                continue;
+            res.buffer[--res.length] = 0;
             break;
         }
 
         default:
             char c = info.asciiChar;
-            if (c < 32 || c > 126)
+            if (c < 32 || c > 126 || res.length >= maxSize - 1) // -1 to leave room for NULL
                 continue;
-            if (res.length < maxSize - 1) // -1 to leave room for NULL
-                res.buffer[res.length++] = c;
+            res.buffer[res.length++] = c;
         }
+
+        if (onChange != NULL)
+            onChange(res.buffer, res.length);
     }
 }
\ No newline at end of file
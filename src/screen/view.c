@@ -0,0 +1,335 @@
+// Views. The text area is split into views laid out as a binary tree: every
+// node is either a view or a split of its rectangle into two, stacked or side
+// by side. The active view always shows the current buffer and keeps its cursor
+// in it, so the rest of the editor only deals with curBuffer. Other views keep
+// their own buffer and cursor, which are swapped in when they become active.
+// All views are drawn row by row into one frame, so the screen is written once.
+
+#include "rum.h"
+
+extern Editor editor;
+extern Colors colors;
+
+#define VIEW_MAX 16       // Views on screen at once
+#define VIEW_MIN_WIDTH 16 // Smallest view made by a split
+#define VIEW_MIN_HEIGHT 2
+
+typedef struct Layout
+{
+    bool used;
+    int parent;        // -1 for the root
+    int first, second; // Children, -1 if the node is a view
+    bool vertical;     // Children are side by side, else stacked
+    View view;         // Rectangle of the node, and the view if it is one
+} Layout;
+
+static Layout nodes[VIEW_MAX * 2] = {{.used = true, .parent = -1, .first = -1, .second = -1}};
+static int root = 0;
+static int active = 0; // Node of the active view
+static int numViews = 1;
+
+static Range selection; // Selection of the active view while drawing
+
+static bool isView(int node)
+{
+    return nodes[node].first == -1;
+}
+
+static Buffer *viewBuffer(int node)
+{
+    return node == active ? curBuffer : nodes[node].view.buffer;
+}
+
+static Cursor *viewCursor(int node)
+{
+    return node == active ? &curBuffer->cursor : &nodes[node].view.cursor;
+}
+
+// Returns an unused node, -1 if there is none.
+static int newNode()
+{
+    for (int i = 0; i < VIEW_MAX * 2; i++)
+    {
+        if (!nodes[i].used)
+        {
+            nodes[i] = (Layout){.used = true, .first = -1, .second = -1};
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+// Sets the rectangle of node and its children. The first child gets the
+// smaller half, one column or row between them is used by the separator.
+static void layout(int node, int x, int y, int width, int height)
+{
+    Layout *n = &nodes[node];
+    n->view.x = x;
+    n->view.y = y;
+    n->view.width = width;
+    n->view.height = height;
+    if (isView(node))
+        return;
+
+    if (n->vertical)
+    {
+        int w = (width - 1) / 2;
+        layout(n->first, x, y, w, height);
+        layout(n->second, x + w + 1, y, width - w - 1, height);
+    }
+    else
+    {
+        int h = (height - 1) / 2;
+        layout(n->first, x, y, width, h);
+        layout(n->second, x, y + h + 1, width, height - h - 1);
+    }
+}
+
+// Writes the views in screen order to dest. Returns the number written.
+static int listViews(int node, int *dest)
+{
+    if (isView(node))
+    {
+        *dest = node;
+        return 1;
+    }
+
+    int count = listViews(nodes[node].first, dest);
+    return count + listViews(nodes[node].second, dest + count);
+}
+
+// Keeps the cursor of a view inside its buffer and on screen. The buffer may
+// have been changed in another view.
+static void clampCursor(Buffer *b, Cursor *c, int textW, int textH)
+{
+    textH = max(textH, 1);
+    c->row = max(min(c->row, b->numLines - 1), 0);
+    c->col = min(c->col, b->lines[c->row].length);
+
+    if (c->offy > c->row)
+        c->offy = c->row;
+    else if (c->row - c->offy >= textH)
+        c->offy = c->row - textH + 1;
+
+    c->offx = max(c->col - textW + c->scrollDx, 0);
+}
+
+// Makes node the active view, showing its buffer with its cursor.
+static void show(int node)
+{
+    View *v = &nodes[node].view;
+    active = node;
+    EditorShowBuffer(EditorBufferIndex(v->buffer));
+    curBuffer->cursor = v->cursor;
+}
+
+// Makes node the active view, keeping the buffer and cursor of the current one.
+static void focus(int node)
+{
+    if (node == active)
+        return;
+
+    if (editor.mode == MODE_VISUAL)
+        EditorSetMode(MODE_VIM);
+
+    View *v = &nodes[active].view;
+    v->buffer = curBuffer;
+    v->cursor = curBuffer->cursor;
+    show(node);
+}
+
+// Splits the active view in two showing the same buffer, side by side if
+// vertical is true. The new view above or left of the other is active.
+// Returns false if there is no room for another view.
+bool ViewSplit(bool vertical)
+{
+    Layout *n = &nodes[active];
+    int size = vertical ? n->view.width : n->view.height;
+    int minSize = vertical ? VIEW_MIN_WIDTH : VIEW_MIN_HEIGHT;
+    if (numViews == VIEW_MAX || size < minSize * 2 + 1)
+        return false;
+
+    int first = newNode();
+    int second = newNode();
+    nodes[first].parent = active;
+    nodes[second].parent = active;
+    nodes[second].view.buffer = curBuffer;
+    nodes[second].view.cursor = curBuffer->cursor;
+
+    n->first = first;
+    n->second = second;
+    n->vertical = vertical;
+    active = first;
+    numViews++;
+    return true;
+}
+
+// Closes the active view, its space goes to the view next to it. Returns false
+// if it is the only view.
+bool ViewClose()
+{
+    if (numViews == 1)
+        return false;
+
+    if (editor.mode == MODE_VISUAL)
+        EditorSetMode(MODE_VIM);
+
+    int parent = nodes[active].parent;
+    Layout *p = &nodes[parent];
+    int sibling = p->first == active ? p->second : p->first;
+
+    // The sibling takes the place of the parent
+    int grandparent = p->parent;
+    *p = nodes[sibling];
+    p->parent = grandparent;
+    if (!isView(parent))
+    {
+        nodes[p->first].parent = parent;
+        nodes[p->second].parent = parent;
+    }
+
+    nodes[active].used = false;
+    nodes[sibling].used = false;
+    numViews--;
+
+    int node = parent;
+    while (!isView(node))
+        node = nodes[node].first;
+    show(node);
+    return true;
+}
+
+// Makes the next view in screen order active, wrapping around.
+void ViewFocusNext()
+{
+    int views[VIEW_MAX];
+    int count = listViews(root, views);
+    for (int i = 0; i < count; i++)
+    {
+        if (views[i] == active)
+        {
+            focus(views[(i + 1) % count]);
+            return;
+        }
+    }
+}
+
+// Returns the number of views showing b, or all views if b is NULL.
+int ViewCount(Buffer *b)
+{
+    if (b == NULL)
+        return numViews;
+
+    int views[VIEW_MAX];
+    int count = listViews(root, views);
+    int shown = 0;
+    for (int i = 0; i < count; i++)
+        shown += viewBuffer(views[i]) == b;
+    return shown;
+}
+
+// Shows the current buffer in the views showing b. Must be called when b is
+// removed from the buffer list.
+void ViewBufferRemoved(Buffer *b)
+{
+    for (int i = 0; i < VIEW_MAX * 2; i++)
+    {
+        View *v = &nodes[i].view;
+        if (nodes[i].used && isView(i) && i != active && v->buffer == b)
+        {
+            v->buffer = curBuffer;
+            v->cursor = curBuffer->cursor;
+        }
+    }
+}
+
+// Lays out the views in the text area of width and height and brings their
+// cursors up to date. Must be called before drawing rows.
+void ViewLayout(int width, int height)
+{
+    layout(root, 0, 0, width, height);
+
+    selection = (Range){.mode = SELECT_NONE};
+    if (editor.mode == MODE_VISUAL && curBuffer->selectMode != SELECT_NONE)
+        selection = SelectRange();
+
+    int views[VIEW_MAX];
+    int count = listViews(root, views);
+    for (int i = 0; i < count; i++)
+    {
+        View *v = &nodes[views[i]].view;
+        Buffer *b = viewBuffer(views[i]);
+        clampCursor(b, viewCursor(views[i]), v->width - b->padX, v->height - b->padY);
+    }
+
+    // Scrolling while editing follows the active view
+    curBuffer->textH = nodes[active].view.height - curBuffer->padY;
+}
+
+// Appends the bar below the first child of a stacked split, showing the name
+// of the buffer above it.
+static void renderBar(CharBuf *cb, int node, int width)
+{
+    char name[MAX_PATH + 8] = "";
+    int length = 0;
+    if (isView(node))
+    {
+        Buffer *b = viewBuffer(node);
+        length = snprintf(name, sizeof(name), " %s%s", b->filepath[0] != 0 ? b->filepath : "[empty]",
+                          b->dirty && b->isFile ? "*" : "");
+    }
+
+    CbColor(cb, colors.bg1, node == active ? colors.yellow : colors.fg0);
+    length = min(length, width);
+    CbAppend(cb, name, length);
+    for (int i = length; i < width; i++)
+        CbAppend(cb, " ", 1);
+}
+
+static void renderRow(CharBuf *cb, int node, int y)
+{
+    Layout *n = &nodes[node];
+    if (n->view.width <= 0)
+        return;
+
+    if (isView(node))
+    {
+        Range none = {.mode = SELECT_NONE};
+        Range *sel = node == active ? &selection : &none;
+        BufferRenderRow(viewBuffer(node), viewCursor(node), cb, y - n->view.y, n->view.width, sel);
+        return;
+    }
+
+    View *first = &nodes[n->first].view;
+    if (n->vertical)
+    {
+        renderRow(cb, n->first, y);
+        CbColor(cb, colors.bg1, colors.fg0);
+        CbAppend(cb, " ", 1);
+        renderRow(cb, n->second, y);
+    }
+    else if (y < first->y + first->height)
+        renderRow(cb, n->first, y);
+    else if (y == first->y + first->height)
+        renderBar(cb, n->first, n->view.width);
+    else
+        renderRow(cb, n->second, y);
+}
+
+// Appends row y of the text area, with every view and separator on it, to cb.
+void ViewRenderRow(CharBuf *cb, int y)
+{
+    renderRow(cb, root, y);
+}
+
+// Returns the screen position of the cursor in the active view.
+COORD ViewCursorPos()
+{
+    View *v = &nodes[active].view;
+    Cursor *c = &curBuffer->cursor;
+    return (COORD){
+        .X = v->x + c->col - c->offx + curBuffer->padX,
+        .Y = v->y + c->row - c->offy + curBuffer->padY,
+    };
+}
@@ -75,6 +75,9 @@ void CbColorReset(CharBuf *buf)
 // Prints buffer at x, y with accumulated length only.
 void CbRender(CharBuf *buf, int x, int y)
 {
+    if (editor.replaying)
+        return;
+
     CursorHide();
     CursorTempPos(x, y);
     ScreenWrite(buf->buffer, buf->pos - buf->buffer);
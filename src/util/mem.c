@@ -12,10 +12,14 @@ void *MemZeroAlloc(int size)
 
 void *MemRealloc(void *ptr, int newSize)
 {
+    // HeapReAlloc does not accept NULL
+    if (ptr == NULL)
+        return MemZeroAlloc(newSize);
     return HeapReAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, ptr, newSize);
 }
 
 void MemFree(void *ptr)
 {
-    HeapFree(GetProcessHeap(), 0, ptr);
+    if (ptr != NULL)
+        HeapFree(GetProcessHeap(), 0, ptr);
 }
\ No newline at end of file
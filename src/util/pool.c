@@ -0,0 +1,154 @@
+// Worker pool for splitting work across cores. A job is a number of tasks which
+// are claimed one at a time by the workers, so tasks should be coarse, eg. a
+// chunk of lines. Jobs run in the order they were started.
+
+#include "rum.h"
+
+#define POOL_MAX_WORKERS 32
+
+struct PoolJob
+{
+    PoolFunc fn;
+    void *arg;
+    int count;
+    int next;           // Next task to claim
+    volatile LONG done; // Number of finished tasks
+    volatile LONG cancel;
+    HANDLE finished;
+    PoolJob *nextJob;
+};
+
+static struct
+{
+    CRITICAL_SECTION lock;
+    HANDLE wake; // Semaphore, released once per worker when a job is added
+    PoolJob *head, *tail;
+    int numWorkers;
+} pool;
+
+// Claims the next task of the first job with tasks left. Jobs are removed from
+// the queue once all their tasks are claimed. Returns NULL if the queue is empty.
+static PoolJob *claimTask(int *index)
+{
+    EnterCriticalSection(&pool.lock);
+
+    PoolJob *job = pool.head;
+    if (job != NULL)
+    {
+        *index = job->next++;
+        if (job->next == job->count)
+        {
+            pool.head = job->nextJob;
+            if (pool.head == NULL)
+                pool.tail = NULL;
+        }
+    }
+
+    LeaveCriticalSection(&pool.lock);
+    return job;
+}
+
+static DWORD WINAPI worker(LPVOID param)
+{
+    int id = (int)(intptr_t)param;
+
+    while (true)
+    {
+        WaitForSingleObject(pool.wake, INFINITE);
+
+        PoolJob *job;
+        int index;
+        while ((job = claimTask(&index)) != NULL)
+        {
+            if (!job->cancel)
+                job->fn(job->arg, index, id);
+
+            // The job may be freed as soon as the last task is done
+            if (InterlockedIncrement(&job->done) == job->count)
+                SetEvent(job->finished);
+        }
+    }
+
+    return 0;
+}
+
+// Starts one worker per logical processor. Must be called before any other pool
+// function.
+void PoolInit()
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    pool.numWorkers = max(1, min((int)info.dwNumberOfProcessors, POOL_MAX_WORKERS));
+
+    InitializeCriticalSection(&pool.lock);
+    pool.wake = CreateSemaphoreA(NULL, 0, INT_MAX, NULL);
+    if (pool.wake == NULL)
+        Error("failed to create worker pool");
+
+    for (int i = 0; i < pool.numWorkers; i++)
+        if (CreateThread(NULL, 0, worker, (LPVOID)(intptr_t)i, 0, NULL) == NULL)
+            Error("failed to start worker thread");
+}
+
+// Returns number of workers. Worker ids passed to tasks are less than this.
+int PoolSize()
+{
+    return pool.numWorkers;
+}
+
+// Runs fn(arg, index, worker) for each index in [0, count) on the workers.
+// Returns immediately. The job must be freed with PoolFinish.
+PoolJob *PoolStart(PoolFunc fn, void *arg, int count)
+{
+    PoolJob *job = MemZeroAlloc(sizeof(PoolJob));
+    AssertNotNull(job);
+    job->fn = fn;
+    job->arg = arg;
+    job->count = count;
+    job->finished = CreateEventA(NULL, TRUE, count == 0, NULL);
+
+    if (count == 0)
+        return job;
+
+    EnterCriticalSection(&pool.lock);
+    if (pool.tail != NULL)
+        pool.tail->nextJob = job;
+    else
+        pool.head = job;
+    pool.tail = job;
+    LeaveCriticalSection(&pool.lock);
+
+    ReleaseSemaphore(pool.wake, min(count, pool.numWorkers), NULL);
+    return job;
+}
+
+// Waits up to ms milliseconds for job to finish. Returns true if it finished.
+bool PoolWait(PoolJob *job, int ms)
+{
+    return WaitForSingleObject(job->finished, ms) == WAIT_OBJECT_0;
+}
+
+// Returns the number of tasks finished, including skipped ones.
+int PoolProgress(PoolJob *job)
+{
+    return job->done;
+}
+
+// Makes workers skip tasks that have not started yet.
+void PoolCancel(PoolJob *job)
+{
+    InterlockedExchange(&job->cancel, 1);
+}
+
+bool PoolCanceled(PoolJob *job)
+{
+    return job->cancel;
+}
+
+// Waits for job to finish and frees it.
+void PoolFinish(PoolJob *job)
+{
+    PoolWait(job, INFINITE);
+    CloseHandle(job->finished);
+    MemFree(job);
+}
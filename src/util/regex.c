@@ -0,0 +1,1033 @@
+// Regular expressions for search. Patterns are parsed into a small tree and
+// compiled into a Thompson NFA. A line is first checked for the longest literal
+// every match must contain, then run through a DFA which is built lazily from
+// the NFA and cached between calls. Only lines the DFA accepts are run through a
+// Pike VM to get the exact match position. Matching is always linear in the
+// length of the line, there is no backtracking.
+//
+// Matches are leftmost-longest. Supported syntax: . [] [^] * + ? {n} {n,} {n,m}
+// | () ^ $ and the escapes \d \w \s \D \W \S \t and \ followed by any symbol.
+
+#include "rum.h"
+
+#define REGEX_MAX_REPEAT 64 // Max count in {n,m}
+#define REGEX_MAX_INST 4096 // Max number of NFA instructions
+#define DFA_MAX_STATES 512  // States kept in the DFA cache before it is flushed
+#define DFA_TABLE_SIZE 1024 // Hash table size, power of two > DFA_MAX_STATES
+
+typedef struct ByteSet
+{
+    uint32_t bits[8];
+} ByteSet;
+
+#define setHas(s, c) ((s)->bits[(unsigned char)(c) >> 5] & (1u << ((unsigned char)(c) & 31)))
+#define setAdd(s, c) ((s)->bits[(unsigned char)(c) >> 5] |= (1u << ((unsigned char)(c) & 31)))
+
+typedef enum Op
+{
+    OP_SET,   // Consume byte in set
+    OP_SPLIT, // Continue at both x and y
+    OP_JMP,   // Continue at x
+    OP_BOL,   // Assert beginning of line
+    OP_EOL,   // Assert end of line
+    OP_MATCH,
+} Op;
+
+typedef struct Inst
+{
+    Op op;
+    int x, y;
+    int set; // Index in sets for OP_SET
+} Inst;
+
+typedef enum NodeType
+{
+    N_EMPTY,
+    N_SET,
+    N_CAT,
+    N_ALT,
+    N_REPEAT,
+    N_BOL,
+    N_EOL,
+} NodeType;
+
+typedef struct Node
+{
+    NodeType type;
+    int set;      // N_SET
+    int min, max; // N_REPEAT, max is -1 for no limit
+    struct Node *left, *right;
+} Node;
+
+typedef struct DfaState
+{
+    int *pcs; // Sorted NFA pcs after closure: OP_SET, OP_EOL and OP_MATCH only
+    int numPcs;
+    bool match;
+    int acceptsEol; // -1 if not computed yet
+    int next[256];  // Cached transitions, -1 if not computed yet
+} DfaState;
+
+typedef struct Dfa
+{
+    DfaState *states;
+    int numStates;
+    int table[DFA_TABLE_SIZE]; // State index + 1, 0 is empty
+    int startBol, startMid;    // Start states at and after line begin, -1 if none
+} Dfa;
+
+typedef struct Thread
+{
+    int pc;
+    int start;
+} Thread;
+
+struct Regex
+{
+    Inst *prog;
+    int numInst;
+    ByteSet *sets;
+    int numSets;
+
+    Search literal; // Literal all matches contain, length 0 if none
+    Dfa *dfa;
+    bool shared; // Program is owned by another Regex, see RegexClone
+
+    // Scratch space for closures and the Pike VM
+    int *stack;
+    int *mark;
+    int gen;
+    Thread *clist, *nlist;
+};
+
+typedef struct Parser
+{
+    Regex *re;
+    char *src;
+    int length;
+    int pos;
+    Node *nodes;
+    int numNodes;
+    int maxNodes;
+    bool failed;
+} Parser;
+
+static Node *newNode(Parser *p, NodeType type)
+{
+    if (p->numNodes >= p->maxNodes)
+    {
+        p->failed = true;
+        return &p->nodes[0];
+    }
+
+    Node *n = &p->nodes[p->numNodes++];
+    *n = (Node){.type = type};
+    return n;
+}
+
+static int newSet(Regex *re)
+{
+    re->sets = MemRealloc(re->sets, (re->numSets + 1) * sizeof(ByteSet));
+    AssertNotNull(re->sets);
+    memset(&re->sets[re->numSets], 0, sizeof(ByteSet));
+    return re->numSets++;
+}
+
+static void addRange(ByteSet *set, int from, int to)
+{
+    for (int c = from; c <= to; c++)
+        setAdd(set, c);
+}
+
+// Adds class escape like \d to set. Returns false if c is not a class.
+static bool addClassEscape(ByteSet *set, char c)
+{
+    ByteSet class = {0};
+
+    switch (tolower(c))
+    {
+    case 'd':
+        addRange(&class, '0', '9');
+        break;
+    case 'w':
+        addRange(&class, '0', '9');
+        addRange(&class, 'a', 'z');
+        addRange(&class, 'A', 'Z');
+        setAdd(&class, '_');
+        break;
+    case 's':
+        setAdd(&class, ' ');
+        setAdd(&class, '\t');
+        setAdd(&class, '\r');
+        setAdd(&class, '\n');
+        break;
+    default:
+        return false;
+    }
+
+    bool negate = isupper(c);
+    for (int i = 0; i < 8; i++)
+        set->bits[i] |= negate ? ~class.bits[i] : class.bits[i];
+    return true;
+}
+
+static char escapedChar(char c)
+{
+    return c == 't' ? '\t' : c == 'n' ? '\n' : c;
+}
+
+static Node *parseAlt(Parser *p);
+
+static bool atEnd(Parser *p)
+{
+    return p->pos >= p->length;
+}
+
+static Node *parseClass(Parser *p)
+{
+    Node *n = newNode(p, N_SET);
+    n->set = newSet(p->re);
+    ByteSet *set = &p->re->sets[n->set];
+
+    bool negate = !atEnd(p) && p->src[p->pos] == '^';
+    if (negate)
+        p->pos++;
+
+    bool first = true;
+    while (!atEnd(p) && (p->src[p->pos] != ']' || first))
+    {
+        first = false;
+        char c = p->src[p->pos++];
+
+        if (c == '\\')
+        {
+            if (atEnd(p))
+                break;
+            c = p->src[p->pos++];
+            if (addClassEscape(set, c))
+                continue;
+            c = escapedChar(c);
+        }
+
+        // Range like a-z
+        if (p->pos + 1 < p->length && p->src[p->pos] == '-' && p->src[p->pos + 1] != ']')
+        {
+            char to = p->src[p->pos + 1];
+            p->pos += 2;
+            if ((unsigned char)to < (unsigned char)c)
+                p->failed = true;
+            addRange(set, (unsigned char)c, (unsigned char)to);
+            continue;
+        }
+
+        setAdd(set, c);
+    }
+
+    if (atEnd(p))
+    {
+        p->failed = true; // Unterminated class
+        return n;
+    }
+
+    p->pos++; // ]
+    if (negate)
+        for (int i = 0; i < 8; i++)
+            set->bits[i] = ~set->bits[i];
+    return n;
+}
+
+static Node *parseAtom(Parser *p)
+{
+    char c = p->src[p->pos++];
+
+    switch (c)
+    {
+    case '(':
+    {
+        Node *n = parseAlt(p);
+        if (atEnd(p) || p->src[p->pos] != ')')
+            p->failed = true;
+        p->pos++;
+        return n;
+    }
+
+    case '[':
+        return parseClass(p);
+
+    case '^':
+        return newNode(p, N_BOL);
+
+    case '$':
+        return newNode(p, N_EOL);
+
+    case '*':
+    case '+':
+    case '?':
+    case ')':
+        p->failed = true; // Nothing to repeat or unmatched paren
+        return newNode(p, N_EMPTY);
+    }
+
+    Node *n = newNode(p, N_SET);
+    n->set = newSet(p->re);
+    ByteSet *set = &p->re->sets[n->set];
+
+    if (c == '.')
+        addRange(set, 0, 255);
+    else if (c == '\\')
+    {
+        if (atEnd(p))
+        {
+            p->failed = true;
+            return n;
+        }
+        c = p->src[p->pos++];
+        if (!addClassEscape(set, c))
+            setAdd(set, escapedChar(c));
+    }
+    else
+        setAdd(set, c);
+
+    return n;
+}
+
+// Parses number at current pos. Returns -1 if there is none.
+static int parseNumber(Parser *p)
+{
+    if (atEnd(p) || !isdigit(p->src[p->pos]))
+        return -1;
+
+    int n = 0;
+    while (!atEnd(p) && isdigit(p->src[p->pos]))
+    {
+        n = n * 10 + (p->src[p->pos++] - '0');
+        n = min(n, REGEX_MAX_REPEAT + 1);
+    }
+    return n;
+}
+
+static Node *parseRepeat(Parser *p)
+{
+    Node *atom = parseAtom(p);
+
+    while (!atEnd(p) && !p->failed)
+    {
+        char c = p->src[p->pos];
+        int lo, hi;
+
+        if (c == '*')
+            lo = 0, hi = -1;
+        else if (c == '+')
+            lo = 1, hi = -1;
+        else if (c == '?')
+            lo = 0, hi = 1;
+        else if (c == '{')
+        {
+            p->pos++;
+            lo = parseNumber(p);
+            hi = lo;
+            if (!atEnd(p) && p->src[p->pos] == ',')
+            {
+                p->pos++;
+                hi = parseNumber(p);
+            }
+            if (lo < 0 || atEnd(p) || p->src[p->pos] != '}' ||
+                lo > REGEX_MAX_REPEAT || hi > REGEX_MAX_REPEAT || (hi != -1 && hi < lo))
+            {
+                p->failed = true;
+                return atom;
+            }
+        }
+        else
+            break;
+
+        p->pos++;
+        Node *n = newNode(p, N_REPEAT);
+        n->left = atom;
+        n->min = lo;
+        n->max = hi;
+        atom = n;
+    }
+
+    return atom;
+}
+
+static Node *parseCat(Parser *p)
+{
+    Node *n = NULL;
+
+    while (!atEnd(p) && !p->failed && p->src[p->pos] != '|' && p->src[p->pos] != ')')
+    {
+        Node *next = parseRepeat(p);
+        if (n == NULL)
+            n = next;
+        else
+        {
+            Node *cat = newNode(p, N_CAT);
+            cat->left = n;
+            cat->right = next;
+            n = cat;
+        }
+    }
+
+    return n != NULL ? n : newNode(p, N_EMPTY);
+}
+
+static Node *parseAlt(Parser *p)
+{
+    Node *n = parseCat(p);
+
+    while (!atEnd(p) && !p->failed && p->src[p->pos] == '|')
+    {
+        p->pos++;
+        Node *alt = newNode(p, N_ALT);
+        alt->left = n;
+        alt->right = parseCat(p);
+        n = alt;
+    }
+
+    return n;
+}
+
+static int emit(Regex *re, Op op, int x, int y)
+{
+    if (re->numInst >= REGEX_MAX_INST)
+        return -1;
+
+    re->prog[re->numInst] = (Inst){.op = op, .x = x, .y = y};
+    return re->numInst++;
+}
+
+// Compiles node to NFA instructions. Returns false if the program gets too big.
+static bool compileNode(Regex *re, Node *n)
+{
+    switch (n->type)
+    {
+    case N_EMPTY:
+        return true;
+
+    case N_SET:
+    {
+        int pc = emit(re, OP_SET, 0, 0);
+        if (pc != -1)
+            re->prog[pc].set = n->set;
+        return pc != -1;
+    }
+
+    case N_BOL:
+        return emit(re, OP_BOL, 0, 0) != -1;
+
+    case N_EOL:
+        return emit(re, OP_EOL, 0, 0) != -1;
+
+    case N_CAT:
+        return compileNode(re, n->left) && compileNode(re, n->right);
+
+    case N_ALT:
+    {
+        int split = emit(re, OP_SPLIT, 0, 0);
+        if (split == -1 || !compileNode(re, n->left))
+            return false;
+        int jmp = emit(re, OP_JMP, 0, 0);
+        if (jmp == -1)
+            return false;
+        re->prog[split].x = split + 1;
+        re->prog[split].y = re->numInst;
+        if (!compileNode(re, n->right))
+            return false;
+        re->prog[jmp].x = re->numInst;
+        return true;
+    }
+
+    case N_REPEAT:
+    {
+        // Required copies first
+        for (int i = 0; i < n->min; i++)
+            if (!compileNode(re, n->left))
+                return false;
+
+        if (n->max == -1)
+        {
+            // Loop: split body, end; body; jmp split
+            int split = emit(re, OP_SPLIT, 0, 0);
+            if (split == -1 || !compileNode(re, n->left))
+                return false;
+            if (emit(re, OP_JMP, split, 0) == -1)
+                return false;
+            re->prog[split].x = split + 1;
+            re->prog[split].y = re->numInst;
+            return true;
+        }
+
+        // Optional copies
+        for (int i = n->min; i < n->max; i++)
+        {
+            int split = emit(re, OP_SPLIT, 0, 0);
+            if (split == -1 || !compileNode(re, n->left))
+                return false;
+            re->prog[split].x = split + 1;
+            re->prog[split].y = re->numInst;
+        }
+        return true;
+    }
+    }
+
+    return false;
+}
+
+// Returns the byte if node matches exactly one byte, else -1.
+static int singleByte(Regex *re, Node *n)
+{
+    if (n->type != N_SET)
+        return -1;
+
+    int found = -1;
+    for (int c = 0; c < 256; c++)
+    {
+        if (!setHas(&re->sets[n->set], c))
+            continue;
+        if (found != -1)
+            return -1;
+        found = c;
+    }
+    return found;
+}
+
+typedef struct Literal
+{
+    char chars[MAX_SEARCH];
+    int length;
+} Literal;
+
+static void keepLongest(Literal *best, Literal *l)
+{
+    if (l->length > best->length)
+        *best = *l;
+}
+
+// Flattens a tree of N_CAT nodes into list. Returns new count.
+static int flattenCat(Node *n, Node **list, int count, int cap)
+{
+    if (n->type == N_CAT)
+    {
+        count = flattenCat(n->left, list, count, cap);
+        return flattenCat(n->right, list, count, cap);
+    }
+    if (count < cap)
+        list[count++] = n;
+    return count;
+}
+
+// Returns the longest literal every match of node must contain.
+static Literal requiredLiteral(Regex *re, Node *n, Node **scratch, int cap)
+{
+    Literal best = {0};
+
+    switch (n->type)
+    {
+    case N_SET:
+    {
+        int c = singleByte(re, n);
+        if (c != -1)
+            best = (Literal){.chars = {c}, .length = 1};
+        break;
+    }
+
+    case N_REPEAT:
+        if (n->min > 0)
+            best = requiredLiteral(re, n->left, scratch, cap);
+        break;
+
+    case N_CAT:
+    {
+        // Longest run of single bytes in a row. Assertions are zero width so
+        // they do not break a run.
+        int count = flattenCat(n, scratch, 0, cap);
+        Literal run = {0};
+
+        for (int i = 0; i < count; i++)
+        {
+            Node *child = scratch[i];
+            if (child->type == N_BOL || child->type == N_EOL)
+                continue;
+
+            int c = singleByte(re, child);
+            if (c != -1 && run.length < MAX_SEARCH - 1)
+            {
+                run.chars[run.length++] = c;
+                continue;
+            }
+
+            keepLongest(&best, &run);
+            run.length = 0;
+
+            // Scratch is reused by the child so copy the rest out first
+            Node *rest[count - i];
+            memcpy(rest, scratch + i, (count - i) * sizeof(Node *));
+            Literal inner = requiredLiteral(re, child, scratch, cap);
+            keepLongest(&best, &inner);
+            memcpy(scratch + i, rest, (count - i) * sizeof(Node *));
+        }
+
+        keepLongest(&best, &run);
+        break;
+    }
+
+    default:
+        break;
+    }
+
+    return best;
+}
+
+// Allocates the DFA cache and scratch space used while matching.
+static void allocState(Regex *re)
+{
+    re->stack = MemAlloc((re->numInst * 2 + 2) * sizeof(int));
+    re->mark = MemZeroAlloc(re->numInst * sizeof(int));
+    re->clist = MemAlloc(max(re->numInst, 1) * sizeof(Thread));
+    re->nlist = MemAlloc(max(re->numInst, 1) * sizeof(Thread));
+    re->dfa = MemZeroAlloc(sizeof(Dfa));
+    AssertNotNull(re->stack);
+    AssertNotNull(re->mark);
+    AssertNotNull(re->clist);
+    AssertNotNull(re->nlist);
+    AssertNotNull(re->dfa);
+    re->dfa->startBol = -1;
+    re->dfa->startMid = -1;
+}
+
+// Compiles pattern. Returns NULL on syntax error or if the pattern is too big.
+Regex *RegexCompile(char *pattern, int length)
+{
+    Regex *re = MemZeroAlloc(sizeof(Regex));
+    AssertNotNull(re);
+
+    int maxNodes = length * 3 + 8;
+    Parser p = {
+        .re = re,
+        .src = pattern,
+        .length = length,
+        .nodes = MemZeroAlloc(maxNodes * sizeof(Node)),
+        .maxNodes = maxNodes,
+    };
+    AssertNotNull(p.nodes);
+
+    Node *root = parseAlt(&p);
+    if (!atEnd(&p))
+        p.failed = true; // Unmatched )
+
+    re->prog = MemAlloc(REGEX_MAX_INST * sizeof(Inst));
+    AssertNotNull(re->prog);
+
+    if (p.failed || !compileNode(re, root) || emit(re, OP_MATCH, 0, 0) == -1)
+    {
+        MemFree(p.nodes);
+        RegexFree(re);
+        return NULL;
+    }
+
+    Node *scratch[maxNodes];
+    Literal lit = requiredLiteral(re, root, scratch, maxNodes);
+    SearchCompile(&re->literal, lit.chars, lit.length);
+    MemFree(p.nodes);
+
+    allocState(re);
+    return re;
+}
+
+// Returns a copy of re with its own DFA cache and scratch space so it can be
+// used on another thread. The program is shared, re must outlive the copy.
+Regex *RegexClone(Regex *re)
+{
+    Regex *copy = MemZeroAlloc(sizeof(Regex));
+    AssertNotNull(copy);
+
+    copy->prog = re->prog;
+    copy->numInst = re->numInst;
+    copy->sets = re->sets;
+    copy->numSets = re->numSets;
+    copy->literal = re->literal;
+    copy->shared = true;
+
+    allocState(copy);
+    return copy;
+}
+
+static void dfaFlush(Dfa *d)
+{
+    for (int i = 0; i < d->numStates; i++)
+        MemFree(d->states[i].pcs);
+    d->numStates = 0;
+    d->startBol = -1;
+    d->startMid = -1;
+    memset(d->table, 0, sizeof(d->table));
+}
+
+void RegexFree(Regex *re)
+{
+    if (re == NULL)
+        return;
+
+    if (re->dfa != NULL)
+    {
+        dfaFlush(re->dfa);
+        MemFree(re->dfa->states);
+        MemFree(re->dfa);
+    }
+
+    if (!re->shared)
+    {
+        MemFree(re->prog);
+        MemFree(re->sets);
+    }
+
+    MemFree(re->stack);
+    MemFree(re->mark);
+    MemFree(re->clist);
+    MemFree(re->nlist);
+    MemFree(re);
+}
+
+// Adds pc and everything reachable from it without consuming a byte to list,
+// unless already marked with the current gen. Assertions pass if bol or eol is
+// true, otherwise OP_EOL is added to the list so it can be checked later.
+static int closure(Regex *re, int pc, bool bol, bool eol, int *list, int count)
+{
+    int top = 0;
+    re->stack[top++] = pc;
+
+    while (top > 0)
+    {
+        pc = re->stack[--top];
+        if (re->mark[pc] == re->gen)
+            continue;
+        re->mark[pc] = re->gen;
+
+        Inst *inst = &re->prog[pc];
+        switch (inst->op)
+        {
+        case OP_JMP:
+            re->stack[top++] = inst->x;
+            break;
+
+        case OP_SPLIT:
+            // Push y first so x is explored first, keeping priority order
+            re->stack[top++] = inst->y;
+            re->stack[top++] = inst->x;
+            break;
+
+        case OP_BOL:
+            if (bol)
+                re->stack[top++] = pc + 1;
+            break;
+
+        case OP_EOL:
+            if (eol)
+                re->stack[top++] = pc + 1;
+            else
+                list[count++] = pc;
+            break;
+
+        default:
+            list[count++] = pc;
+        }
+    }
+
+    return count;
+}
+
+static int compareInt(const void *a, const void *b)
+{
+    return *(int *)a - *(int *)b;
+}
+
+static uint32_t hashPcs(int *pcs, int count)
+{
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < count; i++)
+        h = (h ^ pcs[i]) * 16777619u;
+    return h;
+}
+
+// Returns index of state with the given sorted pcs, adding it if new.
+static int dfaAddState(Regex *re, int *pcs, int count)
+{
+    Dfa *d = re->dfa;
+    uint32_t h = hashPcs(pcs, count) & (DFA_TABLE_SIZE - 1);
+
+    while (d->table[h] != 0)
+    {
+        DfaState *s = &d->states[d->table[h] - 1];
+        if (s->numPcs == count && !memcmp(s->pcs, pcs, count * sizeof(int)))
+            return d->table[h] - 1;
+        h = (h + 1) & (DFA_TABLE_SIZE - 1);
+    }
+
+    if (d->states == NULL)
+    {
+        d->states = MemAlloc(DFA_MAX_STATES * sizeof(DfaState));
+        AssertNotNull(d->states);
+    }
+
+    DfaState *s = &d->states[d->numStates];
+    s->pcs = MemAlloc(max(count, 1) * sizeof(int));
+    AssertNotNull(s->pcs);
+    memcpy(s->pcs, pcs, count * sizeof(int));
+    s->numPcs = count;
+    s->acceptsEol = -1;
+    s->match = false;
+    memset(s->next, -1, sizeof(s->next));
+
+    for (int i = 0; i < count; i++)
+        if (re->prog[pcs[i]].op == OP_MATCH)
+            s->match = true;
+
+    d->table[h] = ++d->numStates;
+    return d->numStates - 1;
+}
+
+static int dfaStart(Regex *re, bool bol)
+{
+    Dfa *d = re->dfa;
+    int *start = bol ? &d->startBol : &d->startMid;
+
+    if (*start == -1)
+    {
+        if (d->numStates >= DFA_MAX_STATES)
+            dfaFlush(d);
+
+        int list[re->numInst];
+        re->gen++;
+        int count = closure(re, 0, bol, false, list, 0);
+        qsort(list, count, sizeof(int), compareInt);
+        *start = dfaAddState(re, list, count);
+    }
+
+    return *start;
+}
+
+// Computes and caches the transition from state on byte c. Returns new state.
+static int dfaStep(Regex *re, int state, unsigned char c)
+{
+    Dfa *d = re->dfa;
+    int list[re->numInst];
+    int count = 0;
+    re->gen++;
+
+    DfaState *s = &d->states[state];
+    for (int i = 0; i < s->numPcs; i++)
+    {
+        Inst *inst = &re->prog[s->pcs[i]];
+        if (inst->op == OP_SET && setHas(&re->sets[inst->set], c))
+            count = closure(re, s->pcs[i] + 1, false, false, list, count);
+    }
+
+    // Unanchored search, a match may start at any position
+    count = closure(re, 0, false, false, list, count);
+    qsort(list, count, sizeof(int), compareInt);
+
+    if (d->numStates >= DFA_MAX_STATES)
+    {
+        // Cache is full. Start over, the current state is no longer needed.
+        dfaFlush(d);
+        return dfaAddState(re, list, count);
+    }
+
+    int next = dfaAddState(re, list, count);
+    d->states[state].next[c] = next;
+    return next;
+}
+
+static bool dfaAcceptsEol(Regex *re, int state)
+{
+    DfaState *s = &re->dfa->states[state];
+    if (s->acceptsEol != -1)
+        return s->acceptsEol;
+
+    int list[re->numInst];
+    int count = 0;
+    re->gen++;
+
+    for (int i = 0; i < s->numPcs; i++)
+        if (re->prog[s->pcs[i]].op == OP_EOL)
+            count = closure(re, s->pcs[i] + 1, false, true, list, count);
+
+    s->acceptsEol = false;
+    for (int i = 0; i < count; i++)
+        if (re->prog[list[i]].op == OP_MATCH)
+            s->acceptsEol = true;
+
+    return s->acceptsEol;
+}
+
+// Returns true if there is any match starting at or after from.
+static bool dfaMatches(Regex *re, char *text, int length, int from)
+{
+    Dfa *d = re->dfa;
+    int state = dfaStart(re, from == 0);
+
+    for (int i = from; i < length; i++)
+    {
+        if (d->states[state].match)
+            return true;
+
+        int next = d->states[state].next[(unsigned char)text[i]];
+        state = next != -1 ? next : dfaStep(re, state, text[i]);
+    }
+
+    return d->states[state].match || dfaAcceptsEol(re, state);
+}
+
+// Adds threads for everything reachable from pc at pos to list.
+static int addThread(Regex *re, Thread *list, int count, int pc, int start, int pos, int length)
+{
+    int pcs[re->numInst];
+    int n = closure(re, pc, pos == 0, pos == length, pcs, 0);
+    for (int i = 0; i < n; i++)
+        if (re->prog[pcs[i]].op != OP_EOL)
+            list[count++] = (Thread){.pc = pcs[i], .start = start};
+    return count;
+}
+
+// Pike VM. Threads are kept in priority order, which is also the order of their
+// start positions, so the first thread to reach a state is the leftmost one.
+static int pikeSearch(Regex *re, char *text, int length, int from, int *matchLength)
+{
+    Thread *clist = re->clist;
+    Thread *nlist = re->nlist;
+    int ccount = 0;
+    int best = -1, bestEnd = -1;
+
+    re->gen++;
+    for (int pos = from; pos <= length; pos++)
+    {
+        if (best == -1)
+            ccount = addThread(re, clist, ccount, 0, pos, pos, length);
+        else if (ccount == 0)
+            break;
+
+        int ncount = 0;
+        re->gen++;
+
+        for (int i = 0; i < ccount; i++)
+        {
+            Thread t = clist[i];
+            if (best != -1 && t.start > best)
+                continue;
+
+            Inst *inst = &re->prog[t.pc];
+            if (inst->op == OP_MATCH)
+            {
+                if (best == -1 || t.start < best || pos > bestEnd)
+                {
+                    best = t.start;
+                    bestEnd = pos;
+                }
+            }
+            else if (pos < length && setHas(&re->sets[inst->set], text[pos]))
+                ncount = addThread(re, nlist, ncount, t.pc + 1, t.start, pos + 1, length);
+        }
+
+        Thread *tmp = clist;
+        clist = nlist;
+        nlist = tmp;
+        ccount = ncount;
+    }
+
+    if (best != -1 && matchLength != NULL)
+        *matchLength = bestEnd - best;
+    return best;
+}
+
+// Pike VM for the last match starting at or before from, in one pass. A thread
+// is started at every position up to from and put first, so when two threads
+// reach the same state the later start is kept. Both match at the same ends
+// from there, and only the later start can be the last match.
+static int pikeSearchLast(Regex *re, char *text, int length, int from, int *matchLength)
+{
+    Thread *clist = re->clist;
+    Thread *nlist = re->nlist;
+    int best = -1, bestEnd = -1;
+
+    re->gen++;
+    int ccount = addThread(re, clist, 0, 0, 0, 0, length);
+
+    for (int pos = 0; pos <= length; pos++)
+    {
+        int ncount = 0;
+        re->gen++;
+
+        if (pos < from)
+            ncount = addThread(re, nlist, 0, 0, pos + 1, pos + 1, length);
+
+        for (int i = 0; i < ccount; i++)
+        {
+            Thread t = clist[i];
+            if (t.start < best)
+                continue;
+
+            Inst *inst = &re->prog[t.pc];
+            if (inst->op == OP_MATCH)
+            {
+                if (t.start > best || pos > bestEnd)
+                {
+                    best = t.start;
+                    bestEnd = pos;
+                }
+            }
+            else if (pos < length && setHas(&re->sets[inst->set], text[pos]))
+                ncount = addThread(re, nlist, ncount, t.pc + 1, t.start, pos + 1, length);
+        }
+
+        Thread *tmp = clist;
+        clist = nlist;
+        nlist = tmp;
+        ccount = ncount;
+
+        if (ccount == 0 && pos >= from)
+            break;
+    }
+
+    if (best != -1 && matchLength != NULL)
+        *matchLength = bestEnd - best;
+    return best;
+}
+
+// Returns the literal every match contains. Its length is 0 if there is none.
+// Used to find candidate lines in large texts before running the regex.
+Search *RegexLiteral(Regex *re)
+{
+    return &re->literal;
+}
+
+// Returns index of leftmost match starting at or after from, -1 if none is
+// found. Writes length of match to matchLength if not NULL.
+int RegexSearch(Regex *re, char *text, int length, int from, int *matchLength)
+{
+    if (from < 0 || from > length)
+        return -1;
+
+    if (re->literal.length > 0 && SearchForward(&re->literal, text, length, from, NULL) == -1)
+        return -1;
+
+    // The DFA does not track line begin at the end of an empty line
+    if (length > 0 && !dfaMatches(re, text, length, from))
+        return -1;
+
+    return pikeSearch(re, text, length, from, matchLength);
+}
+
+// Returns index of last match starting at or before from, -1 if none is found.
+// Writes length of match to matchLength if not NULL.
+int RegexSearchLast(Regex *re, char *text, int length, int from, int *matchLength)
+{
+    from = min(from, length);
+    if (from < 0)
+        return -1;
+
+    if (re->literal.length > 0 && SearchForward(&re->literal, text, length, 0, NULL) == -1)
+        return -1;
+
+    return pikeSearchLast(re, text, length, from, matchLength);
+}
@@ -0,0 +1,166 @@
+// Substring search used by find, replace etc. Patterns are compiled once into a
+// Search object. Forward searches look for the least common byte of the pattern
+// with memchr, which the crt vectorizes, and fall back to a Horspool scan when
+// that byte turns out to be common in the text. Backward searches use a
+// mirrored Horspool table. Regex searches are handled by util/regex.c.
+
+#include "rum.h"
+
+// Bytes ordered from most to least common in source code and plain text.
+// Bytes not in the list are considered rare.
+static const char commonBytes[] = " etaoinsrlcdhu\npmf_()=;,.gybw\"*/xvk-{}#>:<0[]1&'+\\!2|%?";
+
+static int byteRank(unsigned char c)
+{
+    char *pos = strchr(commonBytes, c);
+    if (c == 0 || pos == NULL)
+        return sizeof(commonBytes);
+    return pos - commonBytes;
+}
+
+// Number of prefilter candidates allowed per byte scanned before switching to
+// Horspool. A common rare byte makes memchr stop so often it is slower.
+#define PREFILTER_MIN_SKIP 16
+
+// Compiles pattern into s. Pattern is truncated to MAX_SEARCH-1 bytes.
+void SearchCompile(Search *s, char *pattern, int length)
+{
+    length = min(length, MAX_SEARCH - 1);
+    memset(s->pattern, 0, MAX_SEARCH);
+    memcpy(s->pattern, pattern, length);
+    s->length = length;
+    s->regex = NULL;
+
+    // Find the least common byte in pattern
+    s->rare = 0;
+    for (int i = 1; i < length; i++)
+        if (byteRank(pattern[i]) > byteRank(pattern[s->rare]))
+            s->rare = i;
+
+    // Shift tables: distance from the last (or first) occurrence of each byte
+    for (int i = 0; i < 256; i++)
+    {
+        s->skip[i] = length;
+        s->skipRev[i] = length;
+    }
+    for (int i = 0; i < length - 1; i++)
+        s->skip[(unsigned char)pattern[i]] = length - 1 - i;
+    for (int i = length - 1; i > 0; i--)
+        s->skipRev[(unsigned char)pattern[i]] = i;
+}
+
+// Horspool scan from pos. Returns index of match or -1.
+static int horspool(Search *s, char *text, int length, int pos)
+{
+    int last = s->length - 1;
+    unsigned char lastc = s->pattern[last];
+
+    while (pos <= length - s->length)
+    {
+        unsigned char c = text[pos + last];
+        if (c == lastc && !memcmp(text + pos, s->pattern, last))
+            return pos;
+        pos += s->skip[c];
+    }
+
+    return -1;
+}
+
+// Compiles regex pattern into s. Returns error if the pattern is invalid.
+Status SearchCompileRegex(Search *s, char *pattern, int length)
+{
+    Regex *re = RegexCompile(pattern, length);
+    if (re == NULL)
+        return RETURN_ERROR;
+
+    SearchCompile(s, pattern, length);
+    s->regex = re;
+    return RETURN_SUCCESS;
+}
+
+// Frees the compiled regex, if any. The search is empty after.
+void SearchFree(Search *s)
+{
+    RegexFree(s->regex);
+    s->regex = NULL;
+    s->length = 0;
+}
+
+// Copies src into dst. Regex searches get their own match state so the copy can
+// be used on another thread. Free with SearchFree, src must outlive it.
+void SearchClone(Search *dst, Search *src)
+{
+    *dst = *src;
+    if (src->regex != NULL)
+        dst->regex = RegexClone(src->regex);
+}
+
+// Returns index of first match at or after from in text, -1 if none is found.
+// Writes length of match to matchLength if not NULL.
+int SearchForward(Search *s, char *text, int length, int from, int *matchLength)
+{
+    if (s->regex != NULL)
+        return RegexSearch(s->regex, text, length, from, matchLength);
+
+    if (matchLength != NULL)
+        *matchLength = s->length;
+
+    if (s->length == 0 || from < 0 || length - from < s->length)
+        return -1;
+
+    char rarec = s->pattern[s->rare];
+    int pos = from;
+    int candidates = 0;
+
+    if (s->length == 1)
+    {
+        char *p = memchr(text + pos, rarec, length - pos);
+        return p != NULL ? p - text : -1;
+    }
+
+    while (pos <= length - s->length)
+    {
+        // Rare byte can only be within the window where a full match fits
+        char *begin = text + pos + s->rare;
+        char *p = memchr(begin, rarec, length - s->length - pos + 1);
+        if (p == NULL)
+            return -1;
+
+        int start = (p - text) - s->rare;
+        if (!memcmp(text + start, s->pattern, s->length))
+            return start;
+
+        pos = start + 1;
+        if (++candidates > 8 && candidates * PREFILTER_MIN_SKIP > pos - from)
+            return horspool(s, text, length, pos);
+    }
+
+    return -1;
+}
+
+// Returns index of last match starting at or before from, -1 if none is found.
+// Writes length of match to matchLength if not NULL.
+int SearchBackward(Search *s, char *text, int length, int from, int *matchLength)
+{
+    if (s->regex != NULL)
+        return RegexSearchLast(s->regex, text, length, from, matchLength);
+
+    if (matchLength != NULL)
+        *matchLength = s->length;
+
+    if (s->length == 0)
+        return -1;
+
+    int pos = min(from, length - s->length);
+    unsigned char firstc = s->pattern[0];
+
+    while (pos >= 0)
+    {
+        unsigned char c = text[pos];
+        if (c == firstc && !memcmp(text + pos + 1, s->pattern + 1, s->length - 1))
+            return pos;
+        pos -= s->skipRev[c];
+    }
+
+    return -1;
+}
@@ -47,8 +47,47 @@ char *StrMemStr(char *buf, char *substr, size_t size)
     return NULL;
 }
 
+// Writes n to dest with comma seperated thousands, eg. 12,004. Returns length.
+int StrFormatInt(char *dest, int n)
+{
+    char digits[16];
+    int length = sprintf(digits, "%d", abs(n));
+    int pos = 0;
+
+    if (n < 0)
+        dest[pos++] = '-';
+
+    for (int i = 0; i < length; i++)
+    {
+        if (i > 0 && (length - i) % 3 == 0)
+            dest[pos++] = ',';
+        dest[pos++] = digits[i];
+    }
+
+    dest[pos] = 0;
+    return pos;
+}
+
 // Returns true if c is a printable ascii character
 bool isChar(char c)
 {
     return c >= 32 && c <= 126;
-}
\ No newline at end of file
+}
+
+// Writes path of a file in the rum temp directory to dest. The file is named by
+// a hash of the full path of filepath, with ext added. Returns false on fail.
+bool StrTempPath(char *dest, char *filepath, char *ext)
+{
+    char fullPath[MAX_PATH], dir[MAX_PATH];
+    if (GetFullPathNameA(filepath, MAX_PATH, fullPath, NULL) == 0 || GetTempPathA(MAX_PATH, dir) == 0)
+        return false;
+
+    uint32_t hash = 2166136261u;
+    for (char *p = fullPath; *p != 0; p++)
+        hash = (hash ^ (uint8_t)*p) * 16777619u;
+
+    strncat(dir, "rum", MAX_PATH - strlen(dir) - 1);
+    CreateDirectoryA(dir, NULL);
+    snprintf(dest, MAX_PATH, "%s\\%08x%s", dir, hash, ext);
+    return true;
+}